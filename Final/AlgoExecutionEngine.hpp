@@ -0,0 +1,332 @@
+/**
+* AlgoExecutionEngine.hpp
+* Definition of AlgoExecutionEngine class
+*
+* Accepts parent orders and slices them into child ExecutionOrders:
+*   TWAP    - equal slices at a fixed interval
+*   VWAP    - slices following a volume profile at a fixed interval
+*   ICEBERG - one visible child at a time, the next one released on its fill
+*
+* Slices are driven by the shared TimerWheel, each one a one-shot that arms
+* the next, fills come back through OnChildFill / OnChildDone. Every event is O(1) in the number of parents.
+* A TWAP/VWAP parent whose schedule is over expires once its last child
+* leaves the market unfilled. Finished parents are dropped as soon as none
+* of their children is live, and their slots are reused.
+*
+* @Yunze Sun
+*/
+
+#ifndef AlgoExecutionEngine_h
+#define AlgoExecutionEngine_h
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "executionservice.hpp"
+#include "TimerWheel.hpp"
+#include "utility.h"
+using namespace std;
+
+enum AlgoType { TWAP, VWAP, ICEBERG };
+
+enum ParentOrderState { PARENT_WORKING, PARENT_FILLED, PARENT_CANCELLED, PARENT_EXPIRED };
+
+/**
+* Slicing schedule of a parent order.
+* duration and numSlices are used by TWAP/VWAP,
+* volumeProfile (relative weights, one per slice) by VWAP,
+* displayQuantity by ICEBERG.
+*/
+struct AlgoSchedule {
+    AlgoType algoType;
+    long duration;
+    int numSlices;
+    vector<double> volumeProfile;
+    long displayQuantity;
+};
+
+/**
+* Parent order worked by the engine.
+* Type T is the product type.
+*/
+template<typename T>
+class ParentOrder {
+public:
+    // ctor
+    ParentOrder(const T& _product, const OrderId& _parentOrderId, PricingSide _side, double _price, long _quantity, const AlgoSchedule& _schedule)
+        : product(_product), parentOrderId(_parentOrderId), side(_side), price(_price), quantity(_quantity),
+        algoType(_schedule.algoType), displayQuantity(_schedule.displayQuantity),
+        released(0), filled(0), nextSlice(0), liveChildren(0), interval(1), timerId(0), state(PARENT_WORKING) {};
+
+    const T& GetProduct() const { return product; }
+    const OrderId& GetParentOrderId() const { return parentOrderId; }
+    PricingSide GetSide() const { return side; }
+    double GetPrice() const { return price; }
+    long GetQuantity() const { return quantity; }
+    AlgoType GetAlgoType() const { return algoType; }
+
+    // quantity sent to the market and not yet filled or expired
+    long GetWorkingQuantity() const { return released - filled; }
+
+    long GetFilledQuantity() const { return filled; }
+    ParentOrderState GetState() const { return state; }
+
+private:
+    template<typename> friend class AlgoExecutionEngine;
+
+    T product;
+    OrderId parentOrderId;
+    PricingSide side;
+    double price;
+    long quantity;
+    AlgoType algoType;
+    long displayQuantity;
+    vector<long> cumTarget; // cumulative quantity due after each slice
+    long released;
+    long filled;
+    int nextSlice;
+    int liveChildren;
+    long interval; // ms between slices
+    TimerWheel::TimerId timerId; // next slice
+    ParentOrderState state;
+};
+
+template<typename T>
+class AlgoExecutionEngine {
+public:
+    typedef function<void(ExecutionOrder<T>&)> ChildSink;
+
+    // ctor, children are handed to the sink as soon as they are released, the timer must be turned by the caller
+    AlgoExecutionEngine(TimerWheel* _timer, ChildSink _sink, size_t _expectedParents = 1024);
+
+    // start working a parent order, returns its id
+    OrderId AddParentOrder(const T& product, PricingSide side, double price, long quantity, const AlgoSchedule& schedule);
+
+    // cancel the unreleased part of a parent order
+    bool CancelParentOrder(const OrderId& parentOrderId);
+
+    // a child got (partially) filled
+    void OnChildFill(const OrderId& childOrderId, long quantity);
+
+    // a child left the market, its unfilled quantity returns to the parent
+    void OnChildDone(const OrderId& childOrderId);
+
+    // null once the parent is finished and none of its children is live
+    const ParentOrder<T>* FindParentOrder(const OrderId& parentOrderId) const {
+        auto it = parentIndex.find(parentOrderId);
+        return it == parentIndex.end() ? nullptr : &parents[it->second];
+    }
+
+    size_t GetWorkingParents() const { return workingParents; }
+    size_t GetParents() const { return parentIndex.size(); }
+    size_t GetLiveChildren() const { return children.size(); }
+
+private:
+    struct ChildInfo {
+        size_t parent;
+        long leaves;
+    };
+
+    TimerWheel* timer;
+    ChildSink sink;
+    vector<ParentOrder<T> > parents;
+    vector<size_t> freeParents; // slots of dropped parents
+    unordered_map<OrderId, size_t> parentIndex;
+    unordered_map<OrderId, ChildInfo> children;
+    size_t workingParents;
+    long parentCount;
+    long childCount;
+
+    void ReleaseSlice(size_t index);
+    // arm the next slice if the schedule has one left
+    void ScheduleSlice(size_t index);
+    void ReleaseChild(size_t index, long childQuantity);
+    void Complete(size_t index, ParentOrderState state);
+    // a child left the market, the parent is finished or dropped if it was the last one
+    void ChildGone(size_t index);
+    // drop a finished parent once none of its children is live
+    void Prune(size_t index);
+};
+
+
+template<typename T>
+AlgoExecutionEngine<T>::AlgoExecutionEngine(TimerWheel* _timer, ChildSink _sink, size_t _expectedParents)
+    : timer(_timer), sink(_sink), workingParents(0), parentCount(1), childCount(1)
+{
+    parents.reserve(_expectedParents);
+    parentIndex.reserve(_expectedParents);
+    children.reserve(_expectedParents * 2);
+}
+
+template<typename T>
+OrderId AlgoExecutionEngine<T>::AddParentOrder(const T& product, PricingSide side, double price, long quantity, const AlgoSchedule& schedule) {
+    OrderId parentOrderId = "P" + IdGenerator(parentCount++, 12);
+    size_t index;
+    if (!freeParents.empty()) {
+        index = freeParents.back();
+        freeParents.pop_back();
+        parents[index] = ParentOrder<T>(product, parentOrderId, side, price, quantity, schedule);
+    }
+    else {
+        index = parents.size();
+        parents.push_back(ParentOrder<T>(product, parentOrderId, side, price, quantity, schedule));
+    }
+    parentIndex.insert(pair<OrderId, size_t>(parentOrderId, index));
+    ++workingParents;
+
+    ParentOrder<T>& parent = parents[index];
+    if (schedule.algoType == ICEBERG) {
+        if (parent.displayQuantity <= 0) parent.displayQuantity = quantity;
+        ReleaseChild(index, min(parent.displayQuantity, quantity));
+        return parentOrderId;
+    }
+
+    // precompute the cumulative target of every slice once, each slice is then O(1)
+    int slices = schedule.numSlices > 0 ? schedule.numSlices : 1;
+    vector<double> weights(slices, 1.0);
+    if (schedule.algoType == VWAP && (int)schedule.volumeProfile.size() == slices) weights = schedule.volumeProfile;
+    double total = 0;
+    for (double w : weights) total += w;
+    double cum = 0;
+    parent.cumTarget.resize(slices);
+    for (int i = 0; i < slices; ++i) {
+        cum += weights[i];
+        parent.cumTarget[i] = (long)(quantity * cum / total);
+    }
+    parent.cumTarget[slices - 1] = quantity;
+
+    long interval = schedule.duration / slices;
+    parent.interval = interval > 0 ? interval : 1;
+
+    // first slice goes now, the rest on the timer
+    ReleaseSlice(index);
+    ScheduleSlice(index);
+    return parentOrderId;
+}
+
+template<typename T>
+bool AlgoExecutionEngine<T>::CancelParentOrder(const OrderId& parentOrderId) {
+    auto it = parentIndex.find(parentOrderId);
+    if (it == parentIndex.end() || parents[it->second].state != PARENT_WORKING) return false;
+    size_t index = it->second;
+    Complete(index, PARENT_CANCELLED);
+    Prune(index);
+    return true;
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::OnChildFill(const OrderId& childOrderId, long quantity) {
+    auto it = children.find(childOrderId);
+    if (it == children.end()) return;
+
+    ChildInfo& child = it->second;
+    long qty = min(quantity, child.leaves);
+    child.leaves -= qty;
+    size_t index = child.parent;
+    bool gone = child.leaves == 0;
+    if (gone) children.erase(it);
+
+    ParentOrder<T>& parent = parents[index];
+    parent.filled += qty;
+    if (parent.filled >= parent.quantity) Complete(index, PARENT_FILLED);
+    if (gone) ChildGone(index);
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::OnChildDone(const OrderId& childOrderId) {
+    auto it = children.find(childOrderId);
+    if (it == children.end()) return;
+
+    size_t index = it->second.parent;
+    // unfilled quantity is released again by the next slice
+    parents[index].released -= it->second.leaves;
+    children.erase(it);
+    ChildGone(index);
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::ChildGone(size_t index) {
+    ParentOrder<T>& parent = parents[index];
+    --parent.liveChildren;
+
+    if (parent.state == PARENT_WORKING && parent.liveChildren == 0) {
+        if (parent.algoType == ICEBERG) {
+            // iceberg shows the next clip once the current one is gone
+            ReleaseChild(index, min(parent.displayQuantity, parent.quantity - parent.released));
+        }
+        else if (parent.nextSlice >= (int)parent.cumTarget.size()) {
+            // the schedule is over and nothing is left in the market
+            Complete(index, PARENT_EXPIRED);
+        }
+    }
+
+    Prune(index);
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::Prune(size_t index) {
+    ParentOrder<T>& parent = parents[index];
+    if (parent.state == PARENT_WORKING || parent.liveChildren > 0) return;
+    if (parentIndex.erase(parent.parentOrderId) == 0) return;
+    parent.cumTarget = vector<long>();
+    freeParents.push_back(index);
+}
+
+// release whatever the schedule says is due by the current slice
+template<typename T>
+void AlgoExecutionEngine<T>::ReleaseSlice(size_t index) {
+    ParentOrder<T>& parent = parents[index];
+    if (parent.state != PARENT_WORKING) return;
+
+    int slice = min(parent.nextSlice, (int)parent.cumTarget.size() - 1);
+    long due = parent.cumTarget[slice] - parent.released;
+    ++parent.nextSlice;
+
+    // after the last slice the parent expires with its last child
+    if (due > 0) ReleaseChild(index, due);
+    else if (parent.nextSlice >= (int)parent.cumTarget.size() && parent.liveChildren == 0) {
+        // every child already left unfilled, nothing more is coming back
+        Complete(index, PARENT_EXPIRED);
+        Prune(index);
+    }
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::ScheduleSlice(size_t index) {
+    ParentOrder<T>& parent = parents[index];
+    // the slot may already belong to a parent added while the last slice went out
+    if (parent.state != PARENT_WORKING || parent.timerId || parent.nextSlice >= (int)parent.cumTarget.size()) return;
+    parent.timerId = timer->Schedule(parent.interval, [this, index]() {
+        parents[index].timerId = 0;
+        ReleaseSlice(index);
+        ScheduleSlice(index);
+    });
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::ReleaseChild(size_t index, long childQuantity) {
+    if (childQuantity <= 0) return;
+    ParentOrder<T>& parent = parents[index];
+    OrderId childOrderId = "C" + IdGenerator(childCount++, 12);
+    parent.released += childQuantity;
+    ++parent.liveChildren;
+    children.insert(pair<OrderId, ChildInfo>(childOrderId, ChildInfo{ index, childQuantity }));
+
+    ExecutionOrder<T> child(parent.product, parent.side, childOrderId, LIMIT, parent.price, childQuantity, 0, parent.parentOrderId, true);
+    sink(child);
+}
+
+template<typename T>
+void AlgoExecutionEngine<T>::Complete(size_t index, ParentOrderState state) {
+    ParentOrder<T>& parent = parents[index];
+    if (parent.state != PARENT_WORKING) return;
+    parent.state = state;
+    --workingParents;
+    if (parent.timerId) {
+        timer->Cancel(parent.timerId);
+        parent.timerId = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+* AnalyticsTickCache.hpp
+* Definition of AnalyticsTickCache class
+*
+* Memo of the bond analytics by price. Prices move on the 1/256 grid and a
+* mid of two of them on the 1/512 grid, within a narrow range, so the same
+* few hundred prices per bond come back again and again. Every bond has a
+* direct-mapped table of slotsPerBond entries keyed by the integer tick
+* price (price * ticksPerPoint); a new tick evicts whatever shares its slot.
+* Prices off the grid are never cached. The analytics depend on the
+* settlement date, so a roll clears the whole cache.
+*
+* @Yunze Sun
+*/
+
+#ifndef AnalyticsTickCache_h
+#define AnalyticsTickCache_h
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+struct BondRisk {
+    double price; // clean
+    double yield;
+    double modifiedDuration;
+    double convexity;
+    double pv01; // per 100 face
+};
+
+class AnalyticsTickCache {
+public:
+    // ctor, slotsPerBond rounded up to a power of two, 0 disables the cache
+    AnalyticsTickCache(int _numBonds, int _slotsPerBond = 1024, int _ticksPerPoint = 512);
+
+    // tick of a price, false if the price is off the grid
+    bool ToTick(double price, long long& tick) const;
+
+    // cached risk of a bond at a tick, null on a miss
+    const BondRisk* Find(int bond, long long tick);
+    void Insert(int bond, long long tick, const BondRisk& risk);
+
+    // drop every entry, on a settlement date roll
+    void Clear();
+
+    bool IsEnabled() const { return mask >= 0; }
+    long GetHits() const { return hits; }
+    long GetMisses() const { return misses; }
+    long GetEvictions() const { return evictions; }
+    long GetClears() const { return clears; }
+    double GetHitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0; }
+
+private:
+    struct Entry {
+        long long tick; // -1 when empty
+        BondRisk risk;
+    };
+
+    int numBonds;
+    int slotsPerBond;
+    long long mask;
+    double ticksPerPoint;
+    vector<Entry> entries; // [bond * slotsPerBond + slot]
+    long hits, misses, evictions, clears;
+};
+
+
+AnalyticsTickCache::AnalyticsTickCache(int _numBonds, int _slotsPerBond, int _ticksPerPoint)
+    : numBonds(_numBonds), slotsPerBond(0), mask(-1), ticksPerPoint(_ticksPerPoint), hits(0), misses(0), evictions(0), clears(0)
+{
+    if (_slotsPerBond <= 0) return;
+    slotsPerBond = 1;
+    while (slotsPerBond < _slotsPerBond) slotsPerBond <<= 1;
+    mask = slotsPerBond - 1;
+    entries.assign((size_t)numBonds * slotsPerBond, Entry{ -1, BondRisk{ 0, 0, 0, 0, 0 } });
+}
+
+bool AnalyticsTickCache::ToTick(double price, long long& tick) const {
+    double ticks = price * ticksPerPoint;
+    double rounded = floor(ticks + 0.5);
+    if (mask < 0 || rounded < 0 || fabs(ticks - rounded) > 1e-6) return false;
+    tick = (long long)rounded;
+    return true;
+}
+
+const BondRisk* AnalyticsTickCache::Find(int bond, long long tick) {
+    Entry& entry = entries[(size_t)bond * slotsPerBond + (tick & mask)];
+    if (entry.tick == tick) {
+        ++hits;
+        return &entry.risk;
+    }
+    ++misses;
+    return nullptr;
+}
+
+void AnalyticsTickCache::Insert(int bond, long long tick, const BondRisk& risk) {
+    Entry& entry = entries[(size_t)bond * slotsPerBond + (tick & mask)];
+    if (entry.tick >= 0 && entry.tick != tick) ++evictions;
+    entry.tick = tick;
+    entry.risk = risk;
+}
+
+void AnalyticsTickCache::Clear() {
+    for (auto& entry : entries) entry.tick = -1;
+    ++clears;
+}
+
+#endif
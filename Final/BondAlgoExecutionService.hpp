@@ -2,7 +2,15 @@
 * BondAlgoExecutionService.hpp
 * Definition of BondAlgoExecutionService class
 *
-* 1 Listener: BondExecutionService
+* 2 Listeners:
+* BondAlgoExecutionServiceListener - listen from BondMarketDataService
+* BondAlgoExecutionFillListener - child order fills from BondExecutionService
+*
+* Parent orders are worked by an AlgoExecutionEngine (TWAP/VWAP/ICEBERG),
+* their child orders flow to the listeners like any other AlgoExecution
+*
+* Every order is split across the venues by a SmartOrderRouter before it
+* is published, one AlgoExecution per venue slice
 *
 * @Yunze Sun
 */
@@ -13,18 +21,37 @@
 #include "BondMarketDataService.hpp"
 #include "soa.hpp"
 #include "utility.h"
+#include "AlgoExecutionEngine.hpp"
+#include "TimerWheel.hpp"
+#include "SmartOrderRouter.hpp"
 #include <map>
 #include <vector>
 using namespace std;
 
 class BondAlgoExecutionService : public Service<string, AlgoExecution<Bond> > {
 private:
-    map<string, AlgoExecution<Bond> > exeMap;
+    map<ProductId, AlgoExecution<Bond> > exeMap;
     vector<ServiceListener<AlgoExecution<Bond> >*> listeners;
     static long count;
+    TimerWheel* timer;
+    AlgoExecutionEngine<Bond>* engine;
+    SmartOrderRouter router;
+
+    // route the order and publish its slices
+    void Route(const ExecutionOrder<Bond>& order);
+
+    // store a new algo execution and flow it to the listeners
+    void Publish(AlgoExecution<Bond>& algoExecution);
+
 public:
-    // ctor
-    BondAlgoExecutionService() { exeMap = map<string, AlgoExecution<Bond> >(); }
+    // ctor, the timer drives the parent order slicing and must be the one the connectors turn
+    BondAlgoExecutionService(TimerWheel* _timer) {
+        exeMap = map<ProductId, AlgoExecution<Bond> >();
+        timer = _timer;
+        engine = new AlgoExecutionEngine<Bond>(timer, [this](ExecutionOrder<Bond>& child) {
+            Route(child);
+        });
+    }
 
     // Implement all the virtual functions
 
@@ -46,6 +73,27 @@ public:
 
     // execute algo based on orderbook, called by listener when adding process
     void AlgoTrading(const OrderBook<Bond>& orderBook);
+
+    // work a parent order, children are sliced according to the schedule
+    OrderId AddParentOrder(const Bond& bond, PricingSide side, double price, long quantity, const AlgoSchedule& schedule) {
+        return engine->AddParentOrder(bond, side, price, quantity, schedule);
+    }
+
+    // cancel the unreleased part of a parent order
+    bool CancelParentOrder(const OrderId& parentOrderId) { return engine->CancelParentOrder(parentOrderId); }
+
+    // fill / expiry of a child order or of one of its venue slices, called on execution reports
+    void OnChildFill(const OrderId& childOrderId, long quantity) { engine->OnChildFill(router.GetOrderId(childOrderId), quantity); }
+    void OnChildDone(const OrderId& childOrderId) {
+        OrderId orderId;
+        if (router.OnSliceDone(childOrderId, orderId)) engine->OnChildDone(orderId);
+    }
+
+    // venue fill rates for the router
+    void OnVenueFill(Market market, long quantity) { router.OnFill(market, quantity); }
+
+    AlgoExecutionEngine<Bond>* GetEngine() { return engine; }
+    SmartOrderRouter& GetRouter() { return router; }
 };
 
 long BondAlgoExecutionService::count = 1;
@@ -73,10 +121,34 @@ private:
 
 
 
+class BondAlgoExecutionFillListener : public ServiceListener<ExecutionFill<Bond> > {
+public:
+    // ctor
+    BondAlgoExecutionFillListener(BondAlgoExecutionService* _bae_service) : bae_service(_bae_service) {};
+
+    // update the parent of the filled child, no-op for orders the engine does not know
+    void ProcessAdd(ExecutionFill<Bond>& data) override {
+        bae_service->OnVenueFill(data.GetMarket(), data.GetQuantity());
+        if (data.GetQuantity() > 0) bae_service->OnChildFill(data.GetOrderId(), data.GetQuantity());
+        if (data.IsDone()) bae_service->OnChildDone(data.GetOrderId());
+    }
+
+    // no implementation
+    void ProcessRemove(ExecutionFill<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(ExecutionFill<Bond>& data) override {}
+
+private:
+    BondAlgoExecutionService* bae_service;
+};
+
+
+
 void BondAlgoExecutionService::AlgoTrading(const OrderBook<Bond>& ob) {
     // get the order book data
     auto bond = ob.GetProduct();
-    string id = bond.GetProductId();
+    ProductId id = bond.GetProductId();
     string orderId = "A" + IdGenerator(count,12);
 
     // get the best bid and offer order and their corresponding price and quantity
@@ -92,8 +164,8 @@ void BondAlgoExecutionService::AlgoTrading(const OrderBook<Bond>& ob) {
     double price;
     long quantity;
 
-    // only agressing when the spread is at its tightest (1/128)
-    if (offerPrice - bidPrice <= 1.0 / 128.0) {
+    // only agressing when the spread is at its tightest (1/64, the generated books never go under it)
+    if (offerPrice - bidPrice <= 1.0 / 64.0 + 1e-9) {
         // alternating between bid and offer, taking the opposite side of the book to cross the spread
         if (count % 2 == 0) {
             side = BID;
@@ -106,6 +178,11 @@ void BondAlgoExecutionService::AlgoTrading(const OrderBook<Bond>& ob) {
             quantity = offerQuantity;
         }
     }
+    else {
+        // nothing to send, side, price and quantity were left unset here
+        count++;
+        return;
+    }
 
     // update the count
     count++;
@@ -114,12 +191,37 @@ void BondAlgoExecutionService::AlgoTrading(const OrderBook<Bond>& ob) {
     // IOC order C immediate-or-cancel
     ExecutionOrder<Bond> executionOrder(bond, side, orderId, IOC, price, quantity, 0, "", false);
 
-    // Create the algo execution
-    AlgoExecution<Bond> algoExecution(executionOrder, CME);
+    Route(executionOrder);
+}
+
+void BondAlgoExecutionService::Route(const ExecutionOrder<Bond>& order) {
+    RouteSlice slices[SmartOrderRouter::VENUES];
+    int numSlices = router.Route(order, slices);
+
+    if (numSlices == 1) {
+        AlgoExecution<Bond> algoExecution(order, slices[0].market);
+        Publish(algoExecution);
+        return;
+    }
+
+    // one order per venue, the visible quantity is used up first
+    long visible = order.GetVisibleQuantity();
+    for (int i = 0; i < numSlices; ++i) {
+        long sliceVisible = min(visible, slices[i].quantity);
+        visible -= sliceVisible;
+        ExecutionOrder<Bond> slice(order.GetProduct(), order.GetSide(), SmartOrderRouter::SliceId(order.GetOrderId(), slices[i].market),
+            order.GetOrderType(), order.GetPrice(), sliceVisible, slices[i].quantity - sliceVisible, order.GetParentOrderId(), order.IsChildOrder());
+        AlgoExecution<Bond> algoExecution(slice, slices[i].market);
+        Publish(algoExecution);
+    }
+}
+
+void BondAlgoExecutionService::Publish(AlgoExecution<Bond>& algoExecution) {
+    ProductId id = algoExecution.GetOrder().GetProduct().GetProductId();
 
     // update the algo execution map
     if (exeMap.find(id) != exeMap.end()) { exeMap.erase(id); }
-    exeMap.insert(pair<string, AlgoExecution<Bond>>(id, algoExecution));
+    exeMap.insert(pair<ProductId, AlgoExecution<Bond>>(id, algoExecution));
 
     // flow the data to listeners
     for (auto& listener : listeners) {
@@ -5,6 +5,10 @@
 * 1 Listener: BondAlgoStreamingServiceListener
 * listen from BondPricingService
 *
+* Quotes are mid +/- spread/2, skewed by a QuoteSkewEngine when one is set.
+* With a QuoteTierGenerator all client tiers are generated in one pass and
+* carried by the same PriceStream, tier 0 being its bid/offer
+*
 * @Yunze Sun
 */
 
@@ -14,19 +18,25 @@
 #include "pricingservice.hpp"
 #include "soa.hpp"
 #include "products.hpp"
+#include "QuoteSkewEngine.hpp"
+#include "QuoteTierGenerator.hpp"
 #include <map>
 #include <vector>
 using namespace std;
 
 class BondAlgoStreamingService : public Service<string, AlgoStream<Bond> > {
 private:
-    map<string, AlgoStream<Bond> > streamMap;
+    map<ProductId, AlgoStream<Bond> > streamMap;
     vector<ServiceListener<AlgoStream<Bond> >*> listeners;
     static long count;
+    QuoteSkewEngine* skew;
+    QuoteTierGenerator* tierGenerator;
 
 public:
-    // ctor
-    BondAlgoStreamingService() { streamMap = map<string, AlgoStream<Bond> >(); }
+    // ctor, quotes stay symmetric without a skew engine and single-tier without a tier generator
+    BondAlgoStreamingService(QuoteSkewEngine* _skew = nullptr, QuoteTierGenerator* _tierGenerator = nullptr) : skew(_skew), tierGenerator(_tierGenerator) {
+        streamMap = map<ProductId, AlgoStream<Bond> >();
+    }
 
     // Implement all the virtual functions
 
@@ -70,7 +80,7 @@ private:
 
 void BondAlgoStreamingService::UpdatePrice(const Price<Bond>& price) {
     Bond product = price.GetProduct();
-    string id = product.GetProductId();
+    ProductId id = product.GetProductId();
 
     double mid = price.GetMid();
     double spread = price.GetBidOfferSpread();
@@ -79,22 +89,36 @@ void BondAlgoStreamingService::UpdatePrice(const Price<Bond>& price) {
 
     // alternate visible size between 1000000 and 2000000
     long visibleQuantity = (count % 2 == 0) ? 1000000 : 2000000;
-    // hidden size is twice the visible size
-    long hiddenQuantity = visibleQuantity * 2;
 
     count++;
 
-    // create bid and offer order
-    PriceStreamOrder bidOrder(bidPrice, visibleQuantity, hiddenQuantity, BID);
-    PriceStreamOrder offerOrder(offerPrice, visibleQuantity, hiddenQuantity, OFFER);
+    // position / risk skew
+    long bidQuantity = visibleQuantity, offerQuantity = visibleQuantity;
+    QuoteTiers tiers;
+    tiers.count = 0;
+    if (tierGenerator) {
+        tierGenerator->Generate(id, mid, spread, visibleQuantity, skew ? skew->GetSkew(id) : nullptr, tiers);
+        bidPrice = tiers.bidPrice[0];
+        offerPrice = tiers.offerPrice[0];
+        bidQuantity = tiers.bidQuantity[0];
+        offerQuantity = tiers.offerQuantity[0];
+    }
+    else if (skew) {
+        skew->Apply(id, bidPrice, offerPrice, bidQuantity, offerQuantity);
+    }
+
+    // create bid and offer order, hidden size is twice the visible size
+    PriceStreamOrder bidOrder(bidPrice, bidQuantity, bidQuantity * 2, BID);
+    PriceStreamOrder offerOrder(offerPrice, offerQuantity, offerQuantity * 2, OFFER);
     // create price stream
     PriceStream<Bond> priceStream(product, bidOrder, offerOrder);
+    priceStream.SetTiers(tiers);
     // create algo stream
     AlgoStream<Bond> algoStream(priceStream);
 
     // update the algo stream map
     if (streamMap.find(id) != streamMap.end()) { streamMap.erase(id); };
-    streamMap.insert(pair<string, AlgoStream<Bond>>(id, algoStream));
+    streamMap.insert(pair<ProductId, AlgoStream<Bond>>(id, algoStream));
 
 
     for (auto& listener : listeners) {
@@ -0,0 +1,305 @@
+/**
+* BondAnalytics.hpp
+* Definition of BondAnalyticsEngine class
+*
+* Yield, modified duration, convexity and PV01 of the bond universe from
+* the live prices. Street convention, semi-annual compounding:
+*
+*   P(y) = sum cf_k / (1 + y/2)^n_k,  P dirty per 100 face
+*   modified duration = -P'(y) / P,  convexity = P''(y) / P
+*   PV01 = modified duration * P * 0.0001, per 100 face (as GetPV01Value)
+*
+* with n = w + k periods to the k-th flow, w the fraction of the current
+* coupon period left, so discounting is one pow per bond and a multiply
+* per flow. The schedules are built once when the engine is created from
+* the ProductService universe, stored cashflow-major ([k][bond], padded
+* with zero flows) so Evaluate runs every loop across the bonds and
+* vectorizes. Prices only mark bonds stale; a risk query solves its bond,
+* Newton on the yield warm-started from the last one. Before solving, the
+* AnalyticsTickCache is asked for the risk at the same tick price.
+*
+* 1 Listener: BondAnalyticsPriceListener
+* listen from BondPricingService
+*
+* @Yunze Sun
+*/
+
+#ifndef BondAnalytics_h
+#define BondAnalytics_h
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "products.hpp"
+#include "BondCashflows.hpp"
+#include "AnalyticsTickCache.hpp"
+using namespace std;
+
+class BondAnalyticsEngine {
+public:
+    // ctor, schedules of every bond against the settlement date, cacheSlots per bond (0 for no cache)
+    BondAnalyticsEngine(const vector<Bond>& _bonds, const date& _settlement = from_string(DEFAULT_SETTLEMENT_DATE), int cacheSlots = 1024);
+
+    // move to a new settlement date, the schedules are rebuilt and the cache cleared
+    void SetSettlementDate(const date& _settlement);
+    const date& GetSettlementDate() const { return settlement; }
+
+    // live clean price of a bond
+    void SetPrice(const ProductId& productId, double cleanPrice);
+
+    // risk of a bond at its last price (at par yield before any price), null if unknown
+    const BondRisk* GetRisk(const ProductId& productId);
+    double GetPV01(const ProductId& productId);
+
+    // solve every stale bond in one pass across the universe
+    void Evaluate();
+
+    int GetProductIndex(const ProductId& productId) const;
+    int Size() const { return numBonds; }
+    long GetSolves() const { return solves; }
+    const AnalyticsTickCache& GetCache() const { return cache; }
+
+private:
+    static const int MAX_ITERATIONS = 20;
+
+    vector<Bond> bonds;
+    date settlement;
+    unordered_map<ProductId, int> productIndex;
+    int numBonds;
+    int numFlows; // cashflows of the longest bond
+
+    // [k * numBonds + bond], 0 past the bond's last flow
+    vector<double> amounts;
+
+    // per bond
+    vector<double> firstPeriod; // fraction of a coupon period to the next flow
+    vector<int> flowCount;
+    vector<double> accrued, dirtyPrice, yield;
+    vector<BondRisk> risk;
+    vector<char> stale;
+    int staleCount;
+    long solves;
+
+    AnalyticsTickCache cache;
+    vector<long long> priceTick; // -1 off the grid or no price
+
+    void BuildSchedules();
+    bool FromCache(int b);
+    void SetRisk(int b, double p, double d1, double d2);
+
+    // one bond on its own
+    void Solve(int b);
+};
+
+
+BondAnalyticsEngine::BondAnalyticsEngine(const vector<Bond>& _bonds, const date& _settlement, int cacheSlots)
+    : bonds(_bonds), settlement(_settlement), numBonds((int)_bonds.size()), numFlows(0), staleCount(0), solves(0),
+    cache((int)_bonds.size(), cacheSlots), priceTick(_bonds.size(), -1)
+{
+    for (int i = 0; i < numBonds; ++i) {
+        productIndex.insert(pair<ProductId, int>(bonds[i].GetProductId(), i));
+    }
+    BuildSchedules();
+}
+
+void BondAnalyticsEngine::BuildSchedules() {
+    vector<CashflowSchedule> schedules;
+    numFlows = 0;
+    for (auto& bond : bonds) {
+        schedules.push_back(BuildCashflowSchedule(bond, settlement));
+        numFlows = max(numFlows, (int)schedules.back().times.size());
+    }
+
+    amounts.assign((size_t)numFlows * numBonds, 0.0);
+    firstPeriod.assign(numBonds, 0.0);
+    flowCount.assign(numBonds, 0);
+    accrued.assign(numBonds, 0.0);
+    dirtyPrice.assign(numBonds, -1.0); // no price yet, priced at the coupon yield
+    yield.assign(numBonds, 0.0);
+    risk.assign(numBonds, BondRisk{ 0, 0, 0, 0, 0 });
+    stale.assign(numBonds, 1);
+    staleCount = numBonds;
+    for (int b = 0; b < numBonds; ++b) {
+        const CashflowSchedule& s = schedules[b];
+        for (size_t k = 0; k < s.times.size(); ++k) {
+            amounts[k * numBonds + b] = s.amounts[k];
+        }
+        firstPeriod[b] = FirstPeriod(s, bonds[b]);
+        flowCount[b] = (int)s.times.size();
+        accrued[b] = s.accrued;
+        yield[b] = bonds[b].GetCoupon();
+    }
+}
+
+void BondAnalyticsEngine::SetSettlementDate(const date& _settlement) {
+    if (_settlement == settlement) return;
+    settlement = _settlement;
+    cache.Clear();
+    vector<double> clean(numBonds, -1);
+    for (int b = 0; b < numBonds; ++b) {
+        if (dirtyPrice[b] >= 0) clean[b] = dirtyPrice[b] - accrued[b];
+    }
+    BuildSchedules();
+    for (int b = 0; b < numBonds; ++b) {
+        if (clean[b] >= 0) dirtyPrice[b] = clean[b] + accrued[b];
+    }
+}
+
+void BondAnalyticsEngine::SetPrice(const ProductId& productId, double cleanPrice) {
+    int b = GetProductIndex(productId);
+    if (b < 0) return;
+    double dirty = cleanPrice + accrued[b];
+    if (dirty == dirtyPrice[b]) return;
+    dirtyPrice[b] = dirty;
+    if (!cache.ToTick(cleanPrice, priceTick[b])) priceTick[b] = -1;
+    if (!stale[b]) {
+        stale[b] = 1;
+        ++staleCount;
+    }
+}
+
+const BondRisk* BondAnalyticsEngine::GetRisk(const ProductId& productId) {
+    int b = GetProductIndex(productId);
+    if (b < 0) return nullptr;
+    if (stale[b] && !FromCache(b)) Solve(b);
+    return &risk[b];
+}
+
+double BondAnalyticsEngine::GetPV01(const ProductId& productId) {
+    const BondRisk* r = GetRisk(productId);
+    return r ? r->pv01 : 0.0;
+}
+
+// p, d1 = sum n v, d2 = sum n (n + 1) v over the discounted flows v, n = firstPeriod + k
+void BondAnalyticsEngine::SetRisk(int b, double p, double d1, double d2) {
+    double g = 1.0 + yield[b] / 2.0;
+    double md = p > 0 ? d1 / (2.0 * g) / p : 0;
+    BondRisk& r = risk[b];
+    r.price = p - accrued[b];
+    r.yield = yield[b];
+    r.modifiedDuration = md;
+    r.convexity = p > 0 ? d2 / (4.0 * g * g) / p : 0;
+    r.pv01 = md * p * 0.0001;
+    stale[b] = 0;
+    --staleCount;
+    ++solves;
+    if (priceTick[b] >= 0) cache.Insert(b, priceTick[b], r);
+}
+
+bool BondAnalyticsEngine::FromCache(int b) {
+    if (priceTick[b] < 0) return false;
+    const BondRisk* hit = cache.Find(b, priceTick[b]);
+    if (!hit) return false;
+    risk[b] = *hit;
+    yield[b] = hit->yield;
+    stale[b] = 0;
+    --staleCount;
+    return true;
+}
+
+void BondAnalyticsEngine::Solve(int b) {
+    double p = 0, d1 = 0, d2 = 0;
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        double d = 1.0 / (1.0 + yield[b] / 2.0);
+        double v = pow(d, firstPeriod[b]);
+        double n = firstPeriod[b];
+        p = 0;
+        d1 = 0;
+        d2 = 0;
+        for (int k = 0; k < flowCount[b]; ++k) {
+            double cf = amounts[(size_t)k * numBonds + b] * v;
+            p += cf;
+            d1 += n * cf;
+            d2 += n * (n + 1.0) * cf;
+            v *= d;
+            n += 1.0;
+        }
+        if (dirtyPrice[b] < 0 || d1 == 0) break;
+        // dP/dy = -d1 / (2 (1 + y/2))
+        double step = (p - dirtyPrice[b]) * 2.0 / (d1 * d);
+        if (fabs(step) < 1e-12) break;
+        yield[b] += step;
+    }
+    SetRisk(b, p, d1, d2);
+}
+
+void BondAnalyticsEngine::Evaluate() {
+    for (int b = 0; b < numBonds && staleCount > 0; ++b) {
+        if (stale[b]) FromCache(b);
+    }
+    if (staleCount == 0) return;
+    int n = numBonds;
+    vector<double> d(n), v(n), w(n), p(n), d1(n), d2(n);
+    vector<char> active(stale);
+
+    // Newton on every stale bond in lockstep, bonds without a price keep their coupon yield
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        for (int b = 0; b < n; ++b) {
+            d[b] = 1.0 / (1.0 + yield[b] / 2.0);
+            v[b] = pow(d[b], firstPeriod[b]);
+            w[b] = firstPeriod[b];
+            p[b] = 0;
+            d1[b] = 0;
+            d2[b] = 0;
+        }
+        for (int k = 0; k < numFlows; ++k) {
+            const double* ak = &amounts[(size_t)k * n];
+            for (int b = 0; b < n; ++b) {
+                double cf = ak[b] * v[b];
+                p[b] += cf;
+                d1[b] += w[b] * cf;
+                d2[b] += w[b] * (w[b] + 1.0) * cf;
+                v[b] *= d[b];
+                w[b] += 1.0;
+            }
+        }
+        bool moving = false;
+        for (int b = 0; b < n; ++b) {
+            if (!active[b]) continue;
+            if (dirtyPrice[b] < 0 || d1[b] == 0) {
+                active[b] = 0;
+                continue;
+            }
+            double step = (p[b] - dirtyPrice[b]) * 2.0 / (d1[b] * d[b]);
+            if (fabs(step) < 1e-12) {
+                active[b] = 0;
+                continue;
+            }
+            yield[b] += step;
+            moving = true;
+        }
+        if (!moving) break;
+    }
+
+    for (int b = 0; b < n; ++b) {
+        if (stale[b]) SetRisk(b, p[b], d1[b], d2[b]);
+    }
+}
+
+int BondAnalyticsEngine::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+
+class BondAnalyticsPriceListener : public ServiceListener<Price<Bond> > {
+public:
+    // ctor
+    BondAnalyticsPriceListener(BondAnalyticsEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(Price<Bond>& data) override { engine->SetPrice(data.GetProduct().GetProductId(), data.GetMid()); }
+
+    // no implementation
+    void ProcessRemove(Price<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Price<Bond>& data) override {}
+
+private:
+    BondAnalyticsEngine* engine;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+* BondCashflows.hpp
+* Cashflow schedule of a fixed coupon Treasury
+*
+* Semi-annual coupons rolled back from the maturity date (end of month
+* maturities stay at month end), per 100 face, times in years ACT/365
+* from the settlement date.
+*
+* @Yunze Sun
+*/
+
+#ifndef BondCashflows_h
+#define BondCashflows_h
+
+#include <vector>
+#include "products.hpp"
+using namespace std;
+
+// settlement date the analytics run against unless told otherwise
+static const char* DEFAULT_SETTLEMENT_DATE = "2017/12/18";
+
+// key rate tenors in years, curve shocks are given on these nodes
+static const int KEY_RATES = 7;
+static const double KEY_RATE_TENORS[KEY_RATES] = { 2, 3, 5, 7, 10, 20, 30 };
+
+// node below t and the weight of the node above, linear between nodes and flat outside
+inline void KeyRateWeight(double t, int& node, double& weight)
+{
+    if (t <= KEY_RATE_TENORS[0]) { node = 0; weight = 0; return; }
+    if (t >= KEY_RATE_TENORS[KEY_RATES - 1]) { node = KEY_RATES - 2; weight = 1; return; }
+    node = 0;
+    while (t > KEY_RATE_TENORS[node + 1]) ++node;
+    weight = (t - KEY_RATE_TENORS[node]) / (KEY_RATE_TENORS[node + 1] - KEY_RATE_TENORS[node]);
+}
+
+struct CashflowSchedule {
+    vector<double> times; // years from settlement
+    vector<double> amounts; // per 100 face, the last one includes the principal
+    double accrued; // accrued interest per 100 face
+};
+
+CashflowSchedule BuildCashflowSchedule(const Bond& bond, const date& settlement)
+{
+    CashflowSchedule schedule;
+    schedule.accrued = 0;
+    const date& maturity = bond.GetMaturityDate();
+    if (maturity <= settlement) return schedule;
+
+    double coupon = bond.GetCoupon() * 100.0 / 2.0;
+    vector<date> dates;
+    int k = 0;
+    date d = maturity;
+    while (d > settlement) {
+        dates.push_back(d);
+        ++k;
+        d = maturity - months(6 * k);
+    }
+    date previous = d;
+
+    for (int i = (int)dates.size() - 1; i >= 0; --i) {
+        schedule.times.push_back((dates[i] - settlement).days() / 365.0);
+        schedule.amounts.push_back(i == 0 ? coupon + 100.0 : coupon);
+    }
+    date next = dates.back();
+    schedule.accrued = coupon * (settlement - previous).days() / (double)(next - previous).days();
+    return schedule;
+}
+
+// street convention: flow k is FirstPeriod + k coupon periods away, FirstPeriod the part of
+// the current period left (from the accrued, or the first flow time without a coupon)
+inline double FirstPeriod(const CashflowSchedule& schedule, const Bond& bond)
+{
+    if (schedule.times.empty()) return 0;
+    double coupon = bond.GetCoupon() * 100.0 / 2.0;
+    return coupon > 0 ? 1.0 - schedule.accrued / coupon : 2.0 * schedule.times[0];
+}
+
+#endif
@@ -0,0 +1,387 @@
+/**
+* BondCurveService.hpp
+* Definition of BondCurveService class
+*
+* Fits a Nelson-Siegel-Svensson zero curve across the bonds of the pricing
+* stream and publishes a FairValue (fitted price and residual) per bond.
+*
+*   z(t) = b0 + b1 f1(t) + b2 (f1(t) - e^(-t/tau1)) + b3 (f3(t) - e^(-t/tau2))
+*   f1(t) = (1 - e^(-t/tau1)) / (t/tau1),  f3(t) = (1 - e^(-t/tau2)) / (t/tau2)
+*
+* tau1 / tau2 are fixed, so the basis of every cashflow is computed once
+* when the bond is added. Each refit is a damped Gauss-Newton on b0..b3
+* warm-started from the last solution, weighted by 1 / duration^2 so the
+* price errors count like yield errors; a tick usually costs 1-3 iterations.
+*
+* 1 Listener: BondCurveServiceListener
+* listen from BondPricingService
+*
+* @Yunze Sun
+*/
+
+#ifndef BondCurveService_h
+#define BondCurveService_h
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <vector>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "products.hpp"
+#include "BondCashflows.hpp"
+using namespace std;
+
+/**
+* Fitted fair value of a product against the curve.
+* Type T is the product type.
+*/
+template<typename T>
+class FairValue {
+public:
+    // ctor
+    FairValue(const T& _product, double _marketPrice, double _fairPrice)
+        : product(_product), marketPrice(_marketPrice), fairPrice(_fairPrice) {}
+
+    const T& GetProduct() const { return product; }
+    double GetMarketPrice() const { return marketPrice; }
+    double GetFairPrice() const { return fairPrice; }
+
+    // market minus fair, positive when the bond is cheap to the curve
+    double GetResidual() const { return marketPrice - fairPrice; }
+
+private:
+    T product;
+    double marketPrice;
+    double fairPrice;
+};
+
+
+class NssCurveFitter {
+public:
+    static const int PARAMS = 4;
+
+    // ctor
+    NssCurveFitter(double _tau1 = 2.0, double _tau2 = 10.0, int _maxIterations = 20, double _tolerance = 1e-8);
+
+    // add a bond to the universe, returns its index
+    int AddBond(const CashflowSchedule& schedule, double coupon);
+
+    // clean market price of a bond
+    void SetMarketPrice(int i, double cleanPrice);
+
+    // refit from the current parameters, returns the iterations used (0 if too few prices)
+    int Fit();
+
+    int Size() const { return (int)accrued.size(); }
+    double GetFairPrice(int i) const { return model[i] - accrued[i]; }
+    double GetMarketPrice(int i) const { return market[i] - accrued[i]; }
+    double GetResidual(int i) const { return market[i] - model[i]; }
+    bool HasPrice(int i) const { return weight[i] > 0; }
+
+    // continuously compounded zero rate
+    double GetZeroRate(double t) const;
+    const double* GetParameters() const { return beta; }
+
+    // root mean square of the price residuals
+    double GetRmse() const;
+
+private:
+    double tau1, tau2;
+    int maxIterations;
+    double tolerance;
+    double beta[PARAMS];
+    double lambda; // damping
+    bool modelCurrent; // model / jacobian are at beta, a new price does not change them
+
+    // cashflows of all bonds back to back, bond i owns [start[i], start[i+1])
+    vector<int> start;
+    vector<double> cfTime, cfAmount, basis1, basis2, basis3;
+
+    // per bond, dirty prices
+    vector<double> accrued, market, duration, weight;
+    vector<double> model, jacobian; // at beta
+    vector<double> trialModel, trialJacobian;
+
+    void Basis(double t, double& f1, double& f2, double& f3) const;
+    double Evaluate(const double* params, vector<double>& prices, vector<double>& jac) const;
+    static bool Solve(double a[PARAMS][PARAMS], double b[PARAMS]);
+};
+
+
+NssCurveFitter::NssCurveFitter(double _tau1, double _tau2, int _maxIterations, double _tolerance)
+    : tau1(_tau1), tau2(_tau2), maxIterations(_maxIterations), tolerance(_tolerance), lambda(1e-3), modelCurrent(false)
+{
+    // flat 2% to start from, the first fit takes a few more iterations
+    beta[0] = 0.02;
+    beta[1] = beta[2] = beta[3] = 0.0;
+    start.push_back(0);
+}
+
+void NssCurveFitter::Basis(double t, double& f1, double& f2, double& f3) const {
+    if (t < 1e-8) {
+        f1 = 1.0; f2 = 0.0; f3 = 0.0;
+        return;
+    }
+    double e1 = exp(-t / tau1), e2 = exp(-t / tau2);
+    f1 = (1.0 - e1) / (t / tau1);
+    f2 = f1 - e1;
+    f3 = (1.0 - e2) / (t / tau2) - e2;
+}
+
+int NssCurveFitter::AddBond(const CashflowSchedule& schedule, double coupon) {
+    double dv = 0;
+    for (size_t k = 0; k < schedule.times.size(); ++k) {
+        double t = schedule.times[k], f1, f2, f3;
+        Basis(t, f1, f2, f3);
+        cfTime.push_back(t);
+        cfAmount.push_back(schedule.amounts[k]);
+        basis1.push_back(f1);
+        basis2.push_back(f2);
+        basis3.push_back(f3);
+        dv += t * schedule.amounts[k] * exp(-coupon * t);
+    }
+    start.push_back((int)cfTime.size());
+
+    accrued.push_back(schedule.accrued);
+    market.push_back(0);
+    duration.push_back(max(dv, 1e-6));
+    weight.push_back(0);
+    model.push_back(0);
+    trialModel.push_back(0);
+    jacobian.resize(jacobian.size() + PARAMS, 0);
+    trialJacobian.resize(trialJacobian.size() + PARAMS, 0);
+    modelCurrent = false;
+    return (int)accrued.size() - 1;
+}
+
+void NssCurveFitter::SetMarketPrice(int i, double cleanPrice) {
+    market[i] = cleanPrice + accrued[i];
+    weight[i] = 1.0 / (duration[i] * duration[i]);
+}
+
+double NssCurveFitter::Evaluate(const double* b, vector<double>& prices, vector<double>& jac) const {
+    double objective = 0;
+    int n = Size();
+    for (int i = 0; i < n; ++i) {
+        double p = 0, j0 = 0, j1 = 0, j2 = 0, j3 = 0;
+        for (int k = start[i]; k < start[i + 1]; ++k) {
+            double t = cfTime[k];
+            double z = b[0] + b[1] * basis1[k] + b[2] * basis2[k] + b[3] * basis3[k];
+            double v = cfAmount[k] * exp(-z * t);
+            double tv = -t * v;
+            p += v;
+            j0 += tv;
+            j1 += tv * basis1[k];
+            j2 += tv * basis2[k];
+            j3 += tv * basis3[k];
+        }
+        prices[i] = p;
+        jac[i * PARAMS] = j0;
+        jac[i * PARAMS + 1] = j1;
+        jac[i * PARAMS + 2] = j2;
+        jac[i * PARAMS + 3] = j3;
+        double r = p - market[i];
+        objective += weight[i] * r * r;
+    }
+    return objective;
+}
+
+// Cholesky of the 4x4 normal equations, the solution overwrites b
+bool NssCurveFitter::Solve(double a[PARAMS][PARAMS], double b[PARAMS]) {
+    double l[PARAMS][PARAMS] = {};
+    for (int j = 0; j < PARAMS; ++j) {
+        double d = a[j][j];
+        for (int k = 0; k < j; ++k) d -= l[j][k] * l[j][k];
+        if (d <= 0) return false;
+        l[j][j] = sqrt(d);
+        for (int i = j + 1; i < PARAMS; ++i) {
+            double s = a[i][j];
+            for (int k = 0; k < j; ++k) s -= l[i][k] * l[j][k];
+            l[i][j] = s / l[j][j];
+        }
+    }
+    for (int i = 0; i < PARAMS; ++i) {
+        for (int k = 0; k < i; ++k) b[i] -= l[i][k] * b[k];
+        b[i] /= l[i][i];
+    }
+    for (int i = PARAMS - 1; i >= 0; --i) {
+        for (int k = i + 1; k < PARAMS; ++k) b[i] -= l[k][i] * b[k];
+        b[i] /= l[i][i];
+    }
+    return true;
+}
+
+int NssCurveFitter::Fit() {
+    int priced = 0;
+    for (int i = 0; i < Size(); ++i) if (weight[i] > 0) ++priced;
+    if (priced < PARAMS) return 0;
+
+    double objective = 0;
+    if (modelCurrent) {
+        for (int i = 0; i < Size(); ++i) {
+            double r = model[i] - market[i];
+            objective += weight[i] * r * r;
+        }
+    }
+    else {
+        objective = Evaluate(beta, model, jacobian);
+        modelCurrent = true;
+    }
+    int iteration = 0;
+    while (iteration < maxIterations) {
+        ++iteration;
+        double a[PARAMS][PARAMS] = {};
+        double g[PARAMS] = {};
+        for (int i = 0; i < Size(); ++i) {
+            double w = weight[i];
+            if (w == 0) continue;
+            const double* j = &jacobian[i * PARAMS];
+            double r = model[i] - market[i];
+            for (int p = 0; p < PARAMS; ++p) {
+                g[p] -= w * j[p] * r;
+                for (int q = 0; q <= p; ++q) a[p][q] += w * j[p] * j[q];
+            }
+        }
+        for (int p = 0; p < PARAMS; ++p) {
+            for (int q = 0; q < p; ++q) a[q][p] = a[p][q];
+            a[p][p] *= 1.0 + lambda;
+        }
+        if (!Solve(a, g)) break;
+
+        double trial[PARAMS];
+        double step = 0;
+        for (int p = 0; p < PARAMS; ++p) {
+            trial[p] = beta[p] + g[p];
+            step = max(step, fabs(g[p]));
+        }
+        double trialObjective = Evaluate(trial, trialModel, trialJacobian);
+        if (trialObjective <= objective) {
+            for (int p = 0; p < PARAMS; ++p) beta[p] = trial[p];
+            model.swap(trialModel);
+            jacobian.swap(trialJacobian);
+            objective = trialObjective;
+            lambda = max(lambda * 0.1, 1e-9);
+            if (step < tolerance) break;
+        }
+        else {
+            lambda *= 10.0;
+            if (step < tolerance) break;
+        }
+    }
+    return iteration;
+}
+
+double NssCurveFitter::GetZeroRate(double t) const {
+    double f1, f2, f3;
+    Basis(t, f1, f2, f3);
+    return beta[0] + beta[1] * f1 + beta[2] * f2 + beta[3] * f3;
+}
+
+double NssCurveFitter::GetRmse() const {
+    double sum = 0;
+    int n = 0;
+    for (int i = 0; i < Size(); ++i) {
+        if (weight[i] == 0) continue;
+        double r = model[i] - market[i];
+        sum += r * r;
+        ++n;
+    }
+    return n ? sqrt(sum / n) : 0;
+}
+
+
+class BondCurveService : public Service<string, FairValue<Bond> > {
+public:
+    // ctor, the universe is fixed
+    BondCurveService(const vector<Bond>& _bonds, const date& settlement = from_string(DEFAULT_SETTLEMENT_DATE));
+
+    // Implement all the virtual functions
+
+    FairValue<Bond>& GetData(string key) override { return fairValueMap.at(key); }
+
+    // no need for implementation here
+    void OnMessage(FairValue<Bond>& data) override {}
+
+    // Add a listener to the Service for callbacks on add, remove, and update events
+    // for data to the Service.
+    void AddListener(ServiceListener<FairValue<Bond> >* listener) override { listeners.push_back(listener); }
+
+    // Get all listeners on the Service.
+    const vector<ServiceListener<FairValue<Bond> >*>& GetListeners() const override { return listeners; }
+
+    // new market price, refit and publish, called by BondCurveServiceListener
+    void OnPrice(const Price<Bond>& price);
+
+    const NssCurveFitter& GetFitter() const { return fitter; }
+    long GetFits() const { return fits; }
+    double GetAverageIterations() const { return fits ? (double)iterations / fits : 0; }
+    double GetAverageFitTime() const { return fits ? fitTime / fits : 0; } // us
+
+private:
+    map<ProductId, FairValue<Bond> > fairValueMap;
+    vector<ServiceListener<FairValue<Bond> >*> listeners;
+    vector<Bond> bonds;
+    map<ProductId, int> bondIndex;
+    NssCurveFitter fitter;
+    long fits;
+    long iterations;
+    double fitTime;
+};
+
+
+BondCurveService::BondCurveService(const vector<Bond>& _bonds, const date& settlement)
+    : bonds(_bonds), fits(0), iterations(0), fitTime(0)
+{
+    for (auto& bond : bonds) {
+        int i = fitter.AddBond(BuildCashflowSchedule(bond, settlement), bond.GetCoupon());
+        bondIndex.insert(pair<ProductId, int>(bond.GetProductId(), i));
+    }
+}
+
+void BondCurveService::OnPrice(const Price<Bond>& price) {
+    auto it = bondIndex.find(price.GetProduct().GetProductId());
+    if (it == bondIndex.end()) return;
+    fitter.SetMarketPrice(it->second, price.GetMid());
+
+    auto begin = chrono::steady_clock::now();
+    int n = fitter.Fit();
+    if (n == 0) return;
+    fitTime += chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count();
+    iterations += n;
+    ++fits;
+
+    // every fair value moves with the curve
+    for (int i = 0; i < (int)bonds.size(); ++i) {
+        if (!fitter.HasPrice(i)) continue;
+        FairValue<Bond> fairValue(bonds[i], fitter.GetMarketPrice(i), fitter.GetFairPrice(i));
+        const ProductId& id = bonds[i].GetProductId();
+        auto found = fairValueMap.find(id);
+        if (found == fairValueMap.end()) found = fairValueMap.insert(pair<ProductId, FairValue<Bond> >(id, fairValue)).first;
+        else found->second = fairValue;
+
+        for (auto& listener : listeners) {
+            listener->ProcessAdd(found->second);
+        }
+    }
+}
+
+
+class BondCurveServiceListener : public ServiceListener<Price<Bond> > {
+public:
+    // ctor
+    BondCurveServiceListener(BondCurveService* _bc_service) : bc_service(_bc_service) {};
+
+    void ProcessAdd(Price<Bond>& data) override { bc_service->OnPrice(data); }
+
+    // no implementation
+    void ProcessRemove(Price<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Price<Bond>& data) override {}
+
+private:
+    BondCurveService* bc_service;
+};
+
+#endif
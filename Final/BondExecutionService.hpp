@@ -3,12 +3,21 @@
 * Definition of BondExecutionService class
 *
 * 1 Connector: BondExecutionServiceConnector
-* Publish the execution order
+* Encode the execution order to the configured sinks (binary, see OrderEncoder.hpp)
+* and publish it to the venue simulator of its market
 * 
 * 
 * 1 Listener: BondExecutionServiceListener
 * listen from BondAlgoExecutionService
 *
+* Execution reports of the venues are drained by ProcessFills and
+* flow to the fill listeners (trade booking, risk gate, algo execution),
+* after every order and every poll interval ms off the TimerWheel, so
+* reports still come in while no order goes out
+* The lifecycle of every live order is tracked by order id in an OrderStateStore,
+* GetData returns a live order by order id; an order the store could not
+* take is still sent and counted as untracked
+*
 * @Yunze Sun
 */
 
@@ -16,6 +25,10 @@
 #define BondExecutionService_h
 
 #include "BondAlgoExecutionService.hpp"
+#include "VenueSimulator.hpp"
+#include "OrderStateStore.hpp"
+#include "OrderEncoder.hpp"
+#include "TimerWheel.hpp"
 #include "soa.hpp"
 using namespace std;
 
@@ -23,16 +36,29 @@ class BondExecutionServiceConnector;
 
 class BondExecutionService : public ExecutionService<Bond> {
 private:
-    map<string, ExecutionOrder<Bond> > exeMap;
+    map<OrderId, ExecutionOrder<Bond> > exeMap; // live orders by order id
+    OrderStateStore orderStore; // lifecycle of the live orders
+    long untracked; // orders the store refused (full, duplicate or over-long id)
     vector<ServiceListener<ExecutionOrder<Bond> >*> listeners;
     BondExecutionServiceConnector* conn; // connector to publish executions
+    vector<ServiceListener<ExecutionFill<Bond> >*> fillListeners;
+    long fillCount;
+    long roundTrips; // reports answering an order entry
+    long long totalRoundTrip; // ns, order submission to the report at the venue
+    long long maxRoundTrip;
 
 public:
-    // ctor
-    BondExecutionService(BondExecutionServiceConnector* _conn) : conn(_conn) { exeMap = map<string, ExecutionOrder<Bond> >(); };
+    // ctor, the reports are also polled every pollInterval ms off the timer, only after orders if null
+    BondExecutionService(BondExecutionServiceConnector* _conn, TimerWheel* _timer = nullptr, long _pollInterval = 1, size_t _maxLiveOrders = 1 << 16)
+        : orderStore(_maxLiveOrders * 4 / 3), untracked(0), conn(_conn), fillCount(0), roundTrips(0), totalRoundTrip(0), maxRoundTrip(0)
+    {
+        exeMap = map<OrderId, ExecutionOrder<Bond> >();
+        if (_timer) _timer->SchedulePeriodic(_pollInterval, [this]() { ProcessFills(); });
+    };
 
     // Implement all the virtual functions
 
+    // live order by order id
     ExecutionOrder<Bond>& GetData(string key) override { return exeMap.at(key); }
 
     // no need for implementation here
@@ -50,14 +76,48 @@ public:
 
     // add execution from algo and notify listeners
     void AddExecution(const AlgoExecution<Bond>& algo);
+
+    // state of a live order, null once it is done
+    const OrderRecord* GetOrderState(const string& orderId) const { return orderStore.Find(orderId); }
+
+    // orders sent without lifecycle tracking, the store refused them
+    long GetUntracked() const { return untracked; }
+
+    // Add a listener for the execution reports of the venues
+    void AddFillListener(ServiceListener<ExecutionFill<Bond> >* listener) { fillListeners.push_back(listener); }
+
+    // drain the execution reports of all venues and notify the fill listeners
+    void ProcessFills();
+
+    // round trip statistics of the execution reports, in microseconds, fills of resting orders are not counted
+    long GetFillCount() const { return fillCount; }
+    double GetAverageRoundTrip() const { return roundTrips ? totalRoundTrip / 1000.0 / roundTrips : 0; }
+    double GetMaxRoundTrip() const { return maxRoundTrip / 1000.0; }
 };
 
 
 
 class BondExecutionServiceConnector : public Connector<ExecutionOrder<Bond> > {
+private:
+    VenueSimulator* venues[3]; // indexed by Market
+    OrderEncoder encoder;
+    vector<OrderSink*> sinks;
+    EgressLatency latency;
+
 public:
     // ctor
-    BondExecutionServiceConnector() {}
+    BondExecutionServiceConnector() { venues[BROKERTEC] = venues[ESPEED] = venues[CME] = nullptr; }
+
+    // route the orders of a market to a venue, orders of markets without venue are printed
+    void SetVenue(VenueSimulator* venue) { venues[venue->GetMarket()] = venue; }
+    VenueSimulator* GetVenue(Market market) { return venues[market]; }
+
+    // every published order is encoded once and written to all sinks
+    void AddSink(OrderSink* sink) { sinks.push_back(sink); }
+    void Flush() { for (auto& sink : sinks) sink->Flush(); }
+
+    // encode + write time of the published orders
+    const EgressLatency& GetEgressLatency() const { return latency; }
 
     // publish the order
     void Publish(ExecutionOrder<Bond>& order, Market market);
@@ -97,16 +157,21 @@ private:
 // Implement BondExecutionService class
 void BondExecutionService::ExecuteOrder(ExecutionOrder<Bond>& exe_order, Market market) {
     conn->Publish(exe_order, market);
+    // pick up whatever the venues have reported so far
+    ProcessFills();
 }
 
 
 void BondExecutionService::AddExecution(const AlgoExecution<Bond>& algo_exe) {
     auto exe_order = algo_exe.GetOrder();
-    string order_id = exe_order.GetProduct().GetProductId();
+    const OrderId& order_id = exe_order.GetOrderId();
+
+    // start tracking the order lifecycle, its fills are not applied if the store is full or the id is taken
+    if (!orderStore.Add(exe_order, algo_exe.GetMarket())) ++untracked;
 
     // update executionMap
     if (exeMap.find(order_id) != exeMap.end()) { exeMap.erase(order_id); }
-    exeMap.insert(pair<string, ExecutionOrder<Bond> >(order_id, exe_order));
+    exeMap.insert(pair<OrderId, ExecutionOrder<Bond> >(order_id, exe_order));
 
     for (auto& listener : listeners) {
         listener->ProcessAdd(exe_order);
@@ -114,22 +179,59 @@ void BondExecutionService::AddExecution(const AlgoExecution<Bond>& algo_exe) {
 }
 
 
+void BondExecutionService::ProcessFills() {
+    for (Market market : { BROKERTEC, ESPEED, CME }) {
+        VenueSimulator* venue = conn->GetVenue(market);
+        if (!venue) continue;
+        // without a venue thread the matching happens here
+        if (!venue->IsRunning()) venue->Pump();
+
+        VenueFill report;
+        while (venue->PollFill(report)) {
+            ++fillCount;
+            if (!report.passive) {
+                // stamped by the venue, how long the report waited to be drained does not count
+                long long roundTrip = report.reportTime - report.submitTime;
+                ++roundTrips;
+                totalRoundTrip += roundTrip;
+                maxRoundTrip = max(maxRoundTrip, roundTrip);
+            }
+
+            // NEW -> PARTIALLY_FILLED -> FILLED, or CANCELLED for what is left when the venue is done
+            if (report.quantity > 0) orderStore.ApplyFill(report.orderId, report.quantity);
+            if (report.isDone) orderStore.Cancel(report.orderId);
+
+            ExecutionFill<Bond> fill(GetBond(report.productId), report.orderId, report.tradeId, report.side,
+                report.price, report.quantity, report.leavesQuantity, report.isDone, market);
+            for (auto& listener : fillListeners) {
+                listener->ProcessAdd(fill);
+            }
+
+            // final state reached, free the slot
+            if (report.isDone) {
+                orderStore.Erase(report.orderId);
+                exeMap.erase(report.orderId);
+            }
+        }
+    }
+}
+
+
 // Implement BondExecutionServiceConnecto class
 void BondExecutionServiceConnector::Publish(ExecutionOrder<Bond>& data, Market market) 
 {
-    auto bond = data.GetProduct();
-    string oder_type;
-    switch (data.GetOrderType()) {
-    case FOK: oder_type = "FOK"; break;
-    case MARKET: oder_type = "MARKET"; break;
-    case LIMIT: oder_type = "LIMIT"; break;
-    case STOP: oder_type = "STOP"; break;
-    case IOC: oder_type = "IOC"; break;
+    if (!sinks.empty()) {
+        auto start = chrono::steady_clock::now();
+        const BinaryOrderMessage& message = encoder.Encode(data, market);
+        for (auto& sink : sinks) {
+            sink->Write((const char*)&message, OrderEncoder::Length());
+        }
+        latency.Record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+    if (venues[market]) {
+        venues[market]->SubmitOrder(data);
     }
-    cout << bond.GetProductId() << " OrderId: " << data.GetOrderId() << "\n"
-        << " OrderType: " << oder_type
-        << "\nPrice: " << data.GetPrice() << "\tVisibleQuantity: " << data.GetVisibleQuantity()
-        << "\tHiddenQuantity: " << data.GetHiddenQuantity() << endl << endl;
 }
 
 #endif
\ No newline at end of file
@@ -16,12 +16,14 @@
 #define BondHistoricalDataService_h
 
 #include <iostream>
+#include <unordered_set>
 #include "BondPositionService.hpp"
 #include "BondRiskService.hpp"
 #include "BondExecutionService.hpp"
 #include "BondStreamingService.hpp"
 #include "BondInquiryService.hpp"
 #include "historicaldataservice.hpp"
+#include "TimerWheel.hpp"
 #include "soa.hpp"
 #include "products.hpp"
 
@@ -45,19 +47,33 @@ public:
     void PersistData(string persistKey, const Position<Bond>& data) override;
 
 private:
-    map<string, Position<Bond> > dataMap;
+    map<ProductId, Position<Bond> > dataMap;
     BondHistoricalPositionServiceConnector* connector;
     vector<ServiceListener<Position<Bond> >*> listeners;
 };
 
 class BondHistoricalRiskService : public HistoricalDataService<PV01<Bond> > {
 private:
-    map<string, PV01<Bond> > dataMap;
+    map<ProductId, PV01<Bond> > dataMap;
     BondHistoricalRiskServiceConnector* connector;
     vector<ServiceListener<PV01<Bond> >*> listeners;
+
+    // conflation, products changed since the last flush
+    TimerWheel* timer;
+    vector<PV01<Bond>*> pending;
+    unordered_set<const PV01<Bond>*> queued;
+    long persisted, written;
 public:
-    // ctor
-    BondHistoricalRiskService(BondHistoricalRiskServiceConnector* _connector) :connector(_connector) {}
+    // ctor, writes the latest risk of every changed product every interval ms off the timer, every update if null
+    BondHistoricalRiskService(BondHistoricalRiskServiceConnector* _connector, TimerWheel* _timer = nullptr, long _interval = 100)
+        :connector(_connector), timer(_timer), persisted(0), written(0) {
+        if (timer) timer->SchedulePeriodic(_interval, [this]() { Flush(); });
+    }
+
+    // write every pending product now
+    void Flush();
+    long GetPersisted() const { return persisted; }
+    long GetWritten() const { return written; }
 
     //override all functions
     PV01<Bond>& GetData(string id) override { return dataMap.at(id); }
@@ -81,7 +97,7 @@ public:
     void PersistData(string persistKey, const ExecutionOrder<Bond>& data) override;
 
 private:
-    map<string, ExecutionOrder<Bond> > dataMap;
+    map<OrderId, ExecutionOrder<Bond> > dataMap;
     BondHistoricalExecutionServiceConnector* connector;
     vector<ServiceListener<ExecutionOrder<Bond> >*> listeners;
 };
@@ -100,7 +116,7 @@ public:
     void PersistData(string persistKey, const PriceStream<Bond>& data) override;
 
 private:
-    map<string, PriceStream<Bond> > dataMap;
+    map<ProductId, PriceStream<Bond> > dataMap;
     BondHistoricalStreamingServiceConnector* connector;
     vector<ServiceListener<PriceStream<Bond> >*> listeners;
 };
@@ -119,7 +135,7 @@ public:
     void PersistData(string persistKey, const Inquiry<Bond>& data) override;
 
 private:
-    map<string, Inquiry<Bond> > dataMap;
+    map<InquiryId, Inquiry<Bond> > dataMap;
     BondHistoricalInquiryServiceConnector* connector;
     vector<ServiceListener<Inquiry<Bond> >*> listeners;
 };
@@ -147,7 +163,7 @@ void BondHistoricalPositionService::PersistData(string persistKey, const Positio
     auto id = data.GetProduct().GetProductId();
     if (dataMap.find(id) != dataMap.end())
         dataMap.erase(id);
-    dataMap.insert(pair<string, Position<Bond> >(id, data));
+    dataMap.insert(pair<ProductId, Position<Bond> >(id, data));
     auto data_temp = data;
     connector->Publish(data_temp);
     return;
@@ -156,9 +172,12 @@ void BondHistoricalPositionService::PersistData(string persistKey, const Positio
 
 
 class BondHistoricalRiskServiceConnector : public Connector<PV01<Bond> > {
+private:
+    ofstream out; // opened once, not on every record
+
 public:
     // ctor
-    BondHistoricalRiskServiceConnector() {};
+    BondHistoricalRiskServiceConnector(const string& file = "risk.txt") { out.open(file, ios::app); };
 
     //override all functions
     void Subscribe() {}
@@ -166,20 +185,39 @@ public:
         auto id = data.GetProduct().GetProductId();
         auto data_needed = data.GetPV01();
 
-        ofstream out;
-        out.open("risk.txt", ios::app);
-        out << id << "," << data_needed << endl;
+        out << id << "," << data_needed << "\n";
     }
+
+    void Flush() { out.flush(); }
 };
 
 void BondHistoricalRiskService::PersistData(string persistKey, const PV01<Bond>& data) {
-    auto bond = data.GetProduct();
-    auto id = bond.GetProductId();
-    if (dataMap.find(id) != dataMap.end())
-        dataMap.erase(id);
-    dataMap.insert(pair<string, PV01<Bond> >(id, data));
-    auto data_temp = data;
-    connector->Publish(data_temp);
+    const ProductId& id = data.GetProduct().GetProductId();
+    auto it = dataMap.find(id);
+    if (it != dataMap.end())
+        it->second.Update(data.GetPV01(), data.GetQuantity());
+    else
+        it = dataMap.insert(pair<ProductId, PV01<Bond> >(id, data)).first;
+    ++persisted;
+
+    if (!timer) {
+        connector->Publish(it->second);
+        connector->Flush();
+        ++written;
+        return;
+    }
+    // only the latest value goes out on the next flush
+    if (queued.insert(&it->second).second) pending.push_back(&it->second);
+}
+
+void BondHistoricalRiskService::Flush() {
+    for (auto risk : pending) {
+        connector->Publish(*risk);
+        ++written;
+    }
+    pending.clear();
+    queued.clear();
+    connector->Flush();
 }
 
 
@@ -214,10 +252,10 @@ public:
 };
 
 void BondHistoricalExecutionService::PersistData(string persistKey, const ExecutionOrder<Bond>& data) {
-    auto id = data.GetOrderId();
+    const OrderId& id = data.GetOrderId();
     if (dataMap.find(id) != dataMap.end())
         dataMap.erase(id);
-    dataMap.insert(pair<string, ExecutionOrder<Bond> >(id, data));
+    dataMap.insert(pair<OrderId, ExecutionOrder<Bond> >(id, data));
     auto data_temp = data;
     connector->Publish(data_temp);
 }
@@ -253,7 +291,7 @@ void BondHistoricalStreamingService::PersistData(string persistKey, const PriceS
     auto id = data.GetProduct().GetProductId();
     if (dataMap.find(id) != dataMap.end())
         dataMap.erase(id);
-    dataMap.insert(pair<string, PriceStream<Bond> >(id, data));
+    dataMap.insert(pair<ProductId, PriceStream<Bond> >(id, data));
     auto data_temp = data;
     connector->Publish(data_temp);
 }
@@ -262,9 +300,12 @@ void BondHistoricalStreamingService::PersistData(string persistKey, const PriceS
 
 
 class BondHistoricalInquiryServiceConnector : public Connector<Inquiry<Bond> > {
+private:
+    ofstream out; // opened once, not on every record
+
 public:
-    // ctor
-    BondHistoricalInquiryServiceConnector() {};
+    // ctor, not inquiries.txt: that is the input BondInquiryServiceConnector is still reading
+    BondHistoricalInquiryServiceConnector(const string& file = "allinquiries.txt") { out.open(file, ios::app); };
 
     //override all functions
     void Subscribe() {}
@@ -283,18 +324,18 @@ public:
         case CUSTOMER_REJECTED:state_ = "CUSTOMER_REJECTED"; break;
         }
 
-        ofstream out;
-        out.open("inquiries.txt", ios::app);
         out << inquiry_id << "," << id << "," << price << "," << quantity << "," << side << "," << state_
-            << endl;
+            << "\n";
     }
+
+    void Flush() { out.flush(); }
 };
 
 void BondHistoricalInquiryService::PersistData(string persistKey, const Inquiry<Bond>& data) {
     auto id = data.GetInquiryId();
     if (dataMap.find(id) != dataMap.end())
         dataMap.erase(id);
-    dataMap.insert(pair<string, Inquiry<Bond> >(id, data));
+    dataMap.insert(pair<InquiryId, Inquiry<Bond> >(id, data));
     auto data_temp = data;
     connector->Publish(data_temp);
 }
@@ -6,6 +6,13 @@
 * BondInquiryServiceConnector: subscribe from inquiries.txt
 * BondInquiryServiceConnector2: publish the quote
 *
+* With an InquiryQuotingEngine, a RECEIVED inquiry is queued on the quoter
+* and QuotePending answers the queue: SendQuote on the price it computed,
+* RejectInquiry when it could not price in time. The queue is answered on
+* arrival once it is due, otherwise by a one-shot timer at half the budget
+* of the oldest RFQ, so a lone RFQ is quoted by its deadline. A sent quote
+* is finished DONE, the client's answer is not modeled.
+*
 *
 * @Yunze Sun
 */
@@ -17,17 +24,23 @@
 #include "inquiryservice.hpp"
 #include "utility.h"
 #include "productservice.hpp"
+#include "InquiryQuotingEngine.hpp"
+#include "TimerWheel.hpp"
 #include <fstream>
 class BondInquiryServiceConnector2;
 
 class BondInquiryService : public InquiryService<Bond> {
 private:
-    map<string, Inquiry<Bond> > inquiryMap;
+    map<InquiryId, Inquiry<Bond> > inquiryMap;
     vector<ServiceListener<Inquiry<Bond> >* > listeners;
     BondInquiryServiceConnector2* conn;
+    InquiryQuotingEngine* quoter;
+    TimerWheel* timer; // drains the quoter by the deadline, may be null
+    TimerWheel::TimerId drainTimer; // 0 if no drain is scheduled
 public:
-    // ctor
-    BondInquiryService(BondInquiryServiceConnector2* _conn) : conn(_conn){ inquiryMap = map<string, Inquiry<Bond> >(); }
+    // ctor, RECEIVED inquiries are priced by the quoter if there is one
+    BondInquiryService(BondInquiryServiceConnector2* _conn, InquiryQuotingEngine* _quoter = nullptr, TimerWheel* _timer = nullptr)
+        : conn(_conn), quoter(_quoter), timer(_timer), drainTimer(0) { inquiryMap = map<InquiryId, Inquiry<Bond> >(); }
 
     // Implement all the virtual functions
 
@@ -45,10 +58,13 @@ public:
     const vector<ServiceListener<Inquiry<Bond> >*>& GetListeners() const override { return listeners; }
 
     // Send a quote back to the client
-    void SendQuote(const string& inquiryId, double price);
+    void SendQuote(const InquiryId& inquiryId, double price);
 
     // Reject an inquiry from the client
-    void RejectInquiry(const string& inquiryId);
+    void RejectInquiry(const InquiryId& inquiryId);
+
+    // answer the inquiries queued on the quoter, returns the number answered
+    int QuotePending();
 
     // Set Connector
     void SetConn(BondInquiryServiceConnector2* _conn) { conn = _conn; }
@@ -93,38 +109,39 @@ public:
 // Implement BondInquiryService class
 void BondInquiryService::OnMessage(Inquiry<Bond>& data) {
     InquiryState state = data.GetState();
-    string inquiryId = data.GetInquiryId();
+    const InquiryId& inquiryId = data.GetInquiryId();
     switch (state) {
     case RECEIVED:
+        if (quoter) {
+            // kept as RECEIVED until the quoter answers it
+            inquiryMap.erase(inquiryId);
+            inquiryMap.insert(pair<InquiryId, Inquiry<Bond> >(inquiryId, data));
+            if (!quoter->Receive(data)) RejectInquiry(inquiryId);
+            // a burst is answered in batches before its first RFQ runs out of budget
+            else if (quoter->IsDue()) QuotePending();
+            // otherwise the oldest is answered by the timer at half its budget
+            else if (timer && !drainTimer) {
+                long delay = max(1LL, quoter->GetBudget() / 2000000);
+                drainTimer = timer->Schedule(delay, [this]() { drainTimer = 0; QuotePending(); });
+            }
+            return;
+        }
         // if inquiry is received, send back a quote to the connector via publish()
         conn->Publish(data);
         break;
     case QUOTED:
         // finish the inquiry with DONE status and send an update of the object
         data.SetState(DONE);
-        // store the inquiry
-        if (inquiryMap.find(inquiryId) != inquiryMap.end()) { inquiryMap.erase(inquiryId); }
-        inquiryMap.insert(pair<string, Inquiry<Bond> >(inquiryId, data));
-        // notify listeners
-        for (auto& listener : listeners)
-        {
-            listener->ProcessAdd(data);
-        }
         break;
     default:
         break;
     }
 
-
-    // if done, remove the inquiry from the map
-    if ((data.GetState() == DONE) or (inquiryMap.find(inquiryId) != inquiryMap.end()))
-    {
-        inquiryMap.erase(inquiryId);
-    }
-    // otherwise, update the inquiry
-    else
+    // if done, remove the inquiry from the map, otherwise update it
+    inquiryMap.erase(inquiryId);
+    if (data.GetState() != DONE)
     {
-        inquiryMap.insert(pair<string, Inquiry<Bond>>(inquiryId, data));
+        inquiryMap.insert(pair<InquiryId, Inquiry<Bond> >(inquiryId, data));
     }
 
     // notify listeners
@@ -134,24 +151,52 @@ void BondInquiryService::OnMessage(Inquiry<Bond>& data) {
     }
 }
 
-void BondInquiryService::SendQuote(const string& inquiryId, double price) {
-    // get the inquiry
-    Inquiry<Bond>& inquiry = GetData(inquiryId);
-    // update the inquiry
+void BondInquiryService::SendQuote(const InquiryId& inquiryId, double price) {
+    auto it = inquiryMap.find(inquiryId);
+    if (it == inquiryMap.end()) return;
+    Inquiry<Bond> inquiry = it->second;
+    inquiryMap.erase(it);
+    // price the inquiry, the connector publishes the quote and moves it to QUOTED
     inquiry.SetState(inquiry.GetState(), price);
+    conn->Publish(inquiry);
     // notify listeners
     for (auto& listener : listeners)
     {
         listener->ProcessAdd(inquiry);
     }
+    // finish the inquiry with DONE status and send an update of the object
+    inquiry.SetState(DONE);
+    for (auto& listener : listeners)
+    {
+        listener->ProcessAdd(inquiry);
+    }
 }
 
 
-void BondInquiryService::RejectInquiry(const string& inquiryId) {
-    // get the inquiry
-    Inquiry<Bond>& inquiry = GetData(inquiryId);
+void BondInquiryService::RejectInquiry(const InquiryId& inquiryId) {
+    auto it = inquiryMap.find(inquiryId);
+    if (it == inquiryMap.end()) return;
+    Inquiry<Bond> inquiry = it->second;
+    inquiryMap.erase(it);
     // update the inquiry
     inquiry.SetState(REJECTED);
+    // notify listeners
+    for (auto& listener : listeners)
+    {
+        listener->ProcessAdd(inquiry);
+    }
+}
+
+int BondInquiryService::QuotePending() {
+    if (!quoter) return 0;
+    if (drainTimer) {
+        timer->Cancel(drainTimer);
+        drainTimer = 0;
+    }
+    return quoter->Drain([this](const InquiryId& inquiryId, bool quoted, double price) {
+        if (quoted) SendQuote(inquiryId, price);
+        else RejectInquiry(inquiryId);
+    });
 }
 
 
@@ -3,7 +3,8 @@
 * Definition of BondMarketDataService class
 *
 * 1 Connector
-* read prediction from marketdata.txt
+* read prediction from marketdata.txt, all at once (Subscribe) or up to a
+* timestamp (Replay) to merge it with another timestamped stream
 *
 * @Yunze Sun
 */
@@ -12,6 +13,7 @@
 #define BondMarketDataService_h
 
 #include <fstream>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <unordered_map>
@@ -20,16 +22,17 @@
 #include "ProductService.hpp"
 #include "products.hpp"
 #include "utility.h"
+#include "TimerWheel.hpp"
 
 class BondMarketDataService : public MarketDataService<Bond> {
 public:
     // ctor
-    BondMarketDataService() { orderMap = map<string, OrderBook<Bond> >(); };
+    BondMarketDataService() { orderMap = map<ProductId, OrderBook<Bond> >(); };
 
     // Implement all the virtual functions
     
     // Get the best bid/offer order
-    const BidOffer& GetBestBidOffer(const string& productId) override;
+    BidOffer GetBestBidOffer(const string& productId) override;
     // Aggregate the order book
     const OrderBook<Bond>& AggregateDepth(const string& productId) override;
 
@@ -38,7 +41,7 @@ public:
     OrderBook<Bond>& GetData(string key) override
     {
         if (orderMap.find(key) == orderMap.end()) {
-            orderMap.insert(pair<string, OrderBook<Bond>>(key, OrderBook<Bond>(GetBond(key))));
+            orderMap.insert(pair<ProductId, OrderBook<Bond>>(key, OrderBook<Bond>(GetBond(key))));
         }
         return orderMap.at(key);
 
@@ -57,7 +60,7 @@ public:
 
 
 private:
-    map<string, OrderBook<Bond> > orderMap;
+    map<ProductId, OrderBook<Bond> > orderMap;
     vector<ServiceListener<OrderBook<Bond> >*> listeners;
 };
 
@@ -66,30 +69,36 @@ private:
 
 class BondMarketDataServiceConnector : public Connector<OrderBook<Bond> > {
 public:
-    BondMarketDataServiceConnector(BondMarketDataService* _bmd_service, ProductService<Bond>* _product_service)
-        : bmd_service(_bmd_service), product_service(_product_service) {};
+    BondMarketDataServiceConnector(BondMarketDataService* _bmd_service, ProductService<Bond>* _product_service, TimerWheel* _timer = nullptr)
+        : bmd_service(_bmd_service), product_service(_product_service), timer(_timer) {};
 
     // no publish
     void Publish(OrderBook<Bond>& info) override {};
     // subscribe data from marketdata.txt
-    void Subscribe();
+    void Subscribe() { Replay(LLONG_MAX); }
+
+    // flow the books stamped up to until (ms), returns the timestamp of the next one, -1 at the end of the file
+    long long Replay(long long until);
 
 private:
     BondMarketDataService* bmd_service;
     ProductService<Bond>* product_service;
+    TimerWheel* timer; // turned by the book timestamps, may be null
+    ifstream file;
+    string nextLine; // read ahead, not flowed yet
 };
 
 
 
 // Implement the BondMarketDataService class
 
-const BidOffer& BondMarketDataService::GetBestBidOffer(const string& _productId) {
-    return std::move(orderMap.at(_productId).GetBestBidOffer());
+BidOffer BondMarketDataService::GetBestBidOffer(const string& _productId) {
+    return orderMap.at(_productId).GetBestBidOffer();
 }
 
 
 const OrderBook<Bond>& BondMarketDataService::AggregateDepth(const string& _productId) {
-    auto orderbook = orderMap.at(_productId);   // get the orderbook of a specified product
+    auto& orderbook = orderMap.at(_productId);   // get the orderbook of a specified product
     vector<Order> offers = orderbook.GetOfferStack();
     vector<Order> bids = orderbook.GetBidStack();
 
@@ -152,20 +161,22 @@ const OrderBook<Bond>& BondMarketDataService::AggregateDepth(const string& _prod
         agg_ask.push_back(Order(elem.first, elem.second, OFFER));
     }
 
-    return OrderBook<Bond>(orderbook.GetProduct(), agg_bid, agg_ask);
+    // keep the aggregated book in the map, the caller gets a reference to it
+    orderbook = OrderBook<Bond>(orderbook.GetProduct(), agg_bid, agg_ask);
+    return orderbook;
 }
 
 
 
 void BondMarketDataService::OnMessage(OrderBook<Bond>& data) {
     // flow data
-    string id = data.GetProduct().GetProductId();
+    ProductId id = data.GetProduct().GetProductId();
     // update the order book
     if (orderMap.find(id) != orderMap.end()) { orderMap.erase(id); }
-    orderMap.insert(pair<string, OrderBook<Bond> >(id, data));
+    orderMap.insert(pair<ProductId, OrderBook<Bond> >(id, data));
 
     // get best order for listeners : algoexecution
-    auto best_order = GetBestBidOffer(id);
+    auto best_order = data.GetBestBidOffer();
     vector<Order> bid, ask;
     bid.push_back(best_order.GetBidOrder());
     ask.push_back(best_order.GetOfferOrder());
@@ -178,42 +189,49 @@ void BondMarketDataService::OnMessage(OrderBook<Bond>& data) {
 
 // Implement the BondMarketDataServiceConnector class
 
-void BondMarketDataServiceConnector::Subscribe() {
-    // read data from marketdata.txt
-    ifstream file("marketdata.txt", ios::in);
-    if (file.is_open()) {
-        string _line, _data;
-        getline(file, _line);
-        while (getline(file, _line)) {
-            stringstream line(_line);
-            vector<string> dataVec;
-            while (getline(line, _data, ','))
-            {
-                dataVec.push_back(_data);
-            }
-
-            // string timestamp = dataVec[0];
-            string id = dataVec[1];
-
-            auto ob = bmd_service->GetData(id);
-            vector<Order> bids = ob.GetBidStack();
-            vector<Order> asks = ob.GetOfferStack();
-
-            for (int k = 0; k < 5; k++) {
-                // bidPrice = dataVec[4 * k + 2];
-                // bidSize = dataVec[4 * k + 3];
-                // askPrice = dataVec[4 * k + 4];
-                // askSize = dataVec[4 * k + 5];
-                
-                bids.push_back(Order(Str2Price(dataVec[4 * k + 2]), stol(dataVec[4 * k + 3]), BID));
-                asks.push_back(Order(Str2Price(dataVec[4 * k + 4]), stol(dataVec[4 * k + 5]), OFFER));
-            }
-            // aggregate the order book, get a copy
-            auto aggOrderBook = bmd_service->AggregateDepth(id);
-            // publish the order book to the service
-            bmd_service->OnMessage(aggOrderBook);
+long long BondMarketDataServiceConnector::Replay(long long until) {
+    // read data from marketdata.txt, skip the header on the first call
+    if (!file.is_open()) {
+        file.open("marketdata.txt", ios::in);
+        if (!getline(file, nextLine) || !getline(file, nextLine)) nextLine.clear();
+    }
+    string _data;
+    while (!nextLine.empty()) {
+        stringstream line(nextLine);
+        vector<string> dataVec;
+        while (getline(line, _data, ','))
+        {
+            dataVec.push_back(_data);
+        }
+        long long time = stoll(dataVec[0]);
+        if (time > until) return time;
+
+        // fire timers due before this book
+        if (timer) timer->OnEvent(time);
+        string id = dataVec[1];
+
+        auto& ob = bmd_service->GetData(id);
+        vector<Order> bids, asks;
+
+        for (int k = 0; k < 5; k++) {
+            // bidPrice = dataVec[4 * k + 2];
+            // bidSize = dataVec[4 * k + 3];
+            // askPrice = dataVec[4 * k + 4];
+            // askSize = dataVec[4 * k + 5];
+            
+            bids.push_back(Order(Str2Price(dataVec[4 * k + 2]), stol(dataVec[4 * k + 3]), BID));
+            asks.push_back(Order(Str2Price(dataVec[4 * k + 4]), stol(dataVec[4 * k + 5]), OFFER));
         }
+        // the line is a full snapshot of the book
+        ob = OrderBook<Bond>(ob.GetProduct(), bids, asks);
+        // aggregate the order book, get a copy
+        auto aggOrderBook = bmd_service->AggregateDepth(id);
+        // publish the order book to the service
+        bmd_service->OnMessage(aggOrderBook);
+
+        if (!getline(file, nextLine)) nextLine.clear();
     }
+    return -1;
 }
 
 
@@ -0,0 +1,332 @@
+/**
+* BondPnLService.hpp
+* Definition of PnL and BondPnLService class
+*
+* Intraday P&L of every book on every product, from the booked trades and
+* the live mids. Each book/product cell keeps position, cost (position x
+* average cost) and realized P&L; each product keeps the sums over its
+* books and its last mid, so both a trade and a tick are O(1):
+*
+*   realized   += closed quantity x (trade price - average cost) / 100
+*   unrealized  = (position x mid - cost) / 100
+*
+* Snapshots are conflated: updates only mark cells dirty, and the dirty
+* ones are published every interval ms off the TimerWheel (on every update
+* without a timer). A tick dirties the product, its books are re-marked
+* when the snapshot goes out.
+*
+* 2 Listeners:
+* BondPnLTradeListener - BondPnLService listen from BondTradeBookingService
+* BondPnLPriceListener - BondPnLService listen from BondPricingService
+*
+* @Yunze Sun
+*/
+
+#ifndef BondPnLService_h
+#define BondPnLService_h
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "tradebookingservice.hpp"
+#include "TimerWheel.hpp"
+using namespace std;
+
+// P&L of a product in a book, book "ALL" for the product over every book
+template<typename T>
+class PnL {
+public:
+    // ctor
+    PnL(const T& _product, const string& _book, long _position, double _averageCost, double _realized, double _unrealized, double _mark)
+        : product(_product), book(_book), position(_position), averageCost(_averageCost), realized(_realized), unrealized(_unrealized), mark(_mark) {}
+
+    const T& GetProduct() const { return product; }
+    const string& GetBook() const { return book; }
+    long GetPosition() const { return position; }
+    double GetAverageCost() const { return averageCost; }
+    double GetRealized() const { return realized; }
+    double GetUnrealized() const { return unrealized; }
+    double GetTotal() const { return realized + unrealized; }
+    double GetMark() const { return mark; }
+
+private:
+    T product;
+    string book;
+    long position;
+    double averageCost;
+    double realized;
+    double unrealized;
+    double mark;
+};
+
+
+class BondPnLService : public Service<string, PnL<Bond> > {
+public:
+    // ctor, snapshots every interval ms off the timer, on every update if null
+    BondPnLService(const vector<Bond>& _bonds, TimerWheel* _timer = nullptr, long _interval = 100);
+
+    // Get the last snapshot, keyed "<book>:<product id>" or "<product id>" for the product total
+    PnL<Bond>& GetData(string key) override { return snapshots.at(key); }
+
+    // No need to implement because there's no linked connector
+    void OnMessage(PnL<Bond>& data) override {}
+
+    void AddListener(ServiceListener<PnL<Bond> >* listener) override { listeners.push_back(listener); }
+
+    const vector<ServiceListener<PnL<Bond> >*>& GetListeners() const override { return listeners; }
+
+    // called by the listeners
+    void AddTrade(const Trade<Bond>& trade);
+    void UpdateMark(const ProductId& productId, double mid);
+
+    // publish every dirty cell now
+    void Flush();
+
+    // live values, not the conflated snapshots
+    double GetRealized(const ProductId& productId) const;
+    double GetUnrealized(const ProductId& productId) const;
+    double GetBookRealized(const string& book) const;
+    double GetBookUnrealized(const string& book) const;
+    double GetTotal() const;
+
+    long GetTrades() const { return trades; }
+    long GetTicks() const { return ticks; }
+    long GetPublished() const { return published; }
+
+private:
+    struct Cell {
+        long position;
+        double cost; // position x average cost
+        double realized;
+        bool dirty;
+        PnL<Bond>* snapshot; // in snapshots once published
+    };
+
+    struct ProductPnL {
+        long position;
+        double cost;
+        double realized;
+        double mark;
+        bool marked; // a mid has been seen
+        bool dirty;
+        PnL<Bond>* snapshot;
+    };
+
+    vector<Bond> bonds;
+    unordered_map<ProductId, int> productIndex;
+    vector<vector<Cell> > cells; // [product][book index]
+    vector<ProductPnL> products;
+    vector<double> bookRealized; // [book index]
+    vector<int> dirtyProducts;
+    vector<pair<int, int> > dirtyCells;
+
+    map<string, PnL<Bond> > snapshots;
+    vector<ServiceListener<PnL<Bond> >*> listeners;
+    TimerWheel* timer;
+    long trades, ticks, published;
+
+    double Unrealized(long position, double cost, const ProductPnL& product) const;
+    void MarkProductDirty(int p);
+    void Publish(PnL<Bond>*& snapshot, const PnL<Bond>& pnl);
+};
+
+
+BondPnLService::BondPnLService(const vector<Bond>& _bonds, TimerWheel* _timer, long _interval)
+    : bonds(_bonds), cells(_bonds.size()), products(_bonds.size(), ProductPnL{ 0, 0, 0, 0, false, false, nullptr }),
+    timer(_timer), trades(0), ticks(0), published(0)
+{
+    for (int i = 0; i < (int)bonds.size(); ++i) {
+        productIndex.insert(pair<ProductId, int>(bonds[i].GetProductId(), i));
+    }
+    // publish at most once per interval, whatever the trade and tick rate
+    if (timer) timer->SchedulePeriodic(_interval, [this]() { Flush(); });
+}
+
+double BondPnLService::Unrealized(long position, double cost, const ProductPnL& product) const {
+    return product.marked ? (position * product.mark - cost) / 100.0 : 0.0;
+}
+
+void BondPnLService::MarkProductDirty(int p) {
+    if (!products[p].dirty) {
+        products[p].dirty = true;
+        dirtyProducts.push_back(p);
+    }
+}
+
+void BondPnLService::AddTrade(const Trade<Bond>& trade) {
+    auto it = productIndex.find(trade.GetProduct().GetProductId());
+    if (it == productIndex.end()) return;
+    int p = it->second;
+    int b = BookRegistry::GetIndex(trade.GetBook());
+    if (b >= (int)cells[p].size()) cells[p].resize(b + 1, Cell{ 0, 0, 0, false, nullptr });
+    if (b >= (int)bookRealized.size()) bookRealized.resize(b + 1, 0.0);
+
+    Cell& cell = cells[p][b];
+    ProductPnL& product = products[p];
+    long delta = trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity();
+    double price = trade.GetPrice();
+    long oldPosition = cell.position;
+    double oldCost = cell.cost;
+    double realized = 0;
+
+    if (oldPosition == 0 || (oldPosition > 0) == (delta > 0)) {
+        // opening or adding, the average cost moves
+        cell.position += delta;
+        cell.cost += delta * price;
+    }
+    else {
+        // reducing at the average cost, flipping opens the rest at the trade price
+        double average = oldCost / oldPosition;
+        long closed = labs(delta) < labs(oldPosition) ? -delta : oldPosition;
+        realized = closed * (price - average) / 100.0;
+        cell.position += delta;
+        cell.cost = (labs(delta) <= labs(oldPosition)) ? cell.position * average : cell.position * price;
+    }
+    cell.realized += realized;
+    product.position += cell.position - oldPosition;
+    product.cost += cell.cost - oldCost;
+    product.realized += realized;
+    bookRealized[b] += realized;
+    ++trades;
+
+    if (!cell.dirty) {
+        cell.dirty = true;
+        dirtyCells.push_back(pair<int, int>(p, b));
+    }
+    MarkProductDirty(p);
+    if (!timer) Flush();
+}
+
+void BondPnLService::UpdateMark(const ProductId& productId, double mid) {
+    auto it = productIndex.find(productId);
+    if (it == productIndex.end()) return;
+    ProductPnL& product = products[it->second];
+    ++ticks;
+    if (product.marked && product.mark == mid) return;
+    product.mark = mid;
+    product.marked = true;
+    MarkProductDirty(it->second);
+    if (!timer) Flush();
+}
+
+void BondPnLService::Publish(PnL<Bond>*& snapshot, const PnL<Bond>& pnl) {
+    // the map node is kept by the cell, the key is only built on the first snapshot
+    if (snapshot) *snapshot = pnl;
+    else {
+        const ProductId& id = pnl.GetProduct().GetProductId();
+        string key = pnl.GetBook() == "ALL" ? id.str() : pnl.GetBook() + ":" + id;
+        snapshot = &snapshots.insert(pair<string, PnL<Bond> >(key, pnl)).first->second;
+    }
+    ++published;
+    for (auto& listener : listeners) {
+        listener->ProcessAdd(*snapshot);
+    }
+}
+
+void BondPnLService::Flush() {
+    // a re-marked product re-marks every book holding it
+    for (int p : dirtyProducts) {
+        for (int b = 0; b < (int)cells[p].size(); ++b) {
+            Cell& cell = cells[p][b];
+            if (!cell.dirty && cell.position != 0) {
+                cell.dirty = true;
+                dirtyCells.push_back(pair<int, int>(p, b));
+            }
+        }
+    }
+    for (auto& pb : dirtyCells) {
+        Cell& cell = cells[pb.first][pb.second];
+        const ProductPnL& product = products[pb.first];
+        const Bond& bond = bonds[pb.first];
+        double average = cell.position != 0 ? cell.cost / cell.position : 0.0;
+        const string& book = BookRegistry::GetBook(pb.second);
+        Publish(cell.snapshot, PnL<Bond>(bond, book, cell.position, average, cell.realized,
+            Unrealized(cell.position, cell.cost, product), product.mark));
+        cell.dirty = false;
+    }
+    for (int p : dirtyProducts) {
+        ProductPnL& product = products[p];
+        double average = product.position != 0 ? product.cost / product.position : 0.0;
+        Publish(product.snapshot, PnL<Bond>(bonds[p], "ALL", product.position, average, product.realized,
+            Unrealized(product.position, product.cost, product), product.mark));
+        product.dirty = false;
+    }
+    dirtyCells.clear();
+    dirtyProducts.clear();
+}
+
+double BondPnLService::GetRealized(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? 0.0 : products[it->second].realized;
+}
+
+double BondPnLService::GetUnrealized(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    if (it == productIndex.end()) return 0.0;
+    const ProductPnL& product = products[it->second];
+    return Unrealized(product.position, product.cost, product);
+}
+
+double BondPnLService::GetBookRealized(const string& book) const {
+    int b = BookRegistry::Find(book);
+    return (b >= 0 && b < (int)bookRealized.size()) ? bookRealized[b] : 0.0;
+}
+
+double BondPnLService::GetBookUnrealized(const string& book) const {
+    int b = BookRegistry::Find(book);
+    double total = 0;
+    for (size_t p = 0; b >= 0 && p < products.size(); ++p) {
+        if (b < (int)cells[p].size()) total += Unrealized(cells[p][b].position, cells[p][b].cost, products[p]);
+    }
+    return total;
+}
+
+double BondPnLService::GetTotal() const {
+    double total = 0;
+    for (auto& product : products) total += product.realized + Unrealized(product.position, product.cost, product);
+    return total;
+}
+
+
+class BondPnLTradeListener : public ServiceListener<Trade<Bond> > {
+private:
+    BondPnLService* pnl_service;
+
+public:
+    // ctor
+    BondPnLTradeListener(BondPnLService* _pnl_service) : pnl_service(_pnl_service) {}
+
+    void ProcessAdd(Trade<Bond>& data) override { pnl_service->AddTrade(data); }
+
+    // no implementation
+    void ProcessRemove(Trade<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Trade<Bond>& data) override {}
+};
+
+
+class BondPnLPriceListener : public ServiceListener<Price<Bond> > {
+private:
+    BondPnLService* pnl_service;
+
+public:
+    // ctor
+    BondPnLPriceListener(BondPnLService* _pnl_service) : pnl_service(_pnl_service) {}
+
+    void ProcessAdd(Price<Bond>& data) override { pnl_service->UpdateMark(data.GetProduct().GetProductId(), data.GetMid()); }
+
+    // no implementation
+    void ProcessRemove(Price<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Price<Bond>& data) override {}
+};
+
+#endif
@@ -17,7 +17,7 @@
 
 class BondPositionService : public PositionService<Bond> {
 public:
-    BondPositionService() { positionMap = map<string, Position<Bond> >(); }
+    BondPositionService() { positionMap = map<ProductId, Position<Bond> >(); }
 
     // Implement all the virtual functions
 
@@ -41,7 +41,7 @@ public:
     void AddTrade(const Trade<Bond>& trade) override;
 
 private:
-    map<string, Position<Bond> > positionMap;
+    map<ProductId, Position<Bond> > positionMap;
     vector<ServiceListener<Position<Bond> >*> listeners;
 };
 
@@ -71,17 +71,19 @@ public:
 void BondPositionService::AddTrade(const Trade<Bond>& trade) 
 {
     // get the book
-    string book = trade.GetBook();
+    const string& book = trade.GetBook();
     // get the id
-    auto bond = trade.GetProduct();
-    string id = bond.GetProductId();
+    const Bond& bond = trade.GetProduct();
+    const ProductId& id = bond.GetProductId();
     
     // new product -> create a pair
-    if (positionMap.find(id) == positionMap.end()) {
-        positionMap.insert(pair<string, Position<Bond> >(id, Position<Bond>(bond)));
+    auto it = positionMap.find(id);
+    if (it == positionMap.end()) {
+        it = positionMap.insert(pair<ProductId, Position<Bond> >(id, Position<Bond>(bond))).first;
     }
 
-    auto pos = GetData(id);
+    // the stored position, updated in place
+    Position<Bond>& pos = it->second;
 
     // get the quantity
     long delta_position = (trade.GetSide() == BUY) ? trade.GetQuantity() : -trade.GetQuantity();
@@ -3,7 +3,8 @@
 * Definition of BondPricingService class
 *
 * 1 Connector
-* read prediction from price.txt
+* read prediction from price.txt, all at once (Subscribe) or up to a
+* timestamp (Replay) to merge it with another timestamped stream
 *
 * @Yunze Sun
 */
@@ -12,21 +13,23 @@
 #define BondPricingService_h
 
 #include "fstream"
+#include <climits>
 #include "pricingservice.hpp"
 #include "products.hpp"
 #include "soa.hpp"
 #include "utility.h"
+#include "TimerWheel.hpp"
 
 using namespace std;
 
 class BondPricingService : public PricingService<Bond> {
 private:
-    map<string, Price<Bond> > priceMap;
+    map<ProductId, Price<Bond> > priceMap;
     vector<ServiceListener<Price<Bond> >* > listeners;
 
 public:
     // ctor
-    BondPricingService() { priceMap = map<string, Price<Bond> >(); };
+    BondPricingService() { priceMap = map<ProductId, Price<Bond> >(); };
 
     // Implement all the virtual functions
 
@@ -51,26 +54,32 @@ public:
 
 class BondPricingServiceConnector : public Connector<Price<Bond> > {
 public:
-    BondPricingServiceConnector(BondPricingService* _bp_service, ProductService<Bond>* _product_service) 
-        : bp_service(_bp_service), product_service(_product_service){};
+    BondPricingServiceConnector(BondPricingService* _bp_service, ProductService<Bond>* _product_service, TimerWheel* _timer = nullptr) 
+        : bp_service(_bp_service), product_service(_product_service), timer(_timer){};
 
     // subscribe-only where Publish() does nothing
     void Publish(Price<Bond>& info) override {};
     // subscribe data from price.txt file
-    void Subscribe();
+    void Subscribe() { Replay(LLONG_MAX); }
+
+    // flow the prices stamped up to until (ms), returns the timestamp of the next one, -1 at the end of the file
+    long long Replay(long long until);
 
 private:
     BondPricingService* bp_service;
     ProductService<Bond>* product_service;
+    TimerWheel* timer; // turned by the price timestamps, may be null
+    ifstream file;
+    string nextLine; // read ahead, not flowed yet
 };
 
 
 void BondPricingService::OnMessage(Price<Bond>& data) {
 
-    string id = data.GetProduct().GetProductId();
+    ProductId id = data.GetProduct().GetProductId();
 
     if (priceMap.find(id) != priceMap.end()) { priceMap.erase(id); }
-    priceMap.insert(pair<string, Price<Bond> >(id, data));
+    priceMap.insert(pair<ProductId, Price<Bond> >(id, data));
 
     // flow the data to listeners
     for (auto& listener : listeners) {
@@ -79,35 +88,43 @@ void BondPricingService::OnMessage(Price<Bond>& data) {
 }
 
 
-void BondPricingServiceConnector::Subscribe() {
-    // read data from price.txt
-    ifstream file("price.txt", ios::in);
-    if (file.is_open()) {
-        string _line, _data;
-        getline(file, _line);
-        while (getline(file, _line)) {
-            stringstream line(_line);
-            vector<string> dataVec;
-            while (getline(line, _data, ','))
-            {
-                dataVec.push_back(_data);
-            }
-
-            string _productId = dataVec[1];
-            auto _product = product_service->GetData(_productId);
-
-            double _bidPrice = Str2Price(dataVec[2]);
-            double _offerPrice = Str2Price(dataVec[3]);
-            double _midPrice = (_bidPrice + _offerPrice) / 2.0;
-            double _spread = _offerPrice - _bidPrice;
-            
-            
-            Price<Bond> _price(_product, _midPrice, _spread);
-
-            // flow the data
-            bp_service->OnMessage(_price);
+long long BondPricingServiceConnector::Replay(long long until) {
+    // read data from price.txt, skip the header on the first call
+    if (!file.is_open()) {
+        file.open("price.txt", ios::in);
+        if (!getline(file, nextLine) || !getline(file, nextLine)) nextLine.clear();
+    }
+    string _data;
+    while (!nextLine.empty()) {
+        stringstream line(nextLine);
+        vector<string> dataVec;
+        while (getline(line, _data, ','))
+        {
+            dataVec.push_back(_data);
         }
+        long long time = stoll(dataVec[0]);
+        if (time > until) return time;
+
+        string _productId = dataVec[1];
+        auto _product = product_service->GetData(_productId);
+
+        double _bidPrice = Str2Price(dataVec[2]);
+        double _offerPrice = Str2Price(dataVec[3]);
+        double _midPrice = (_bidPrice + _offerPrice) / 2.0;
+        double _spread = _offerPrice - _bidPrice;
+        
+        
+        Price<Bond> _price(_product, _midPrice, _spread);
+
+        // fire timers due before this price
+        if (timer) timer->OnEvent(time);
+
+        // flow the data
+        bp_service->OnMessage(_price);
+
+        if (!getline(file, nextLine)) nextLine.clear();
     }
+    return -1;
 }
 
 #endif
\ No newline at end of file
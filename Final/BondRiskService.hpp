@@ -2,6 +2,11 @@
 * BondRiskService.hpp
 * Definition of BondRiskService class
 *
+* The PV01 of a product is updated in place and published to the listeners
+* on every position change. Sectors registered with AddSector keep running
+* PV01 totals, moved by the per-product delta in AddPosition, so a bucketed
+* risk query is one lookup.
+*
 * 1 Listener
 * BondRiskServiceListener - BondRiskService listen from BondPositionService
 *
@@ -14,13 +19,16 @@
 #include "BondPositionService.hpp"
 #include "riskservice.hpp"
 #include "utility.h"    // get pv01 value for each option
+#include "BondAnalytics.hpp"
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
 
 class BondRiskService : public RiskService<Bond> {
 public:
-    // ctor
-    BondRiskService() { 
-        riskMap = map<string, PV01<Bond> >();
+    // ctor, live pv01 from the analytics engine when given, else the fixed table
+    BondRiskService(BondAnalyticsEngine* _analytics = nullptr) : analytics(_analytics) { 
+        riskMap = map<ProductId, PV01<Bond> >();
         listeners = vector<ServiceListener<PV01<Bond>>*>();
     }
 
@@ -44,13 +52,25 @@ public:
     // called by BondPositionServiceListener
     void AddPosition(Position<Bond>& position);
 
-    // Get the bucketed risk for the bucket sector
-    PV01< BucketedSector<Bond> >& GetBucketedRisk(const BucketedSector<Bond>& sector) const;
+    // register a sector by name, its risk is kept up to date from then on
+    void AddSector(const BucketedSector<Bond>& sector);
+
+    // Get the bucketed risk for the bucket sector, a snapshot
+    PV01< BucketedSector<Bond> > GetBucketedRisk(const BucketedSector<Bond>& sector) const;
+    PV01< BucketedSector<Bond> > GetBucketedRisk(const string& sectorName) const;
 
 
 private:
-    map<string, PV01<Bond> > riskMap;
+    map<ProductId, PV01<Bond> > riskMap;
     vector<ServiceListener<PV01<Bond> >*> listeners;
+    BondAnalyticsEngine* analytics;
+
+    // registered sectors
+    vector<BucketedSector<Bond> > sectors;
+    vector<double> sectorRisk; // sum of pv01 * quantity
+    vector<long> sectorQuantity;
+    unordered_map<string, int> sectorIndex; // name -> sector
+    unordered_map<ProductId, vector<int> > productSectors; // product id -> sectors holding it
 };
 
 
@@ -78,36 +98,102 @@ public:
 
 
 void BondRiskService::AddPosition(Position<Bond>& position) {
-    auto bond = position.GetProduct();
-    string id = bond.GetProductId();
-    double _pv01 = GetPV01Value(id);
+    const Bond& bond = position.GetProduct();
+    const ProductId& id = bond.GetProductId();
+    double _pv01 = analytics ? analytics->GetPV01(id) : GetPV01Value(id);
     long _quantity = position.GetAggregatePosition();
 
-    if (riskMap.find(id) != riskMap.end()) { riskMap.erase(id); }
-    riskMap.insert(pair<string, PV01<Bond>>( id, PV01<Bond>(bond, _pv01, _quantity)));
+    // risk and quantity this product contributed so far
+    double oldRisk = 0;
+    long oldQuantity = 0;
+    auto it = riskMap.find(id);
+    if (it != riskMap.end()) {
+        oldRisk = it->second.GetPV01() * it->second.GetQuantity();
+        oldQuantity = it->second.GetQuantity();
+        it->second.Update(_pv01, _quantity);
+    }
+    else {
+        it = riskMap.insert(pair<ProductId, PV01<Bond>>(id, PV01<Bond>(bond, _pv01, _quantity))).first;
+    }
+
+    // move every sector holding the product by the delta
+    auto s = productSectors.find(id);
+    if (s != productSectors.end()) {
+        double deltaRisk = _pv01 * _quantity - oldRisk;
+        long deltaQuantity = _quantity - oldQuantity;
+        for (int k : s->second) {
+            sectorRisk[k] += deltaRisk;
+            sectorQuantity[k] += deltaQuantity;
+        }
+    }
+
     for (auto& listener : listeners) {
-        listener->ProcessAdd(riskMap.find(id)->second);
+        listener->ProcessAdd(it->second);
+    }
+}
+
+
+void BondRiskService::AddSector(const BucketedSector<Bond>& _sector) {
+    // a name registered again is replaced
+    auto found = sectorIndex.find(_sector.GetName());
+    int k;
+    if (found != sectorIndex.end()) {
+        k = found->second;
+        for (auto& entry : productSectors) {
+            auto& held = entry.second;
+            held.erase(remove(held.begin(), held.end(), k), held.end());
+        }
+        sectors[k] = _sector;
+    }
+    else {
+        k = (int)sectors.size();
+        sectorIndex.insert(pair<string, int>(_sector.GetName(), k));
+        sectors.push_back(_sector);
+        sectorRisk.push_back(0);
+        sectorQuantity.push_back(0);
+    }
+
+    // start from the risk already held
+    double tot = 0;
+    long _quantity = 0;
+    for (auto& p : _sector.GetProducts()) {
+        const ProductId& id = p.GetProductId();
+        productSectors[id].push_back(k);
+        auto it = riskMap.find(id);
+        if (it != riskMap.end()) {
+            tot += it->second.GetPV01() * it->second.GetQuantity();
+            _quantity += it->second.GetQuantity();
+        }
     }
+    sectorRisk[k] = tot;
+    sectorQuantity[k] = _quantity;
+}
+
+
+PV01< BucketedSector<Bond> > BondRiskService::GetBucketedRisk(const string& sectorName) const {
+    int k = sectorIndex.at(sectorName);
+    return PV01<BucketedSector<Bond> >(sectors[k], sectorRisk[k], sectorQuantity[k]);
 }
 
 
-PV01< BucketedSector<Bond> >& BondRiskService::GetBucketedRisk(const BucketedSector<Bond>& _sector) const {
+PV01< BucketedSector<Bond> > BondRiskService::GetBucketedRisk(const BucketedSector<Bond>& _sector) const {
+
+    // registered sector, running totals
+    if (sectorIndex.find(_sector.GetName()) != sectorIndex.end()) return GetBucketedRisk(_sector.GetName());
 
     double tot = 0;
     long _quantity = 0;
 
-    auto _products = _sector.GetProducts();
-    for (auto& p : _products)
+    for (auto& p : _sector.GetProducts())
     {
-        string id = p.GetProductId();
-        if (riskMap.find(id) != riskMap.end()) {
-            tot += riskMap.at(id).GetPV01() * riskMap.at(id).GetQuantity();
-            _quantity += riskMap.at(id).GetQuantity();
+        auto it = riskMap.find(p.GetProductId());
+        if (it != riskMap.end()) {
+            tot += it->second.GetPV01() * it->second.GetQuantity();
+            _quantity += it->second.GetQuantity();
         }
     }
 
-    PV01<BucketedSector<Bond>> pv01(_sector, tot, _quantity);
-    return pv01;
+    return PV01<BucketedSector<Bond> >(_sector, tot, _quantity);
 }
 
 #endif
\ No newline at end of file
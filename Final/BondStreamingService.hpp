@@ -5,6 +5,11 @@
 * 1 Connector: BondStreamingServiceConnector
 * Publish the price
 *
+* Unchanged quotes are suppressed, changed ones go out as deltas
+* (QuoteDeltaEncoder) carrying only the changed fields, client tiers
+* included. The full quotes
+* are fanned out to local readers through a shared-memory ring
+* (PriceStreamRing.hpp)
 *
 * 1 Listener: BondStreamingServiceListener
 * listen from BondAlgoStreamingService
@@ -17,18 +22,21 @@
 
 #include "streamingservice.hpp"
 #include "BondAlgoStreamingService.hpp"
+#include "QuoteDeltaEncoder.hpp"
+#include "PriceStreamRing.hpp"
 
 class BondStreamingServiceConnector;
 
 class BondStreamingService : public StreamingService<Bond> {
 private:
-    map<string, PriceStream<Bond> > streamMap;
+    map<ProductId, PriceStream<Bond> > streamMap;
     vector<ServiceListener<PriceStream<Bond> >*> listeners;
     BondStreamingServiceConnector* conn;
+    QuoteDeltaEncoder encoder;
 
 public:
     // ctor
-    BondStreamingService(BondStreamingServiceConnector* _conn) : conn(_conn) { streamMap = map<string, PriceStream<Bond> >(); };
+    BondStreamingService(BondStreamingServiceConnector* _conn) : conn(_conn) { streamMap = map<ProductId, PriceStream<Bond> >(); };
 
     // Implement all the virtual functions
 
@@ -47,22 +55,32 @@ public:
     // publish the price via connector
     void PublishPrice(PriceStream<Bond>& price_stream);
 
-    // called by BondStreamingServiceListener
+    // called by BondStreamingServiceListener, publishes the changes of the quote
     void UpdateStream(const AlgoStream<Bond>& algo);
+
+    // published / suppressed counts and bytes
+    const QuoteDeltaEncoder& GetEncoder() const { return encoder; }
 };
 
 
 class BondStreamingServiceConnector : public Connector<PriceStream<Bond> > {
 public:
-    // ctor
-    BondStreamingServiceConnector() {}
+    // ctor, quotes go to the shared-memory ring when one is given, to the console when print is set
+    BondStreamingServiceConnector(PriceStreamShmPublisher* _shm = nullptr, bool _print = true) : shm(_shm), print(_print) {}
 
     // override pure virtual functions in base class
-    // publish ExecutionOrder, called by BondExecutionService
+    // publish the full quote to the shared-memory readers
     void Publish(PriceStream<Bond>& data) override;
 
+    // publish a delta message from QuoteDeltaEncoder to the console
+    void PublishDelta(const char* data, size_t length);
+
     // publish only, no subsribe
     void Subscribe() {}
+
+private:
+    PriceStreamShmPublisher* shm;
+    bool print;
 };
 
 
@@ -76,8 +94,6 @@ public:
     void ProcessAdd(AlgoStream<Bond>& data) override
     {
         bs_service->UpdateStream(data);
-        auto price_stream = data.GetPriceStream();
-        bs_service->PublishPrice(price_stream);
     }
 
     // no implementation
@@ -98,28 +114,52 @@ void BondStreamingService::PublishPrice(PriceStream<Bond>& price_stream) {
 
 void BondStreamingService::UpdateStream(const AlgoStream<Bond>& algo) {
     auto stream = algo.GetPriceStream();
+
+    // nothing changed, nothing to store or publish
+    size_t length = encoder.Encode(stream);
+    if (length == 0) return;
+
     auto id = stream.GetProduct().GetProductId();
     if (streamMap.find(id) != streamMap.end()) { streamMap.erase(id); }
 
-    streamMap.insert(pair<string, PriceStream<Bond> >(id, stream));
+    streamMap.insert(pair<ProductId, PriceStream<Bond> >(id, stream));
 
     for (auto& listener : listeners) {
         listener->ProcessAdd(stream);
     }
+
+    conn->Publish(stream);
+    conn->PublishDelta(encoder.Data(), length);
 }
 
 
 // Implement BondStreamingServiceConnector class
 void BondStreamingServiceConnector::Publish(PriceStream<Bond>& data) {
-    auto bond = data.GetProduct();
-    auto bid = data.GetBidOrder();
-    auto offer = data.GetOfferOrder();
-
-    cout << "PriceSream -- product: " << bond.GetProductId() << "\n"
-        << "\tBid\t" << "Price: " << bid.GetPrice() << "\tVisibleQuantity: " << bid.GetVisibleQuantity()
-        << "\tHiddenQuantity: " << bid.GetHiddenQuantity() << "\n"
-        << "\tAsk\t" << "Price: " << offer.GetPrice() << "\tVisibleQuantity: " << offer.GetVisibleQuantity()
-        << "\tHiddenQuantity: " << offer.GetHiddenQuantity() << "\n";
+    if (shm) shm->Publish(data);
+}
+
+void BondStreamingServiceConnector::PublishDelta(const char* data, size_t length) {
+    if (!print) return;
+    QuoteState quote;
+    QuoteDeltaHeader header;
+    if (!QuoteDeltaEncoder::Decode(data, length, quote, header)) return;
+
+    // only the fields in the message
+    cout << "PriceStream #" << header.sequence << " -- product: " << string(header.productId, strnlen(header.productId, sizeof(header.productId)));
+    if (header.fieldMask & BID_PRICE) cout << "\tBid: " << quote.bidPrice;
+    if (header.fieldMask & BID_VISIBLE) cout << "\tBidVisible: " << quote.bidVisible;
+    if (header.fieldMask & BID_HIDDEN) cout << "\tBidHidden: " << quote.bidHidden;
+    if (header.fieldMask & OFFER_PRICE) cout << "\tAsk: " << quote.offerPrice;
+    if (header.fieldMask & OFFER_VISIBLE) cout << "\tAskVisible: " << quote.offerVisible;
+    if (header.fieldMask & OFFER_HIDDEN) cout << "\tAskHidden: " << quote.offerHidden;
+    for (int t = 1; t < header.tierCount; ++t) {
+        unsigned int bits = header.tierMask >> ((t - 1) * TIER_FIELDS);
+        if (bits & (1u << TIER_BID_PRICE)) cout << "\tTier" << t << " Bid: " << quote.tierBidPrice[t];
+        if (bits & (1u << TIER_OFFER_PRICE)) cout << "\tTier" << t << " Ask: " << quote.tierOfferPrice[t];
+        if (bits & (1u << TIER_BID_QUANTITY)) cout << "\tTier" << t << " BidSize: " << quote.tierBidQuantity[t];
+        if (bits & (1u << TIER_OFFER_QUANTITY)) cout << "\tTier" << t << " AskSize: " << quote.tierOfferQuantity[t];
+    }
+    cout << "\n";
 }
 
 #endif
\ No newline at end of file
@@ -5,8 +5,14 @@
 * 1 Connector
 * BondTradeBookingServiceConnector - Read data from "trades.txt"
 * 
-* 1 Listener
+* 2 Listeners
 * BondTradeBookingServiceListener - BondTradeBookingService listen from BondExecutionService
+* BondTradeBookingFillListener - book the venue fills reported by BondExecutionService
+* 
+* Trades are kept in an append-only TradeJournal instead of a map: booking
+* appends a record and indexes its trade id, GetData decodes the latest
+* record of an id. A restart picks the journal up again, Replay sends the
+* journaled trades through the listeners to rebuild the positions.
 * 
 * @Yunze Sun
 */
@@ -15,24 +21,28 @@
 #define BondTradeBookingService_h
 
 #include <fstream>
+#include <memory>
+#include <stdexcept>
 #include "tradebookingservice.hpp"
 #include "products.hpp"
 #include "BondExecutionService.hpp"
+#include "TradeJournal.hpp"
 #include "utility.h"
 
 using namespace std;
 
 class BondTradeBookingService : public TradeBookingService<Bond> {
 private:
-    map<string, Trade<Bond> > trades; // map: id -> Trade
+    TradeJournal journal; // id -> latest record
+    unique_ptr<Trade<Bond> > lookup; // last trade returned by GetData
     vector<ServiceListener<Trade<Bond> >*> listeners;
 
 public:
-    // Constructor
-    BondTradeBookingService() { trades = map<string, Trade<Bond> >(); }
+    // Constructor, continues the journal at journalPath unless recover is false
+    BondTradeBookingService(const string& journalPath = "trades.journal", bool recover = true) : journal(journalPath, recover) {}
 
-    // Implement the virtual func
-    Trade<Bond>& GetData(string key) override { return trades.at(key); }
+    // Implement the virtual func, the trade is valid until the next call
+    Trade<Bond>& GetData(string key) override;
 
     // The callback that a Connector should invoke for any new or updated data
     void OnMessage(Trade<Bond>& data) override;
@@ -44,7 +54,13 @@ public:
     // Get all listeners on the Service.
     const vector<ServiceListener<Trade<Bond> >*>& GetListeners() const override { return listeners; };
 
+    // journal the trade, throws runtime_error if it cannot be written
     void BookTrade(const Trade<Bond>& trade) override;
+
+    // publish every journaled trade to the listeners, in booking order
+    void Replay();
+
+    TradeJournal& GetJournal() { return journal; }
 };
 
 
@@ -86,6 +102,25 @@ private:
 };
 
 
+class BondTradeBookingFillListener : public ServiceListener<ExecutionFill<Bond> > {
+public:
+    // Constructor
+    BondTradeBookingFillListener(BondTradeBookingService* _service) : btb_service(_service) {};
+
+    // book every fill under the trade id given by the venue
+    void ProcessAdd(ExecutionFill<Bond>& data) override;
+
+    // no implementation
+    void ProcessRemove(ExecutionFill<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(ExecutionFill<Bond>& data) override {}
+
+private:
+    BondTradeBookingService* btb_service;
+};
+
+
 // Implemention for BondTradeBookingService class
 void BondTradeBookingService::OnMessage(Trade<Bond>& trade) {
     BookTrade(trade);
@@ -95,11 +130,25 @@ void BondTradeBookingService::OnMessage(Trade<Bond>& trade) {
     }
 }
 void BondTradeBookingService::BookTrade(const Trade<Bond>& trade) {
-    string id = trade.GetTradeId();
-    // Identify if the trade is already recorded
-    if (trades.find(id) != trades.end()) { trades.erase(id); }
+    // a trade id booked again points to its new record
+    if (journal.Append(trade) < 0) throw runtime_error("trade " + trade.GetTradeId() + " not journaled");
+}
 
-    trades.insert(pair<string, Trade<Bond> >(id, trade));
+Trade<Bond>& BondTradeBookingService::GetData(string key) {
+    long long record = journal.Find(key);
+    if (record < 0) throw out_of_range("trade " + key + " not booked");
+    if (lookup) *lookup = journal.GetTrade(record);
+    else lookup.reset(new Trade<Bond>(journal.GetTrade(record)));
+    return *lookup;
+}
+
+void BondTradeBookingService::Replay() {
+    for (long long r = 0; r < journal.Size(); ++r) {
+        Trade<Bond> trade = journal.GetTrade(r);
+        for (auto& listener : listeners) {
+            listener->ProcessAdd(trade);
+        }
+    }
 }
 
 // Implemention for BondTradeBookingServiceConnector class
@@ -158,5 +207,25 @@ void BondTradeBookingServiceListener::ProcessAdd(ExecutionOrder<Bond>& data) {
     btb_service->OnMessage(trade);   // add to book
 }
 
+void BondTradeBookingFillListener::ProcessAdd(ExecutionFill<Bond>& data) {
+    // cancel reports carry no quantity
+    if (data.GetQuantity() <= 0) return;
+
+    string book;
+    switch (rand() % 3) {
+    case 0:
+        book = "TRSY1"; break;
+    case 1:
+        book = "TRSY2"; break;
+    case 2:
+        book = "TRSY3"; break;
+    }
+    // a BID order buys
+    Side side = (data.GetSide() == BID) ? BUY : SELL;
+    Trade<Bond> trade(data.GetProduct(), data.GetTradeId(), data.GetPrice(), book, data.GetQuantity(), side);
+
+    btb_service->OnMessage(trade);   // add to book
+}
+
 
 #endif
\ No newline at end of file
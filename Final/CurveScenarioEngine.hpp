@@ -0,0 +1,287 @@
+/**
+* CurveScenarioEngine.hpp
+* Definition of CurveScenarioEngine class
+*
+* Stress P&L of the position book under yield curve shocks. A scenario is a
+* yield change on every key rate node (KEY_RATE_TENORS), linear between the
+* nodes and flat outside, so parallel, twist, butterfly and key rate shocks
+* are all the same shape. Every cashflow is discounted at its bond's live
+* yield plus the shock at the flow's tenor:
+*
+*   P_s = sum cf_k / (1 + (y + shock_s(t_k)) / 2)^n_k
+*   P&L = quantity / 100 * (P_s - P_0)
+*
+* Cashflows, tenors and node weights are laid out flat once per bond; a run
+* snapshots the yields from BondAnalyticsEngine and fans the scenarios out
+* over the WorkStealingPool, every scenario filling its own row of the
+* scenarios x buckets matrix (the last column is the total).
+*
+* 1 Listener: BondScenarioPositionListener
+* listen from BondPositionService
+*
+* @Yunze Sun
+*/
+
+#ifndef CurveScenarioEngine_h
+#define CurveScenarioEngine_h
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "BondCashflows.hpp"
+#include "BondAnalytics.hpp"
+#include "WorkStealingPool.hpp"
+using namespace std;
+
+struct CurveScenario {
+    string name;
+    double shift[KEY_RATES]; // yield change on every node, 0.0001 = 1bp
+};
+
+struct ScenarioPnL {
+    vector<string> scenarios;
+    vector<string> buckets; // registered buckets, then "Total"
+    vector<double> pnl; // [scenario * buckets.size() + bucket]
+
+    double Get(int scenario, int bucket) const { return pnl[scenario * buckets.size() + bucket]; }
+
+    // scenario with the lowest P&L in a bucket
+    int Worst(int bucket) const;
+};
+
+class CurveScenarioEngine {
+public:
+    // ctor, live yields from analytics (coupon yields when null)
+    CurveScenarioEngine(const vector<Bond>& _bonds, BondAnalyticsEngine* _analytics, WorkStealingPool* _pool,
+        const date& settlement = from_string(DEFAULT_SETTLEMENT_DATE));
+
+    // a bond reports to the last bucket holding it, returns the bucket index
+    int AddBucket(const BucketedSector<Bond>& sector);
+
+    void SetPosition(const ProductId& productId, long quantity);
+
+    // P&L of every scenario in every bucket
+    ScenarioPnL Run(const vector<CurveScenario>& scenarios);
+
+    double GetLastRunTime() const { return lastRunTime; } // seconds
+    int Size() const { return numBonds; }
+
+    // scenario shapes, bp in basis points
+    static CurveScenario Parallel(double bp);
+    static CurveScenario Twist(double bp); // 2y -bp, 30y +bp, pivot at 7y
+    static CurveScenario Butterfly(double bp); // wings +bp, belly -bp
+    static CurveScenario KeyRate(int node, double bp);
+    static CurveScenario Combine(const string& name, const CurveScenario& a, const CurveScenario& b);
+
+    // parallel, twists, butterflies, key rates and their combinations, a few hundred in all
+    static vector<CurveScenario> StandardScenarios();
+
+private:
+    int numBonds;
+    vector<ProductId> productIds;
+    vector<double> coupons;
+    unordered_map<ProductId, int> productIndex;
+    BondAnalyticsEngine* analytics;
+    WorkStealingPool* pool;
+
+    // flows of bond b are [flowStart[b], flowStart[b + 1])
+    vector<int> flowStart;
+    vector<double> periods, amounts, weights;
+    vector<int> nodes;
+
+    vector<long> positions;
+    vector<int> bucketOf; // -1 outside every bucket
+    vector<string> bucketNames;
+    double lastRunTime;
+};
+
+
+int ScenarioPnL::Worst(int bucket) const {
+    int worst = -1;
+    for (int s = 0; s < (int)scenarios.size(); ++s) {
+        if (worst < 0 || Get(s, bucket) < Get(worst, bucket)) worst = s;
+    }
+    return worst;
+}
+
+
+CurveScenarioEngine::CurveScenarioEngine(const vector<Bond>& _bonds, BondAnalyticsEngine* _analytics, WorkStealingPool* _pool, const date& settlement)
+    : numBonds((int)_bonds.size()), analytics(_analytics), pool(_pool), positions(_bonds.size(), 0), bucketOf(_bonds.size(), -1), lastRunTime(0)
+{
+    flowStart.push_back(0);
+    for (int b = 0; b < numBonds; ++b) {
+        const Bond& bond = _bonds[b];
+        productIds.push_back(bond.GetProductId());
+        coupons.push_back(bond.GetCoupon());
+        productIndex.insert(pair<ProductId, int>(bond.GetProductId(), b));
+
+        CashflowSchedule schedule = BuildCashflowSchedule(bond, settlement);
+        double first = FirstPeriod(schedule, bond);
+        for (size_t k = 0; k < schedule.times.size(); ++k) {
+            int node;
+            double weight;
+            KeyRateWeight(schedule.times[k], node, weight);
+            periods.push_back(first + k);
+            amounts.push_back(schedule.amounts[k]);
+            nodes.push_back(node);
+            weights.push_back(weight);
+        }
+        flowStart.push_back((int)periods.size());
+    }
+}
+
+int CurveScenarioEngine::AddBucket(const BucketedSector<Bond>& sector) {
+    int k = (int)bucketNames.size();
+    bucketNames.push_back(sector.GetName());
+    for (auto& product : sector.GetProducts()) {
+        auto it = productIndex.find(product.GetProductId());
+        if (it != productIndex.end()) bucketOf[it->second] = k;
+    }
+    return k;
+}
+
+void CurveScenarioEngine::SetPosition(const ProductId& productId, long quantity) {
+    auto it = productIndex.find(productId);
+    if (it != productIndex.end()) positions[it->second] = quantity;
+}
+
+ScenarioPnL CurveScenarioEngine::Run(const vector<CurveScenario>& scenarios) {
+    auto start = chrono::steady_clock::now();
+    ScenarioPnL result;
+    for (auto& scenario : scenarios) result.scenarios.push_back(scenario.name);
+    result.buckets = bucketNames;
+    result.buckets.push_back("Total");
+    int columns = (int)result.buckets.size();
+    int total = columns - 1;
+    result.pnl.assign(scenarios.size() * columns, 0.0);
+
+    // live yields and base prices of the bonds with a position
+    vector<int> held;
+    vector<double> yields(numBonds, 0.0), basePrices(numBonds, 0.0);
+    for (int b = 0; b < numBonds; ++b) {
+        if (positions[b] == 0) continue;
+        held.push_back(b);
+        const BondRisk* risk = analytics ? analytics->GetRisk(productIds[b]) : nullptr;
+        yields[b] = risk ? risk->yield : coupons[b];
+        double g = log1p(yields[b] / 2.0);
+        double p = 0;
+        for (int k = flowStart[b]; k < flowStart[b + 1]; ++k) p += amounts[k] * exp(-periods[k] * g);
+        basePrices[b] = p;
+    }
+
+    pool->ParallelFor(0, (long)scenarios.size(), 1, [&](long lo, long hi) {
+        for (long s = lo; s < hi; ++s) {
+            const double* shift = scenarios[s].shift;
+            double* row = &result.pnl[s * columns];
+            for (int b : held) {
+                double y = yields[b];
+                double p = 0;
+                for (int k = flowStart[b]; k < flowStart[b + 1]; ++k) {
+                    double shock = shift[nodes[k]] + weights[k] * (shift[nodes[k] + 1] - shift[nodes[k]]);
+                    p += amounts[k] * exp(-periods[k] * log1p((y + shock) / 2.0));
+                }
+                double pnl = positions[b] / 100.0 * (p - basePrices[b]);
+                if (bucketOf[b] >= 0) row[bucketOf[b]] += pnl;
+                row[total] += pnl;
+            }
+        }
+    });
+
+    lastRunTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+CurveScenario CurveScenarioEngine::Parallel(double bp) {
+    CurveScenario scenario;
+    scenario.name = "Parallel" + to_string((int)bp);
+    for (int i = 0; i < KEY_RATES; ++i) scenario.shift[i] = bp * 0.0001;
+    return scenario;
+}
+
+CurveScenario CurveScenarioEngine::Twist(double bp) {
+    CurveScenario scenario;
+    scenario.name = "Twist" + to_string((int)bp);
+    double pivot = log(7.0), low = log(KEY_RATE_TENORS[0]), high = log(KEY_RATE_TENORS[KEY_RATES - 1]);
+    for (int i = 0; i < KEY_RATES; ++i) {
+        double x = log(KEY_RATE_TENORS[i]);
+        scenario.shift[i] = bp * 0.0001 * (x < pivot ? (x - pivot) / (pivot - low) : (x - pivot) / (high - pivot));
+    }
+    return scenario;
+}
+
+CurveScenario CurveScenarioEngine::Butterfly(double bp) {
+    CurveScenario scenario;
+    scenario.name = "Butterfly" + to_string((int)bp);
+    for (int i = 0; i < KEY_RATES; ++i) {
+        bool belly = KEY_RATE_TENORS[i] >= 5 && KEY_RATE_TENORS[i] <= 10;
+        scenario.shift[i] = (belly ? -bp : bp) * 0.0001;
+    }
+    return scenario;
+}
+
+CurveScenario CurveScenarioEngine::KeyRate(int node, double bp) {
+    CurveScenario scenario;
+    scenario.name = "KeyRate" + to_string((int)KEY_RATE_TENORS[node]) + "y" + to_string((int)bp);
+    for (int i = 0; i < KEY_RATES; ++i) scenario.shift[i] = i == node ? bp * 0.0001 : 0.0;
+    return scenario;
+}
+
+CurveScenario CurveScenarioEngine::Combine(const string& name, const CurveScenario& a, const CurveScenario& b) {
+    CurveScenario scenario;
+    scenario.name = name;
+    for (int i = 0; i < KEY_RATES; ++i) scenario.shift[i] = a.shift[i] + b.shift[i];
+    return scenario;
+}
+
+vector<CurveScenario> CurveScenarioEngine::StandardScenarios() {
+    vector<CurveScenario> scenarios;
+    double sizes[] = { 1, 5, 10, 25, 50, 100, 150, 200, 300 };
+    for (double bp : sizes) {
+        scenarios.push_back(Parallel(bp));
+        scenarios.push_back(Parallel(-bp));
+        scenarios.push_back(Twist(bp));
+        scenarios.push_back(Twist(-bp));
+        scenarios.push_back(Butterfly(bp));
+        scenarios.push_back(Butterfly(-bp));
+        for (int node = 0; node < KEY_RATES; ++node) {
+            scenarios.push_back(KeyRate(node, bp));
+            scenarios.push_back(KeyRate(node, -bp));
+        }
+    }
+    // parallel moves with a steepening or flattening on top
+    double levels[] = { -100, -50, -25, 25, 50, 100 };
+    double twists[] = { -50, -25, 25, 50 };
+    for (double level : levels) {
+        for (double twist : twists) {
+            string name = "Parallel" + to_string((int)level) + "+Twist" + to_string((int)twist);
+            scenarios.push_back(Combine(name, Parallel(level), Twist(twist)));
+        }
+    }
+    return scenarios;
+}
+
+
+class BondScenarioPositionListener : public ServiceListener<Position<Bond> > {
+public:
+    // ctor
+    BondScenarioPositionListener(CurveScenarioEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(Position<Bond>& data) override { engine->SetPosition(data.GetProduct().GetProductId(), data.GetAggregatePosition()); }
+
+    // no implementation
+    void ProcessRemove(Position<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Position<Bond>& data) override {}
+
+private:
+    CurveScenarioEngine* engine;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+* FixedString.hpp
+* Definition of FixedString class
+*
+* Identifier of at most N - 1 characters stored inline: no allocation, a
+* copy is a few word moves. The bytes are zero padded to N so equality
+* compares N / 8 machine words, and the hash is computed once when the id
+* is built. Ordering is byte-wise, the same as std::string for ids, so an
+* ordered map iterates as before.
+*
+* ProductId, TradeId, OrderId and InquiryId are the ids used across the
+* messages (CUSIP 9 chars, ISIN 12, trade and inquiry ids 12, order ids 13
+* plus a 2 char venue slice suffix).
+*
+* @Yunze Sun
+*/
+
+#ifndef FixedString_h
+#define FixedString_h
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+template<int N>
+class FixedString {
+public:
+    static_assert(N > 0 && N % 8 == 0, "FixedString capacity must be a whole number of words");
+    static const int WORDS = N / 8;
+
+    // ctor, throws length_error if the id does not fit
+    FixedString() : hashValue(0), len(0) { for (int i = 0; i < WORDS; ++i) words[i] = 0; hashValue = Hash(); }
+    FixedString(const char* s) : FixedString(s, s ? strlen(s) : 0) {}
+    FixedString(const string& s) : FixedString(s.data(), s.size()) {}
+    FixedString(const char* s, size_t n);
+
+    size_t size() const { return len; }
+    size_t length() const { return len; }
+    bool empty() const { return len == 0; }
+    const char* data() const { return (const char*)words; }
+    const char* c_str() const { return (const char*)words; }
+    size_t hash() const { return hashValue; }
+
+    string str() const { return string(data(), len); }
+    operator string() const { return str(); }
+
+    bool operator==(const FixedString& other) const;
+    bool operator!=(const FixedString& other) const { return !(*this == other); }
+    bool operator<(const FixedString& other) const { return memcmp(words, other.words, N) < 0; }
+    bool operator==(const char* s) const { return s && strcmp(c_str(), s) == 0; }
+    bool operator!=(const char* s) const { return !(*this == s); }
+    bool operator==(const string& s) const { return s.size() == len && memcmp(data(), s.data(), len) == 0; }
+    bool operator!=(const string& s) const { return !(*this == s); }
+
+private:
+    unsigned long long words[WORDS];
+    size_t hashValue;
+    unsigned char len;
+
+    size_t Hash() const;
+};
+
+typedef FixedString<16> ProductId;
+typedef FixedString<16> TradeId;
+typedef FixedString<16> OrderId;
+typedef FixedString<16> InquiryId;
+
+
+template<int N>
+FixedString<N>::FixedString(const char* s, size_t n) : hashValue(0), len((unsigned char)n)
+{
+    // the last byte stays 0 so c_str() is terminated
+    if (n >= (size_t)N) throw length_error("id longer than " + to_string(N - 1) + " characters: " + string(s, n));
+    for (int i = 0; i < WORDS; ++i) words[i] = 0;
+    if (n) memcpy(words, s, n);
+    hashValue = Hash();
+}
+
+template<int N>
+size_t FixedString<N>::Hash() const {
+    // one multiply-xorshift round per word
+    unsigned long long h = 0x9E3779B97F4A7C15ULL ^ len;
+    for (int i = 0; i < WORDS; ++i) {
+        h = (h ^ words[i]) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return (size_t)h;
+}
+
+template<int N>
+bool FixedString<N>::operator==(const FixedString& other) const {
+    if (hashValue != other.hashValue) return false;
+    unsigned long long diff = 0;
+    for (int i = 0; i < WORDS; ++i) diff |= words[i] ^ other.words[i];
+    return diff == 0;
+}
+
+template<int N>
+bool operator==(const char* s, const FixedString<N>& id) { return id == s; }
+template<int N>
+bool operator!=(const char* s, const FixedString<N>& id) { return id != s; }
+template<int N>
+bool operator==(const string& s, const FixedString<N>& id) { return id == s; }
+template<int N>
+bool operator!=(const string& s, const FixedString<N>& id) { return id != s; }
+
+template<int N>
+string operator+(const string& s, const FixedString<N>& id) { return s + id.str(); }
+template<int N>
+string operator+(const FixedString<N>& id, const string& s) { return id.str() + s; }
+template<int N>
+string operator+(const char* s, const FixedString<N>& id) { return s + id.str(); }
+template<int N>
+string operator+(const FixedString<N>& id, const char* s) { return id.str() + s; }
+
+template<int N>
+ostream& operator<<(ostream& out, const FixedString<N>& id) { return out.write(id.data(), id.size()); }
+
+namespace std {
+    template<int N>
+    struct hash<FixedString<N> > {
+        size_t operator()(const FixedString<N>& id) const { return id.hash(); }
+    };
+}
+
+#endif
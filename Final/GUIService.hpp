@@ -18,6 +18,7 @@
 #include "soa.hpp"  
 #include "utility.h"
 #include "pricingservice.hpp"
+#include "TimerWheel.hpp"
 
 // forward declaration of GUIConnector and GUIServiceListener
 template<typename T>
@@ -35,16 +36,21 @@ template<typename T>
 class GUIService : public Service<string, Price<T> >
 {
 private:
-    map<string, Price<T>> priceMap; // store price data keyed by product identifier
+    map<ProductId, Price<T>> priceMap; // store price data keyed by product identifier
     vector<ServiceListener<Price<T>>*> listeners; // list of listeners to this service
     GUIConnector<T>* connector; // connector related to this server
     GUIServiceListener<T>* guiservicelistener; // listener related to this server
     int throttle; // throttle of the service   
     std::chrono::system_clock::time_point startTime; // start time
+    TimerWheel* timer; // drives the throttle, clock polling is used if null
+    string pendingId; // product of the latest price not yet published
+
+    // publish the latest pending price, fired by the throttle timer
+    void FlushPendingPrice();
 
 public:
     // ctor
-    GUIService();
+    GUIService(TimerWheel* _timer = nullptr);
 
     // Get data on our service given a key
     Price<T>& GetData(string key) override;
@@ -73,12 +79,15 @@ public:
 };
 
 template<typename T>
-GUIService<T>::GUIService()
+GUIService<T>::GUIService(TimerWheel* _timer)
 {
     connector = new GUIConnector<T>(this); // connector related to this server
     guiservicelistener = new GUIServiceListener<T>(this); // listener related to this server
     throttle = 300; // default throttle 
     startTime = std::chrono::system_clock::now(); // start time
+    timer = _timer;
+    // publish at most once per throttle period, whatever the tick rate
+    if (timer) timer->SchedulePeriodic(throttle, [this]() { FlushPendingPrice(); });
 }
 
 template<typename T>
@@ -126,6 +135,15 @@ int GUIService<T>::GetThrottle() const
 template<typename T>
 void GUIService<T>::PublishThrottledPrice(Price<T>& price)
 {
+    if (timer) {
+        // keep the latest price, the throttle timer publishes it
+        ProductId id = price.GetProduct().GetProductId();
+        if (priceMap.find(id) != priceMap.end()) { priceMap.erase(id); }
+        priceMap.insert(pair<ProductId, Price<T> >(id, price));
+        pendingId = id;
+        return;
+    }
+
     // only publish price to GUI if the time interval is larger than throttle
     auto now = std::chrono::system_clock::now();
     auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime);
@@ -137,6 +155,14 @@ void GUIService<T>::PublishThrottledPrice(Price<T>& price)
     }
 }
 
+template<typename T>
+void GUIService<T>::FlushPendingPrice()
+{
+    if (pendingId.empty()) return;
+    connector->Publish(priceMap.at(pendingId));
+    pendingId.clear();
+}
+
 /**
 * GUI Connector publishing data from GUI Service.
 * Type T is the product type.
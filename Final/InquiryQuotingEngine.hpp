@@ -0,0 +1,311 @@
+/**
+* InquiryQuotingEngine.hpp
+* Definition of InquiryQuotingEngine class
+*
+* Automatic pricing of client RFQs. The side of an inquiry is the client's:
+* a client BUY is answered with an offer, a client SELL with a bid.
+*
+*   offer = mid + half spread + size cost + shift + widen / 2
+*   bid   = mid - half spread - size cost + shift - widen / 2
+*
+* The mid and spread are the latest from BondPricingService. The size cost
+* is what hedging the inquiry would cost on the book: the VWAP of walking
+* the offer (bid) stack for the quantity against the best level, with a
+* penalty per 1MM left over once the book runs out. Shift and widen are
+* the position and risk skew of QuoteSkewEngine, the quote is rounded to
+* 1/256 against the client.
+*
+* RFQs are queued on arrival with a timestamp and answered in order by
+* Drain, which is due once the oldest has waited half the latency budget,
+* so a burst is quoted in batches without any RFQ waiting for the whole
+* burst; the owner drains a queue that is not due yet by a timer. Pricing
+* is a hash lookup and a walk over at most MAX_LEVELS levels; an RFQ that
+* has already waited past the budget is rejected instead of quoted on a
+* stale price. The RFQ-to-response latency and the pricing time alone are
+* kept as histograms.
+*
+* 2 Listeners:
+* BondInquiryPriceListener - listen from BondPricingService
+* BondInquiryMarketDataListener - listen from BondMarketDataService
+*
+* @Yunze Sun
+*/
+
+#ifndef InquiryQuotingEngine_h
+#define InquiryQuotingEngine_h
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "inquiryservice.hpp"
+#include "pricingservice.hpp"
+#include "BondMarketDataService.hpp"
+#include "QuoteSkewEngine.hpp"
+#include "OrderEncoder.hpp"
+using namespace std;
+
+class InquiryQuotingEngine {
+public:
+    static const int MAX_LEVELS = 8;
+
+    // ctor, skew from the position and risk of the products (none if null), budget in ns from arrival to response
+    InquiryQuotingEngine(const vector<Bond>& _bonds, QuoteSkewEngine* _skew = nullptr, long long _budgetNanos = 100000);
+
+    void SetBudget(long long nanos) { budgetNanos = nanos; }
+    long long GetBudget() const { return budgetNanos; }
+    void SetMaxQuantity(long quantity) { maxQuantity = quantity; }
+    void SetDepthPenalty(double pointsPerMillion) { depthPenalty = pointsPerMillion; }
+
+    // called by the listeners
+    void UpdatePrice(const ProductId& productId, double mid, double spread);
+    void UpdateBook(const OrderBook<Bond>& book);
+
+    // quote for a client side and size now, false if the product has no mid yet or the size is over the limit
+    bool Price(const ProductId& productId, Side side, long quantity, double& price);
+
+    // queue an RFQ stamped with its arrival time, false if the product is unknown
+    bool Receive(const Inquiry<Bond>& inquiry);
+
+    // true once the oldest queued RFQ has used half the budget
+    bool IsDue() const { return head < pending.size() && NowNanos() - pending[head].receivedNanos >= budgetNanos / 2; }
+
+    // answer the queued RFQs in arrival order through respond(inquiryId, quoted, price), returns the number answered
+    template<typename F>
+    int Drain(F respond);
+
+    size_t GetPending() const { return pending.size() - head; }
+    long GetQuoted() const { return quoted; }
+    long GetRejected() const { return rejected; }
+    long GetExpired() const { return expired; }
+
+    // arrival to response, and the pricing alone
+    const EgressLatency& GetResponseLatency() const { return responseLatency; }
+    const EgressLatency& GetPricingLatency() const { return pricingLatency; }
+
+    void PrintLatency(ostream& out) const;
+
+private:
+    struct Level {
+        double price;
+        long quantity;
+    };
+
+    struct ProductQuote {
+        double mid;
+        double halfSpread;
+        bool priced; // a mid has been seen
+        int bids, offers;
+        Level bidLevels[MAX_LEVELS]; // best first
+        Level offerLevels[MAX_LEVELS];
+    };
+
+    struct PendingRfq {
+        InquiryId inquiryId;
+        int product;
+        Side side;
+        long quantity;
+        long long receivedNanos;
+    };
+
+    vector<Bond> bonds;
+    unordered_map<ProductId, int> productIndex;
+    vector<ProductQuote> quotes;
+    QuoteSkewEngine* skew;
+
+    vector<PendingRfq> pending;
+    size_t head; // first unanswered
+
+    long long budgetNanos;
+    long maxQuantity;
+    double depthPenalty;
+    long quoted, rejected, expired;
+    EgressLatency responseLatency, pricingLatency;
+
+    static long long NowNanos();
+    int GetProductIndex(const ProductId& productId) const;
+    bool Price(int p, Side side, long quantity, double& price);
+    // VWAP of the levels for quantity less the best level, in price points
+    double SizeCost(const Level* levels, int count, long quantity) const;
+};
+
+
+InquiryQuotingEngine::InquiryQuotingEngine(const vector<Bond>& _bonds, QuoteSkewEngine* _skew, long long _budgetNanos)
+    : bonds(_bonds), quotes(_bonds.size()), skew(_skew), head(0), budgetNanos(_budgetNanos), maxQuantity(50000000),
+    depthPenalty(1.0 / 128.0), quoted(0), rejected(0), expired(0)
+{
+    for (int i = 0; i < (int)bonds.size(); ++i) {
+        productIndex.insert(pair<ProductId, int>(bonds[i].GetProductId(), i));
+        quotes[i].mid = quotes[i].halfSpread = 0;
+        quotes[i].priced = false;
+        quotes[i].bids = quotes[i].offers = 0;
+    }
+}
+
+long long InquiryQuotingEngine::NowNanos() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int InquiryQuotingEngine::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+void InquiryQuotingEngine::UpdatePrice(const ProductId& productId, double mid, double spread) {
+    int p = GetProductIndex(productId);
+    if (p < 0) return;
+    quotes[p].mid = mid;
+    quotes[p].halfSpread = spread / 2.0;
+    quotes[p].priced = true;
+}
+
+void InquiryQuotingEngine::UpdateBook(const OrderBook<Bond>& book) {
+    int p = GetProductIndex(book.GetProduct().GetProductId());
+    if (p < 0) return;
+    // keep the best MAX_LEVELS of each side sorted, the RFQ only walks the copy
+    auto copy = [](const vector<Order>& stack, Level* levels, bool bid) {
+        int count = 0;
+        for (auto& order : stack) {
+            Level level{ order.GetPrice(), order.GetQuantity() };
+            int i = count < MAX_LEVELS ? count++ : MAX_LEVELS;
+            while (i > 0 && (bid ? levels[i - 1].price < level.price : levels[i - 1].price > level.price)) {
+                if (i < MAX_LEVELS) levels[i] = levels[i - 1];
+                --i;
+            }
+            if (i < MAX_LEVELS) levels[i] = level;
+        }
+        return count;
+    };
+    ProductQuote& quote = quotes[p];
+    quote.bids = copy(book.GetBidStack(), quote.bidLevels, true);
+    quote.offers = copy(book.GetOfferStack(), quote.offerLevels, false);
+}
+
+double InquiryQuotingEngine::SizeCost(const Level* levels, int count, long quantity) const {
+    if (count == 0) return depthPenalty * quantity / 1000000.0;
+    double best = levels[0].price;
+    double cost = 0;
+    long left = quantity;
+    for (int i = 0; i < count && left > 0; ++i) {
+        long take = min(left, levels[i].quantity);
+        cost += take * fabs(levels[i].price - best);
+        left -= take;
+    }
+    // past the book, the rest at the last level plus the penalty
+    if (left > 0) cost += left * (fabs(levels[count - 1].price - best) + depthPenalty * left / 1000000.0);
+    return cost / quantity;
+}
+
+bool InquiryQuotingEngine::Price(int p, Side side, long quantity, double& price) {
+    const ProductQuote& quote = quotes[p];
+    if (!quote.priced || quantity <= 0 || quantity > maxQuantity) return false;
+
+    const QuoteSkew* s = skew ? skew->GetSkew(bonds[p].GetProductId()) : nullptr;
+    double shift = s ? s->shift : 0.0;
+    double widen = s ? s->widen : 0.0;
+    if (side == BUY) {
+        // the client lifts our offer, covering means buying the offers
+        double offer = quote.mid + quote.halfSpread + SizeCost(quote.offerLevels, quote.offers, quantity) + shift + widen / 2.0;
+        price = ceil(offer * 256.0 - 1e-9) / 256.0;
+    }
+    else {
+        double bid = quote.mid - quote.halfSpread - SizeCost(quote.bidLevels, quote.bids, quantity) + shift - widen / 2.0;
+        price = floor(bid * 256.0 + 1e-9) / 256.0;
+    }
+    return true;
+}
+
+bool InquiryQuotingEngine::Price(const ProductId& productId, Side side, long quantity, double& price) {
+    int p = GetProductIndex(productId);
+    return p >= 0 && Price(p, side, quantity, price);
+}
+
+bool InquiryQuotingEngine::Receive(const Inquiry<Bond>& inquiry) {
+    int p = GetProductIndex(inquiry.GetProduct().GetProductId());
+    if (p < 0) return false;
+    if (head == pending.size()) {
+        pending.clear();
+        head = 0;
+    }
+    pending.push_back(PendingRfq{ inquiry.GetInquiryId(), p, inquiry.GetSide(), inquiry.GetQuantity(), NowNanos() });
+    return true;
+}
+
+template<typename F>
+int InquiryQuotingEngine::Drain(F respond) {
+    int answered = 0;
+    while (head < pending.size()) {
+        const PendingRfq& rfq = pending[head++];
+        long long start = NowNanos();
+        double price = 0;
+        bool ok = false;
+        if (start - rfq.receivedNanos > budgetNanos) ++expired;
+        else {
+            ok = Price(rfq.product, rfq.side, rfq.quantity, price);
+            pricingLatency.Record(NowNanos() - start);
+        }
+        if (ok) ++quoted;
+        else ++rejected;
+        respond(rfq.inquiryId, ok, price);
+        responseLatency.Record(NowNanos() - rfq.receivedNanos);
+        ++answered;
+    }
+    pending.clear();
+    head = 0;
+    return answered;
+}
+
+void InquiryQuotingEngine::PrintLatency(ostream& out) const {
+    out << "RFQ: " << quoted << " quoted, " << rejected << " rejected (" << expired << " past the " << budgetNanos / 1000 << " us budget)"
+        << "\tresponse p50 (ns) <= " << responseLatency.GetPercentile(50) << "\tp99 (ns) <= " << responseLatency.GetPercentile(99)
+        << "\tmax (ns): " << responseLatency.GetMax()
+        << "\tpricing avg (ns): " << pricingLatency.GetAverage() << "\tp99 (ns) <= " << pricingLatency.GetPercentile(99) << endl;
+}
+
+
+class BondInquiryPriceListener : public ServiceListener<Price<Bond> > {
+public:
+    // ctor
+    BondInquiryPriceListener(InquiryQuotingEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(Price<Bond>& data) override {
+        engine->UpdatePrice(data.GetProduct().GetProductId(), data.GetMid(), data.GetBidOfferSpread());
+    }
+
+    // no implementation
+    void ProcessRemove(Price<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Price<Bond>& data) override {}
+
+private:
+    InquiryQuotingEngine* engine;
+};
+
+
+class BondInquiryMarketDataListener : public ServiceListener<OrderBook<Bond> > {
+public:
+    // ctor
+    BondInquiryMarketDataListener(InquiryQuotingEngine* _engine, BondMarketDataService* _bmd_service)
+        : engine(_engine), bmd_service(_bmd_service) {};
+
+    // listeners only get the top of book, the full depth is read back from the service
+    void ProcessAdd(OrderBook<Bond>& data) override { engine->UpdateBook(bmd_service->GetData(data.GetProduct().GetProductId())); }
+
+    // no implementation
+    void ProcessRemove(OrderBook<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(OrderBook<Bond>& data) override {}
+
+private:
+    InquiryQuotingEngine* engine;
+    BondMarketDataService* bmd_service;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/**
+* KeyRateRisk.hpp
+* Definition of KeyRateRiskEngine class
+*
+* Key rate PV01 of every bond on the KEY_RATE_TENORS nodes. The PV01 of
+* each cashflow at the bond's live yield is split between the two nodes
+* around its tenor (linear weights, flat outside), so the key rates of a
+* bond add up to its PV01 per 100 face.
+*
+* The portfolio vector (dollar PV01 per node) is kept incrementally: a
+* position change takes the bond's old contribution out and puts the new
+* one in, eight lanes at a time. A bond's key rates are only re-derived
+* when its yield has moved. Refresh re-marks every held bond to the
+* current yields.
+*
+* 1 Listener: BondKeyRatePositionListener
+* listen from BondPositionService
+*
+* @Yunze Sun
+*/
+
+#ifndef KeyRateRisk_h
+#define KeyRateRisk_h
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "BondCashflows.hpp"
+#include "BondAnalytics.hpp"
+using namespace std;
+
+// one lane per key rate node, padded to a cache line
+struct alignas(64) KeyRateVector {
+    static const int LANES = 8;
+    double value[LANES];
+};
+
+class KeyRateRiskEngine {
+public:
+    // ctor, live yields from analytics (coupon yields when null)
+    KeyRateRiskEngine(const vector<Bond>& _bonds, BondAnalyticsEngine* _analytics,
+        const date& settlement = from_string(DEFAULT_SETTLEMENT_DATE));
+
+    // new aggregate position of a bond, the portfolio moves by the difference
+    void UpdatePosition(const ProductId& productId, long quantity);
+
+    // key rates of every held bond at the current yields, portfolio rebuilt
+    void Refresh();
+
+    // key rate PV01 per 100 face at the last evaluated yield
+    const KeyRateVector* GetBondKeyRates(const ProductId& productId);
+
+    // dollar PV01 of the book per node
+    const KeyRateVector& GetPortfolio() const { return portfolio; }
+    double GetPortfolioPV01() const;
+
+    int GetProductIndex(const ProductId& productId) const;
+    long GetUpdates() const { return updates; }
+
+private:
+    int numBonds;
+    vector<ProductId> productIds;
+    vector<double> coupons;
+    unordered_map<ProductId, int> productIndex;
+    BondAnalyticsEngine* analytics;
+
+    // flows of bond b are [flowStart[b], flowStart[b + 1])
+    vector<int> flowStart;
+    vector<double> periods, amounts, weights;
+    vector<int> nodes;
+
+    vector<KeyRateVector> keyRates; // per 100 face
+    vector<double> keyRateYield; // yield keyRates were evaluated at
+    vector<KeyRateVector> contributions; // quantity / 100 x key rates, in the portfolio
+    vector<long> positions;
+    KeyRateVector portfolio;
+    long updates;
+
+    // key rates of a bond at its current yield
+    void Evaluate(int b);
+};
+
+
+KeyRateRiskEngine::KeyRateRiskEngine(const vector<Bond>& _bonds, BondAnalyticsEngine* _analytics, const date& settlement)
+    : numBonds((int)_bonds.size()), analytics(_analytics), keyRates(_bonds.size()), keyRateYield(_bonds.size(), NAN), contributions(_bonds.size()),
+    positions(_bonds.size(), 0), updates(0)
+{
+    flowStart.push_back(0);
+    for (int b = 0; b < numBonds; ++b) {
+        const Bond& bond = _bonds[b];
+        productIds.push_back(bond.GetProductId());
+        coupons.push_back(bond.GetCoupon());
+        productIndex.insert(pair<ProductId, int>(bond.GetProductId(), b));
+
+        CashflowSchedule schedule = BuildCashflowSchedule(bond, settlement);
+        double first = FirstPeriod(schedule, bond);
+        for (size_t k = 0; k < schedule.times.size(); ++k) {
+            int node;
+            double weight;
+            KeyRateWeight(schedule.times[k], node, weight);
+            periods.push_back(first + k);
+            amounts.push_back(schedule.amounts[k]);
+            nodes.push_back(node);
+            weights.push_back(weight);
+        }
+        flowStart.push_back((int)periods.size());
+        for (int l = 0; l < KeyRateVector::LANES; ++l) contributions[b].value[l] = 0.0;
+        Evaluate(b);
+    }
+    for (int l = 0; l < KeyRateVector::LANES; ++l) portfolio.value[l] = 0.0;
+}
+
+int KeyRateRiskEngine::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+void KeyRateRiskEngine::Evaluate(int b) {
+    const BondRisk* risk = analytics ? analytics->GetRisk(productIds[b]) : nullptr;
+    double y = risk ? risk->yield : coupons[b];
+    if (y == keyRateYield[b]) return;
+    keyRateYield[b] = y;
+    double g = 1.0 + y / 2.0;
+    double d = 1.0 / g;
+    KeyRateVector& kr = keyRates[b];
+    for (int l = 0; l < KeyRateVector::LANES; ++l) kr.value[l] = 0.0;
+    if (flowStart[b] == flowStart[b + 1]) return;
+
+    // -dPV_k/dy * 0.0001 = n cf v / (2 g) * 0.0001
+    double v = pow(d, periods[flowStart[b]]);
+    for (int k = flowStart[b]; k < flowStart[b + 1]; ++k) {
+        double pv01 = periods[k] * amounts[k] * v / (2.0 * g) * 0.0001;
+        kr.value[nodes[k]] += (1.0 - weights[k]) * pv01;
+        kr.value[nodes[k] + 1] += weights[k] * pv01;
+        v *= d;
+    }
+}
+
+void KeyRateRiskEngine::UpdatePosition(const ProductId& productId, long quantity) {
+    int b = GetProductIndex(productId);
+    if (b < 0) return;
+    Evaluate(b);
+    positions[b] = quantity;
+
+    // swap the bond's contribution, fixed width so it compiles to vector ops
+    double scale = quantity / 100.0;
+    double* total = portfolio.value;
+    double* old = contributions[b].value;
+    const double* kr = keyRates[b].value;
+    for (int l = 0; l < KeyRateVector::LANES; ++l) {
+        double next = scale * kr[l];
+        total[l] += next - old[l];
+        old[l] = next;
+    }
+    ++updates;
+}
+
+void KeyRateRiskEngine::Refresh() {
+    for (int l = 0; l < KeyRateVector::LANES; ++l) portfolio.value[l] = 0.0;
+    for (int b = 0; b < numBonds; ++b) {
+        if (positions[b] == 0) continue;
+        Evaluate(b);
+        double scale = positions[b] / 100.0;
+        for (int l = 0; l < KeyRateVector::LANES; ++l) {
+            contributions[b].value[l] = scale * keyRates[b].value[l];
+            portfolio.value[l] += contributions[b].value[l];
+        }
+    }
+}
+
+const KeyRateVector* KeyRateRiskEngine::GetBondKeyRates(const ProductId& productId) {
+    int b = GetProductIndex(productId);
+    if (b < 0) return nullptr;
+    Evaluate(b);
+    return &keyRates[b];
+}
+
+double KeyRateRiskEngine::GetPortfolioPV01() const {
+    double total = 0;
+    for (int i = 0; i < KEY_RATES; ++i) total += portfolio.value[i];
+    return total;
+}
+
+
+class BondKeyRatePositionListener : public ServiceListener<Position<Bond> > {
+public:
+    // ctor
+    BondKeyRatePositionListener(KeyRateRiskEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(Position<Bond>& data) override { engine->UpdatePosition(data.GetProduct().GetProductId(), data.GetAggregatePosition()); }
+
+    // no implementation
+    void ProcessRemove(Position<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Position<Bond>& data) override {}
+
+private:
+    KeyRateRiskEngine* engine;
+};
+
+#endif
@@ -0,0 +1,361 @@
+/**
+* OrderEncoder.hpp
+* Binary order-entry encoding for BondExecutionServiceConnector
+*
+* BinaryOrderMessage - fixed-layout little-endian order message (SBE-style header)
+* OrderEncoder       - encodes an ExecutionOrder<Bond> into a preallocated buffer
+*
+* Sinks (OrderSink) the encoded bytes are written to:
+*   ShmRingOrderSink    - ring of message slots in a POSIX shared memory segment
+*   UnixSocketOrderSink - datagrams to a Unix domain socket
+*   FileOrderSink       - buffered append to a file
+*   DebugPrintOrderSink - decodes and prints the order, the old human-readable output
+*
+* EgressLatency measures encode + write time per order.
+*
+* @Yunze Sun
+*/
+
+#ifndef OrderEncoder_h
+#define OrderEncoder_h
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "executionservice.hpp"
+using namespace std;
+
+#pragma pack(push, 1)
+struct BinaryOrderMessage {
+    // header
+    unsigned short blockLength; // size of the body
+    unsigned short templateId;
+    unsigned short schemaId;
+    unsigned short version;
+    // body
+    unsigned long long sequence;
+    long long sendTime; // ns, steady clock
+    char orderId[16];
+    char parentOrderId[16];
+    char productId[12];
+    unsigned char side; // PricingSide
+    unsigned char orderType; // OrderType
+    unsigned char market; // Market
+    unsigned char isChildOrder;
+    long long price; // in 1/256 ticks
+    long long visibleQuantity;
+    long long hiddenQuantity;
+};
+#pragma pack(pop)
+
+static const unsigned short ORDER_TEMPLATE_ID = 1;
+static const unsigned short ORDER_SCHEMA_ID = 9815;
+static const unsigned short ORDER_SCHEMA_VERSION = 1;
+static const size_t ORDER_HEADER_LENGTH = 8;
+
+class OrderEncoder {
+public:
+    // ctor
+    OrderEncoder() : sequence(1) { memset(&message, 0, sizeof(message)); }
+
+    // encode into the internal buffer, valid until the next call
+    const BinaryOrderMessage& Encode(const ExecutionOrder<Bond>& order, Market market);
+
+    static size_t Length() { return sizeof(BinaryOrderMessage); }
+
+    // decode helpers
+    static double DecodePrice(const BinaryOrderMessage& message) { return message.price / 256.0; }
+    static string DecodeId(const char* id, size_t size) { return string(id, strnlen(id, size)); }
+
+private:
+    BinaryOrderMessage message;
+    unsigned long long sequence;
+
+    static void CopyId(char* target, size_t size, const string& id);
+};
+
+const BinaryOrderMessage& OrderEncoder::Encode(const ExecutionOrder<Bond>& order, Market market) {
+    message.blockLength = (unsigned short)(sizeof(BinaryOrderMessage) - ORDER_HEADER_LENGTH);
+    message.templateId = ORDER_TEMPLATE_ID;
+    message.schemaId = ORDER_SCHEMA_ID;
+    message.version = ORDER_SCHEMA_VERSION;
+    message.sequence = sequence++;
+    message.sendTime = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    CopyId(message.orderId, sizeof(message.orderId), order.GetOrderId());
+    CopyId(message.parentOrderId, sizeof(message.parentOrderId), order.GetParentOrderId());
+    CopyId(message.productId, sizeof(message.productId), order.GetProduct().GetProductId());
+    message.side = (unsigned char)order.GetSide();
+    message.orderType = (unsigned char)order.GetOrderType();
+    message.market = (unsigned char)market;
+    message.isChildOrder = order.IsChildOrder() ? 1 : 0;
+    message.price = llround(order.GetPrice() * 256.0);
+    message.visibleQuantity = order.GetVisibleQuantity();
+    message.hiddenQuantity = order.GetHiddenQuantity();
+    return message;
+}
+
+// fixed-width, zero padded, truncated if too long
+void OrderEncoder::CopyId(char* target, size_t size, const string& id) {
+    size_t n = min(size, id.size());
+    memcpy(target, id.data(), n);
+    memset(target + n, 0, size - n);
+}
+
+
+/**
+* Destination of the encoded order messages.
+*/
+class OrderSink {
+public:
+    virtual ~OrderSink() {}
+
+    // write one encoded message
+    virtual void Write(const char* data, size_t length) = 0;
+
+    // push out anything buffered
+    virtual void Flush() {}
+};
+
+/**
+* Ring of fixed-size slots in /dev/shm.
+* Layout: [write sequence (8 bytes)][slot count (8 bytes)][slots...]
+* Message with sequence s (from 1) goes to slot s % slots. Every slot is a
+* seqlock as in PriceStreamRing.hpp: its version is 2s-1 while the message
+* is being written and 2s once it is complete, so a reader that finds the
+* version changed after its copy knows the slot was overwritten under it.
+* The header sequence is the last complete message.
+*/
+struct ShmOrderSlot {
+    atomic<unsigned long long> version;
+    BinaryOrderMessage message;
+};
+
+class ShmRingOrderSink : public OrderSink {
+public:
+    // ctor, name like "/bond_orders"
+    ShmRingOrderSink(const string& _name, size_t _slots = 1 << 16);
+    ~ShmRingOrderSink();
+
+    void Write(const char* data, size_t length) override;
+
+    bool IsOpen() const { return base != nullptr; }
+
+    // remove the segment name, mapped readers keep working
+    void Unlink() { shm_unlink(name.c_str()); }
+
+private:
+    string name;
+    size_t slots;
+    size_t mapped;
+    char* base;
+    atomic<unsigned long long>* writeSequence;
+    ShmOrderSlot* ring;
+};
+
+ShmRingOrderSink::ShmRingOrderSink(const string& _name, size_t _slots)
+    : name(_name), slots(_slots > 0 ? _slots : 1), mapped(0), base(nullptr), writeSequence(nullptr), ring(nullptr)
+{
+    mapped = 16 + slots * sizeof(ShmOrderSlot);
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, mapped) == 0) {
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            base = (char*)p;
+            ring = (ShmOrderSlot*)(base + 16);
+            for (size_t i = 0; i < slots; ++i) new (&ring[i].version) atomic<unsigned long long>(0);
+            writeSequence = new (base) atomic<unsigned long long>(0);
+            *(unsigned long long*)(base + 8) = slots;
+        }
+    }
+    close(fd);
+}
+
+ShmRingOrderSink::~ShmRingOrderSink()
+{
+    if (base) munmap(base, mapped);
+}
+
+void ShmRingOrderSink::Write(const char* data, size_t length) {
+    if (!base) return;
+    unsigned long long s = writeSequence->load(memory_order_relaxed) + 1;
+    ShmOrderSlot& slot = ring[s % slots];
+
+    slot.version.store(2 * s - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot.message, data, min(length, sizeof(BinaryOrderMessage)));
+
+    slot.version.store(2 * s, memory_order_release);
+    writeSequence->store(s, memory_order_release);
+}
+
+/**
+* One datagram per message to a Unix domain socket.
+*/
+class UnixSocketOrderSink : public OrderSink {
+public:
+    // ctor, path of the receiving socket
+    UnixSocketOrderSink(const string& _path);
+    ~UnixSocketOrderSink() { if (fd >= 0) close(fd); }
+
+    void Write(const char* data, size_t length) override;
+
+private:
+    int fd;
+    sockaddr_un address;
+};
+
+UnixSocketOrderSink::UnixSocketOrderSink(const string& _path)
+{
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, _path.c_str(), sizeof(address.sun_path) - 1);
+}
+
+void UnixSocketOrderSink::Write(const char* data, size_t length) {
+    // nobody listening is not an error for the trading path
+    if (fd >= 0) sendto(fd, data, length, MSG_DONTWAIT, (sockaddr*)&address, sizeof(address));
+}
+
+/**
+* Append to a file through a preallocated buffer.
+*/
+class FileOrderSink : public OrderSink {
+public:
+    // ctor
+    FileOrderSink(const string& _path, size_t _bufferSize = 1 << 16);
+    ~FileOrderSink() { Flush(); if (fd >= 0) close(fd); delete[] buffer; }
+
+    void Write(const char* data, size_t length) override;
+    void Flush() override;
+
+private:
+    int fd;
+    char* buffer;
+    size_t bufferSize;
+    size_t used;
+};
+
+FileOrderSink::FileOrderSink(const string& _path, size_t _bufferSize) : bufferSize(_bufferSize), used(0)
+{
+    fd = open(_path.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644);
+    buffer = new char[bufferSize];
+}
+
+// a failing file does not stop the egress path, write errors are ignored
+void FileOrderSink::Write(const char* data, size_t length) {
+    if (used + length > bufferSize) Flush();
+    if (length > bufferSize) {
+        if (fd >= 0) (void)!write(fd, data, length);
+        return;
+    }
+    memcpy(buffer + used, data, length);
+    used += length;
+}
+
+void FileOrderSink::Flush() {
+    if (fd >= 0 && used > 0) (void)!write(fd, buffer, used);
+    used = 0;
+}
+
+/**
+* Human-readable output of the orders, for debugging only.
+*/
+class DebugPrintOrderSink : public OrderSink {
+public:
+    // ctor
+    DebugPrintOrderSink(ostream& _out = cout) : out(_out) {}
+
+    void Write(const char* data, size_t length) override;
+    void Flush() override { out.flush(); }
+
+private:
+    ostream& out;
+};
+
+void DebugPrintOrderSink::Write(const char* data, size_t length) {
+    if (length < sizeof(BinaryOrderMessage)) return;
+    const BinaryOrderMessage& message = *(const BinaryOrderMessage*)data;
+
+    string oder_type;
+    switch (message.orderType) {
+    case FOK: oder_type = "FOK"; break;
+    case MARKET: oder_type = "MARKET"; break;
+    case LIMIT: oder_type = "LIMIT"; break;
+    case STOP: oder_type = "STOP"; break;
+    case IOC: oder_type = "IOC"; break;
+    }
+    out << OrderEncoder::DecodeId(message.productId, sizeof(message.productId))
+        << " OrderId: " << OrderEncoder::DecodeId(message.orderId, sizeof(message.orderId)) << "\n"
+        << " OrderType: " << oder_type
+        << "\nPrice: " << OrderEncoder::DecodePrice(message) << "\tVisibleQuantity: " << message.visibleQuantity
+        << "\tHiddenQuantity: " << message.hiddenQuantity << "\n\n";
+}
+
+
+/**
+* Latency histogram of the order egress, log2 buckets of ns.
+*/
+class EgressLatency {
+public:
+    // ctor
+    EgressLatency() : count(0), total(0), maxLatency(0) { memset(buckets, 0, sizeof(buckets)); }
+
+    void Record(long long nanos);
+
+    long GetCount() const { return count; }
+    double GetAverage() const { return count ? (double)total / count : 0; }
+    long long GetMax() const { return maxLatency; }
+
+    // upper bound (ns) of the bucket holding the given percentile
+    long long GetPercentile(double percentile) const;
+
+    void Print(ostream& out) const;
+
+private:
+    static const int BUCKETS = 40;
+    long buckets[BUCKETS];
+    long count;
+    long long total;
+    long long maxLatency;
+};
+
+void EgressLatency::Record(long long nanos) {
+    if (nanos < 0) nanos = 0;
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (1LL << bucket) <= nanos) ++bucket;
+    ++buckets[bucket];
+    ++count;
+    total += nanos;
+    maxLatency = max(maxLatency, nanos);
+}
+
+long long EgressLatency::GetPercentile(double percentile) const {
+    long target = (long)ceil(count * percentile / 100.0);
+    long seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= target && seen > 0) return 1LL << bucket;
+    }
+    return maxLatency;
+}
+
+void EgressLatency::Print(ostream& out) const {
+    out << "Order egress: " << count << " orders"
+        << "\tavg (ns): " << GetAverage()
+        << "\tp50 (ns) <= " << GetPercentile(50)
+        << "\tp99 (ns) <= " << GetPercentile(99)
+        << "\tmax (ns): " << GetMax() << endl;
+}
+
+#endif
@@ -0,0 +1,208 @@
+/**
+* OrderStateStore.hpp
+* Definition of OrderStateStore class
+*
+* Lifecycle of the live execution orders, keyed on order id.
+* Fixed-capacity open-addressing table (linear probing, backward-shift
+* deletion) of flat records with the ids stored inline, so lookups are
+* O(1) and nothing is allocated after construction.
+*
+* Transitions:
+*   NEW / PARTIALLY_FILLED -> PARTIALLY_FILLED / FILLED / CANCELLED
+*   NEW                    -> REJECTED
+*   FILLED, CANCELLED and REJECTED are final
+*
+* @Yunze Sun
+*/
+
+#ifndef OrderStateStore_h
+#define OrderStateStore_h
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "executionservice.hpp"
+using namespace std;
+
+enum OrderStatus { ORDER_NEW, ORDER_PARTIALLY_FILLED, ORDER_FILLED, ORDER_CANCELLED, ORDER_REJECTED, ORDER_UNKNOWN };
+
+/**
+* Flat record of one order, 80 bytes.
+*/
+struct OrderRecord {
+    static const int ID_SIZE = 16;
+    static const int PRODUCT_SIZE = 12;
+
+    char orderId[ID_SIZE];
+    char productId[PRODUCT_SIZE];
+    unsigned int hash;
+    unsigned char idLength; // 0 marks an empty slot
+    OrderStatus status;
+    PricingSide side;
+    OrderType orderType;
+    Market market;
+    double price;
+    long quantity;
+    long filledQuantity;
+
+    long GetLeavesQuantity() const { return quantity - filledQuantity; }
+    string GetOrderId() const { return string(orderId, idLength); }
+    string GetProductId() const { return string(productId, strnlen(productId, PRODUCT_SIZE)); }
+    bool IsFinal() const { return status == ORDER_FILLED || status == ORDER_CANCELLED || status == ORDER_REJECTED; }
+};
+
+class OrderStateStore {
+public:
+    // ctor, capacity is rounded up to a power of two and kept at most 3/4 full
+    OrderStateStore(size_t _capacity = 1 << 16);
+
+    // add a new order, false if the id is too long, already present or the store is full
+    template<typename T>
+    bool Add(const ExecutionOrder<T>& order, Market market);
+
+    // lookup, null if unknown
+    const OrderRecord* Find(const string& orderId) const;
+
+    // apply a fill, returns the new status (ORDER_UNKNOWN if the order is not live)
+    OrderStatus ApplyFill(const string& orderId, long quantity);
+
+    // the rest of the order left the market
+    OrderStatus Cancel(const string& orderId);
+
+    // the venue refused the order
+    OrderStatus Reject(const string& orderId);
+
+    // drop an order, normally once it reached a final state
+    bool Erase(const string& orderId);
+
+    size_t Size() const { return size; }
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    vector<OrderRecord> slots;
+    size_t mask;
+    size_t size;
+    size_t maxSize;
+
+    static unsigned int Hash(const char* id, size_t length);
+    long Locate(const char* id, size_t length, unsigned int hash) const;
+    long Locate(const string& orderId) const;
+};
+
+
+OrderStateStore::OrderStateStore(size_t _capacity) : size(0)
+{
+    size_t capacity = 16;
+    while (capacity < _capacity) capacity <<= 1;
+    slots.assign(capacity, OrderRecord());
+    for (auto& slot : slots) slot.idLength = 0;
+    mask = capacity - 1;
+    maxSize = capacity / 4 * 3;
+}
+
+template<typename T>
+bool OrderStateStore::Add(const ExecutionOrder<T>& order, Market market) {
+    const OrderId& id = order.GetOrderId();
+    if (id.empty() || id.size() > OrderRecord::ID_SIZE || size >= maxSize) return false;
+
+    unsigned int hash = Hash(id.data(), id.size());
+    if (Locate(id.data(), id.size(), hash) >= 0) return false;
+
+    size_t i = hash & mask;
+    while (slots[i].idLength != 0) i = (i + 1) & mask;
+
+    OrderRecord& record = slots[i];
+    memset(record.orderId, 0, OrderRecord::ID_SIZE);
+    memcpy(record.orderId, id.data(), id.size());
+    const ProductId& productId = order.GetProduct().GetProductId();
+    memset(record.productId, 0, OrderRecord::PRODUCT_SIZE);
+    memcpy(record.productId, productId.data(), min(productId.size(), (size_t)OrderRecord::PRODUCT_SIZE));
+    record.hash = hash;
+    record.idLength = (unsigned char)id.size();
+    record.status = ORDER_NEW;
+    record.side = order.GetSide();
+    record.orderType = order.GetOrderType();
+    record.market = market;
+    record.price = order.GetPrice();
+    record.quantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+    record.filledQuantity = 0;
+    ++size;
+    return true;
+}
+
+const OrderRecord* OrderStateStore::Find(const string& orderId) const {
+    long i = Locate(orderId);
+    return i < 0 ? nullptr : &slots[i];
+}
+
+OrderStatus OrderStateStore::ApplyFill(const string& orderId, long quantity) {
+    long i = Locate(orderId);
+    if (i < 0 || slots[i].IsFinal()) return ORDER_UNKNOWN;
+
+    OrderRecord& record = slots[i];
+    record.filledQuantity = min(record.quantity, record.filledQuantity + quantity);
+    record.status = record.filledQuantity == record.quantity ? ORDER_FILLED : ORDER_PARTIALLY_FILLED;
+    return record.status;
+}
+
+OrderStatus OrderStateStore::Cancel(const string& orderId) {
+    long i = Locate(orderId);
+    if (i < 0 || slots[i].IsFinal()) return ORDER_UNKNOWN;
+    slots[i].status = ORDER_CANCELLED;
+    return ORDER_CANCELLED;
+}
+
+OrderStatus OrderStateStore::Reject(const string& orderId) {
+    long i = Locate(orderId);
+    if (i < 0 || slots[i].status != ORDER_NEW) return ORDER_UNKNOWN;
+    slots[i].status = ORDER_REJECTED;
+    return ORDER_REJECTED;
+}
+
+bool OrderStateStore::Erase(const string& orderId) {
+    long found = Locate(orderId);
+    if (found < 0) return false;
+
+    // backward-shift deletion keeps the probe chains intact without tombstones
+    size_t hole = (size_t)found;
+    size_t i = (hole + 1) & mask;
+    while (slots[i].idLength != 0) {
+        size_t home = slots[i].hash & mask;
+        // move the record back if the hole lies between its home slot and its slot
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    slots[hole].idLength = 0;
+    --size;
+    return true;
+}
+
+// FNV-1a
+unsigned int OrderStateStore::Hash(const char* id, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+long OrderStateStore::Locate(const char* id, size_t length, unsigned int hash) const {
+    size_t i = hash & mask;
+    while (slots[i].idLength != 0) {
+        const OrderRecord& record = slots[i];
+        if (record.hash == hash && record.idLength == length && memcmp(record.orderId, id, length) == 0) return (long)i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+long OrderStateStore::Locate(const string& orderId) const {
+    if (orderId.empty() || orderId.size() > OrderRecord::ID_SIZE) return -1;
+    return Locate(orderId.data(), orderId.size(), Hash(orderId.data(), orderId.size()));
+}
+
+#endif
@@ -0,0 +1,476 @@
+/**
+* PV01HedgingEngine.hpp
+* Definition of HedgeSolver and PV01HedgingEngine class
+*
+* Automatic key rate hedging of the book in the on-the-run benchmarks.
+* With K the key rate PV01 of one unit face of every benchmark (nodes x
+* benchmarks), R the residual key rate PV01 of the book and c the average
+* half bid/offer of every benchmark, the hedge h solves
+*
+*   min |R + K h|^2 + w sum (c_j h_j)^2
+*
+* i.e. (K'K + L) h = -K'R with L = diag(w c_j^2), a least squares fit of the
+* risk with a quadratic crossing cost. The benchmarks x benchmarks matrix is
+* Cholesky factored once and kept; a tick only does K'R and the two
+* triangular solves. It is refactored when a benchmark's key rates or cost
+* drift past a tolerance.
+*
+* Hedges are rounded to lots and sent as TWAP parent orders through
+* BondAlgoExecutionService behind a token bucket. The risk is checked every
+* interval off the timer; a position or price update hedges at once when a
+* node of the book has moved past the trigger since the last full hedge and
+* the bucket has a token. The unfilled part of the live hedges counts as
+* risk already hedged; hedges are cancelled after a timeout, their children
+* still in the market keep counting, and whatever filled shows up in the
+* positions. A hedge slice can fill while it is sent and come back through
+* the position listener; that update is left to the next check.
+*
+* 2 Listeners:
+* BondHedgingPositionListener - PV01HedgingEngine listen from BondPositionService
+* BondHedgingPriceListener - PV01HedgingEngine listen from BondPricingService
+*
+* @Yunze Sun
+*/
+
+#ifndef PV01HedgingEngine_h
+#define PV01HedgingEngine_h
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "BondCashflows.hpp"
+#include "KeyRateRisk.hpp"
+#include "BondAlgoExecutionService.hpp"
+#include "TimerWheel.hpp"
+using namespace std;
+
+// regularized least squares on up to LANES instruments, the factorization is kept between solves
+class HedgeSolver {
+public:
+    static const int LANES = KeyRateVector::LANES;
+
+    // ctor
+    HedgeSolver(int _instruments);
+
+    // key rate PV01 of one unit of instrument j, and its quadratic cost, drop the factorization
+    void SetExposure(int j, const double* keyRates);
+    void SetPenalty(int j, double penalty);
+    const double* GetExposure(int j) const { return exposure[j]; }
+    double GetPenalty(int j) const { return penalty[j]; }
+
+    // quantities minimizing |risk + K h|^2 + sum penalty_j h_j^2, false if the system is singular
+    bool Solve(const double* risk, double* hedge);
+
+    int Size() const { return instruments; }
+    bool IsFactored() const { return factored; }
+    long GetFactorizations() const { return factorizations; }
+    long GetSolves() const { return solves; }
+
+private:
+    int instruments;
+    double exposure[LANES][LANES]; // [instrument][node]
+    double penalty[LANES];
+    double chol[LANES][LANES]; // lower triangle of K'K + L
+    bool factored;
+    long factorizations, solves;
+
+    bool Factor();
+};
+
+
+HedgeSolver::HedgeSolver(int _instruments)
+    : instruments(min(_instruments, (int)LANES)), factored(false), factorizations(0), solves(0)
+{
+    for (int j = 0; j < LANES; ++j) {
+        penalty[j] = 0.0;
+        for (int i = 0; i < LANES; ++i) exposure[j][i] = 0.0;
+    }
+}
+
+void HedgeSolver::SetExposure(int j, const double* keyRates) {
+    for (int i = 0; i < KEY_RATES; ++i) exposure[j][i] = keyRates[i];
+    factored = false;
+}
+
+void HedgeSolver::SetPenalty(int j, double _penalty) {
+    penalty[j] = _penalty;
+    factored = false;
+}
+
+bool HedgeSolver::Factor() {
+    double a[LANES][LANES];
+    for (int j = 0; j < instruments; ++j) {
+        for (int k = 0; k <= j; ++k) {
+            double sum = 0;
+            for (int i = 0; i < KEY_RATES; ++i) sum += exposure[j][i] * exposure[k][i];
+            a[j][k] = sum;
+        }
+        a[j][j] += penalty[j];
+    }
+    for (int j = 0; j < instruments; ++j) {
+        double d = a[j][j];
+        for (int k = 0; k < j; ++k) d -= chol[j][k] * chol[j][k];
+        if (d <= 0.0) return false;
+        chol[j][j] = sqrt(d);
+        for (int r = j + 1; r < instruments; ++r) {
+            double s = a[r][j];
+            for (int k = 0; k < j; ++k) s -= chol[r][k] * chol[j][k];
+            chol[r][j] = s / chol[j][j];
+        }
+    }
+    ++factorizations;
+    factored = true;
+    return true;
+}
+
+bool HedgeSolver::Solve(const double* risk, double* hedge) {
+    if (!factored && !Factor()) return false;
+
+    // -K'R, then L y = -K'R and L' h = y
+    double y[LANES];
+    for (int j = 0; j < instruments; ++j) {
+        double g = 0;
+        for (int i = 0; i < KEY_RATES; ++i) g -= exposure[j][i] * risk[i];
+        for (int k = 0; k < j; ++k) g -= chol[j][k] * y[k];
+        y[j] = g / chol[j][j];
+    }
+    for (int j = instruments - 1; j >= 0; --j) {
+        double h = y[j];
+        for (int k = j + 1; k < instruments; ++k) h -= chol[k][j] * hedge[k];
+        hedge[j] = h / chol[j][j];
+    }
+    ++solves;
+    return true;
+}
+
+
+class PV01HedgingEngine {
+public:
+    // ctor, checks the risk every interval ms off the timer, on every change if null
+    PV01HedgingEngine(const vector<Bond>& _benchmarks, KeyRateRiskEngine* _risk, BondAlgoExecutionService* _algo,
+        TimerWheel* _timer = nullptr, long _interval = 50);
+
+    // weight of the crossing cost against the residual risk
+    void SetCostWeight(double weight);
+    // no hedge while every node of the residual is within threshold (dollar PV01)
+    void SetThreshold(double _threshold) { threshold = _threshold; }
+    // hedge from the listeners once a node of the book moved more than trigger (dollar PV01), 0 waits for the timer
+    void SetTrigger(double _trigger) { trigger = _trigger; }
+    void SetLotSize(long _lotSize) { lotSize = _lotSize; }
+    // hedge orders per second and burst
+    void SetRateLimit(double hedgesPerSecond, double _burst);
+    void SetSchedule(const AlgoSchedule& _schedule) { schedule = _schedule; }
+    // live hedges are cancelled after timeout ms
+    void SetTimeout(long _timeout) { timeout = _timeout; }
+    // relative drift of a benchmark's key rates or cost that forces a refactorization
+    void SetTolerance(double _tolerance) { tolerance = _tolerance; }
+
+    // called by the listeners
+    void OnRiskChange();
+    void UpdatePrice(const ProductId& productId, double mid, double spread);
+
+    // solve for the current residual and send the hedges, returns the number sent
+    int Hedge();
+
+    // book risk net of the live hedges
+    const KeyRateVector& GetResidual() const { return residual; }
+    double GetResidualPV01() const;
+
+    HedgeSolver& GetSolver() { return solver; }
+    long GetHedges() const { return hedges; }
+    long GetHedgedQuantity() const { return hedgedQuantity; }
+    long GetRateLimited() const { return rateLimited; }
+    long GetCancelled() const { return cancelled; }
+    long GetTriggered() const { return triggered; }
+
+private:
+    struct LiveHedge {
+        int benchmark;
+        OrderId parentOrderId;
+        long quantity; // signed face
+        long long sentNanos;
+    };
+
+    vector<Bond> benchmarks;
+    unordered_map<ProductId, int> benchmarkIndex;
+    KeyRateRiskEngine* risk;
+    BondAlgoExecutionService* algo;
+    HedgeSolver solver;
+
+    TimerWheel* timer;
+    vector<double> mids, spreads;
+    vector<double> costs; // average half spread, price per 100 face
+    vector<LiveHedge> live;
+    KeyRateVector residual;
+    KeyRateVector lastHedged; // book at the last hedge that was not rate limited
+    double costWeight, threshold, trigger, tolerance;
+    long lotSize, timeout;
+    AlgoSchedule schedule;
+    bool dirty;
+    bool hedging; // inside Hedge, the orders it sends can fill on the spot
+
+    // token bucket
+    double ratePerNano, burst, tokens;
+    long long lastRefill;
+
+    long hedges, hedgedQuantity, rateLimited, cancelled, triggered;
+
+    // on the timer's clock if there is one, so a replay on event time limits and times out on the data time
+    long long NowNanos() const;
+    static bool Drifted(double now, double then, double tolerance);
+
+    // a node of the book moved past the trigger since lastHedged and the bucket has a token
+    bool Triggered();
+
+    int SendHedges();
+
+    // refresh the solver inputs, it only refactors if something moved past the tolerance
+    void RefreshSolver();
+    // drop finished and expired hedges, signed unfilled face per benchmark
+    void Outstanding(double* quantities, long long now);
+};
+
+
+PV01HedgingEngine::PV01HedgingEngine(const vector<Bond>& _benchmarks, KeyRateRiskEngine* _risk, BondAlgoExecutionService* _algo,
+    TimerWheel* _timer, long _interval)
+    : benchmarks(_benchmarks), risk(_risk), algo(_algo), solver((int)_benchmarks.size()), timer(_timer),
+    mids(_benchmarks.size(), NAN), spreads(_benchmarks.size(), 1.0 / 128.0), costs(_benchmarks.size(), 1.0 / 256.0), costWeight(1.0), threshold(0.0), trigger(0.0), tolerance(0.005),
+    lotSize(1000000), timeout(5000), schedule(AlgoSchedule{ TWAP, 1000, 4, vector<double>(), 0 }), dirty(false), hedging(false),
+    ratePerNano(0), burst(0), tokens(0), lastRefill(0), hedges(0), hedgedQuantity(0), rateLimited(0), cancelled(0), triggered(0)
+{
+    if (benchmarks.size() > (size_t)HedgeSolver::LANES) benchmarks.resize(HedgeSolver::LANES);
+    for (int j = 0; j < (int)benchmarks.size(); ++j) {
+        benchmarkIndex.insert(pair<ProductId, int>(benchmarks[j].GetProductId(), j));
+    }
+    for (int l = 0; l < KeyRateVector::LANES; ++l) residual.value[l] = lastHedged.value[l] = 0.0;
+    RefreshSolver();
+    // re-hedge at most once per interval, whatever the position rate
+    if (timer) timer->SchedulePeriodic(_interval, [this]() { if (dirty) Hedge(); });
+}
+
+long long PV01HedgingEngine::NowNanos() const {
+    if (timer) return timer->Now() * 1000000LL;
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool PV01HedgingEngine::Drifted(double now, double then, double tolerance) {
+    return fabs(now - then) > tolerance * max(fabs(then), 1e-12);
+}
+
+void PV01HedgingEngine::SetCostWeight(double weight) {
+    costWeight = weight;
+    for (int j = 0; j < solver.Size(); ++j) {
+        double cost = costs[j] / 100.0;
+        solver.SetPenalty(j, costWeight * cost * cost);
+    }
+}
+
+void PV01HedgingEngine::SetRateLimit(double hedgesPerSecond, double _burst) {
+    ratePerNano = hedgesPerSecond / 1e9;
+    burst = _burst;
+    tokens = _burst;
+    lastRefill = NowNanos();
+}
+
+void PV01HedgingEngine::OnRiskChange() {
+    dirty = true;
+    if (!timer) Hedge();
+    else if (Triggered()) {
+        ++triggered;
+        Hedge();
+    }
+}
+
+bool PV01HedgingEngine::Triggered() {
+    if (trigger <= 0.0 || hedging) return false;
+    const KeyRateVector& book = risk->GetPortfolio();
+    bool moved = false;
+    for (int i = 0; i < KEY_RATES && !moved; ++i) moved = fabs(book.value[i] - lastHedged.value[i]) > trigger;
+    if (!moved || ratePerNano <= 0) return moved;
+    long long now = NowNanos();
+    return min(burst, tokens + (now - lastRefill) * ratePerNano) >= 1.0;
+}
+
+void PV01HedgingEngine::UpdatePrice(const ProductId& productId, double mid, double spread) {
+    auto it = benchmarkIndex.find(productId);
+    if (it == benchmarkIndex.end()) return;
+    int j = it->second;
+    mids[j] = mid;
+    spreads[j] = spread;
+    // the cost follows an average spread, a spread flickering between two ticks does not refactor
+    costs[j] += 0.05 * (spread / 2.0 - costs[j]);
+
+    // a hedge held back by the rate limit goes out on the first tick with a token
+    if (timer && dirty && Triggered()) {
+        ++triggered;
+        Hedge();
+    }
+}
+
+void PV01HedgingEngine::RefreshSolver() {
+    for (int j = 0; j < solver.Size(); ++j) {
+        const KeyRateVector* keyRates = risk->GetBondKeyRates(benchmarks[j].GetProductId());
+        if (!keyRates) continue;
+        const double* old = solver.GetExposure(j);
+        bool moved = !solver.IsFactored();
+        for (int i = 0; i < KEY_RATES && !moved; ++i) moved = Drifted(keyRates->value[i] / 100.0, old[i], tolerance);
+        if (moved) {
+            double unit[KeyRateVector::LANES];
+            for (int i = 0; i < KEY_RATES; ++i) unit[i] = keyRates->value[i] / 100.0;
+            solver.SetExposure(j, unit);
+        }
+        double cost = costs[j] / 100.0; // per unit face
+        double penalty = costWeight * cost * cost;
+        if (!solver.IsFactored() || Drifted(penalty, solver.GetPenalty(j), 0.25)) solver.SetPenalty(j, penalty);
+    }
+}
+
+void PV01HedgingEngine::Outstanding(double* quantities, long long now) {
+    for (int j = 0; j < solver.Size(); ++j) quantities[j] = 0.0;
+    AlgoExecutionEngine<Bond>* engine = algo->GetEngine();
+    size_t kept = 0;
+    for (size_t k = 0; k < live.size(); ++k) {
+        LiveHedge& hedge = live[k];
+        const ParentOrder<Bond>* parent = engine->FindParentOrder(hedge.parentOrderId);
+        if (parent && now - hedge.sentNanos > timeout * 1000000LL) {
+            if (algo->CancelParentOrder(hedge.parentOrderId)) ++cancelled;
+            parent = engine->FindParentOrder(hedge.parentOrderId);
+        }
+        // finished hedges are dropped by the engine once their children are gone
+        if (!parent) continue;
+        // a finished hedge still has its live children in the market
+        long unfilled = parent->GetState() == PARENT_WORKING ? parent->GetQuantity() - parent->GetFilledQuantity() : parent->GetWorkingQuantity();
+        if (unfilled <= 0) continue;
+        quantities[hedge.benchmark] += hedge.quantity > 0 ? unfilled : -unfilled;
+        live[kept++] = hedge;
+    }
+    live.resize(kept);
+}
+
+int PV01HedgingEngine::Hedge() {
+    if (hedging) {
+        dirty = true;
+        return 0;
+    }
+    hedging = true;
+    int sent = SendHedges();
+    hedging = false;
+    return sent;
+}
+
+int PV01HedgingEngine::SendHedges() {
+    dirty = false;
+    long long now = NowNanos();
+    RefreshSolver();
+
+    // residual = book + live hedges
+    double pending[HedgeSolver::LANES];
+    Outstanding(pending, now);
+    const KeyRateVector& book = risk->GetPortfolio();
+    KeyRateVector hedged = book;
+    double worst = 0;
+    for (int i = 0; i < KEY_RATES; ++i) {
+        double r = book.value[i];
+        for (int j = 0; j < solver.Size(); ++j) r += pending[j] * solver.GetExposure(j)[i];
+        residual.value[i] = r;
+        worst = max(worst, fabs(r));
+    }
+    if (worst <= threshold) {
+        lastHedged = hedged;
+        return 0;
+    }
+
+    double quantities[HedgeSolver::LANES];
+    if (!solver.Solve(residual.value, quantities)) {
+        lastHedged = hedged;
+        return 0;
+    }
+
+    // the book is hedged from here, unless the rate limit holds some of it back
+    KeyRateVector previous = lastHedged;
+    lastHedged = hedged;
+    int sent = 0;
+    for (int j = 0; j < solver.Size(); ++j) {
+        long quantity = (long)llround(quantities[j] / lotSize) * lotSize;
+        if (quantity == 0 || std::isnan(mids[j])) continue;
+        if (ratePerNano > 0) {
+            tokens = min(burst, tokens + (now - lastRefill) * ratePerNano);
+            lastRefill = now;
+            if (tokens < 1.0) {
+                // try again on the next check
+                ++rateLimited;
+                dirty = true;
+                lastHedged = previous;
+                break;
+            }
+            tokens -= 1.0;
+        }
+        // cross the spread, BID buys at the offer and OFFER sells at the bid
+        PricingSide side = quantity > 0 ? BID : OFFER;
+        double price = quantity > 0 ? mids[j] + spreads[j] / 2.0 : mids[j] - spreads[j] / 2.0;
+        // outstanding before it is sent, its first slice may fill inside AddParentOrder
+        size_t k = live.size();
+        live.push_back(LiveHedge{ j, OrderId(), quantity, now });
+        live[k].parentOrderId = algo->AddParentOrder(benchmarks[j], side, price, labs(quantity), schedule);
+        ++hedges;
+        hedgedQuantity += labs(quantity);
+        ++sent;
+    }
+    return sent;
+}
+
+double PV01HedgingEngine::GetResidualPV01() const {
+    double total = 0;
+    for (int i = 0; i < KEY_RATES; ++i) total += residual.value[i];
+    return total;
+}
+
+
+class BondHedgingPositionListener : public ServiceListener<Position<Bond> > {
+public:
+    // ctor, add after the key rate listener so the book risk is already updated
+    BondHedgingPositionListener(PV01HedgingEngine* _engine) : engine(_engine) {};
+
+    // hedges at once past the trigger, otherwise on the next timer check
+
+    void ProcessAdd(Position<Bond>& data) override { engine->OnRiskChange(); }
+
+    // no implementation
+    void ProcessRemove(Position<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Position<Bond>& data) override {}
+
+private:
+    PV01HedgingEngine* engine;
+};
+
+
+class BondHedgingPriceListener : public ServiceListener<Price<Bond> > {
+public:
+    // ctor
+    BondHedgingPriceListener(PV01HedgingEngine* _engine) : engine(_engine) {};
+
+    // spread for the crossing cost, retries a rate limited hedge
+
+    void ProcessAdd(Price<Bond>& data) override {
+        engine->UpdatePrice(data.GetProduct().GetProductId(), data.GetMid(), data.GetBidOfferSpread());
+    }
+
+    // no implementation
+    void ProcessRemove(Price<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Price<Bond>& data) override {}
+
+private:
+    PV01HedgingEngine* engine;
+};
+
+#endif
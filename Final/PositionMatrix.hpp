@@ -0,0 +1,245 @@
+/**
+* PositionMatrix.hpp
+* Definition of PositionMatrix class
+*
+* Firm-wide position store: a dense books x products matrix of int64
+* quantities. Books are the interned BookRegistry indices, products are
+* fixed at construction. Rows are padded to whole 64 byte lines of LANES
+* quantities so every roll-up walks contiguous memory in fixed-width
+* blocks the compiler turns into SIMD adds:
+*
+*   by book    - sum of a row
+*   by product - sum of the rows
+*   by sector  - product roll-up masked by the sector's products
+*   firm-wide  - sum of everything, and PV01 weighted versions of the above
+*
+* 1 Listener: BondPositionMatrixListener
+* listen from BondTradeBookingService
+*
+* @Yunze Sun
+*/
+
+#ifndef PositionMatrix_h
+#define PositionMatrix_h
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "soa.hpp"
+#include "products.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+using namespace std;
+
+class PositionMatrix {
+public:
+    static const int LANES = 8; // int64 per cache line
+
+    // ctor, room for bookCapacity books before the first growth
+    PositionMatrix(const vector<Bond>& _products, int bookCapacity = 16);
+
+    int GetProductIndex(const ProductId& productId) const;
+    const ProductId& GetProductId(int product) const { return productIds[product]; }
+    int GetProducts() const { return numProducts; }
+    int GetBooks() const { return numBooks; }
+
+    // change / read the quantity of a book on a product
+    void AddPosition(int book, int product, long long quantity);
+    void AddPosition(const string& book, const ProductId& productId, long long quantity);
+    long long GetPosition(int book, int product) const;
+
+    // a sector is a mask over the products, returns its index
+    int AddSector(const BucketedSector<Bond>& sector);
+    const string& GetSectorName(int sector) const { return sectorNames[sector]; }
+    int GetSectors() const { return (int)sectorNames.size(); }
+
+    // roll-ups over the whole matrix
+    long long RollupBook(int book) const;
+    void RollupBooks(vector<long long>& totals) const;
+    void RollupProducts(vector<long long>& totals) const;
+    void RollupSectors(vector<long long>& totals) const;
+    long long RollupFirm() const;
+
+    // PV01 weighted, pv01 per unit of quantity for every product index
+    void RollupBookRisk(const vector<double>& pv01, vector<double>& risks) const;
+    void RollupSectorRisk(const vector<double>& pv01, vector<double>& risks) const;
+    double RollupFirmRisk(const vector<double>& pv01) const;
+
+private:
+    int numProducts;
+    int stride; // numProducts rounded up to LANES
+    int numBooks;
+    vector<long long> quantities; // [book * stride + product]
+    vector<ProductId> productIds;
+    unordered_map<ProductId, int> productIndex;
+    vector<string> sectorNames;
+    vector<long long> sectorMasks; // [sector * stride + product], 0 or 1
+
+    void Grow(int book);
+};
+
+
+PositionMatrix::PositionMatrix(const vector<Bond>& _products, int bookCapacity)
+    : numProducts((int)_products.size()), numBooks(0)
+{
+    stride = (numProducts + LANES - 1) / LANES * LANES;
+    if (stride == 0) stride = LANES;
+    for (int i = 0; i < numProducts; ++i) {
+        productIds.push_back(_products[i].GetProductId());
+        productIndex.insert(pair<ProductId, int>(productIds.back(), i));
+    }
+    quantities.reserve((size_t)bookCapacity * stride);
+}
+
+int PositionMatrix::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+void PositionMatrix::Grow(int book) {
+    numBooks = book + 1;
+    quantities.resize((size_t)numBooks * stride, 0);
+}
+
+void PositionMatrix::AddPosition(int book, int product, long long quantity) {
+    if (book >= numBooks) Grow(book);
+    quantities[(size_t)book * stride + product] += quantity;
+}
+
+void PositionMatrix::AddPosition(const string& book, const ProductId& productId, long long quantity) {
+    int product = GetProductIndex(productId);
+    if (product >= 0) AddPosition(BookRegistry::GetIndex(book), product, quantity);
+}
+
+long long PositionMatrix::GetPosition(int book, int product) const {
+    return book < numBooks ? quantities[(size_t)book * stride + product] : 0;
+}
+
+int PositionMatrix::AddSector(const BucketedSector<Bond>& sector) {
+    sectorNames.push_back(sector.GetName());
+    sectorMasks.resize(sectorNames.size() * stride, 0);
+    long long* mask = &sectorMasks[(sectorNames.size() - 1) * stride];
+    for (auto& product : sector.GetProducts()) {
+        int p = GetProductIndex(product.GetProductId());
+        if (p >= 0) mask[p] = 1;
+    }
+    return (int)sectorNames.size() - 1;
+}
+
+long long PositionMatrix::RollupBook(int book) const {
+    if (book >= numBooks) return 0;
+    const long long* row = &quantities[(size_t)book * stride];
+    long long acc[LANES] = {};
+    for (int p = 0; p < stride; p += LANES) {
+        for (int l = 0; l < LANES; ++l) acc[l] += row[p + l];
+    }
+    long long total = 0;
+    for (int l = 0; l < LANES; ++l) total += acc[l];
+    return total;
+}
+
+void PositionMatrix::RollupBooks(vector<long long>& totals) const {
+    totals.assign(numBooks, 0);
+    for (int b = 0; b < numBooks; ++b) totals[b] = RollupBook(b);
+}
+
+void PositionMatrix::RollupProducts(vector<long long>& totals) const {
+    vector<long long> sums(stride, 0);
+    long long* s = sums.data();
+    for (int b = 0; b < numBooks; ++b) {
+        const long long* row = &quantities[(size_t)b * stride];
+        for (int p = 0; p < stride; p += LANES) {
+            for (int l = 0; l < LANES; ++l) s[p + l] += row[p + l];
+        }
+    }
+    totals.assign(sums.begin(), sums.begin() + numProducts);
+}
+
+void PositionMatrix::RollupSectors(vector<long long>& totals) const {
+    vector<long long> products;
+    RollupProducts(products);
+    products.resize(stride, 0);
+    totals.assign(sectorNames.size(), 0);
+    for (size_t k = 0; k < sectorNames.size(); ++k) {
+        const long long* mask = &sectorMasks[k * stride];
+        long long acc[LANES] = {};
+        for (int p = 0; p < stride; p += LANES) {
+            for (int l = 0; l < LANES; ++l) acc[l] += products[p + l] * mask[p + l];
+        }
+        for (int l = 0; l < LANES; ++l) totals[k] += acc[l];
+    }
+}
+
+long long PositionMatrix::RollupFirm() const {
+    long long acc[LANES] = {};
+    const long long* q = quantities.data();
+    size_t size = (size_t)numBooks * stride;
+    for (size_t i = 0; i < size; i += LANES) {
+        for (int l = 0; l < LANES; ++l) acc[l] += q[i + l];
+    }
+    long long total = 0;
+    for (int l = 0; l < LANES; ++l) total += acc[l];
+    return total;
+}
+
+void PositionMatrix::RollupBookRisk(const vector<double>& pv01, vector<double>& risks) const {
+    vector<double> weights(stride, 0.0);
+    for (int p = 0; p < numProducts && p < (int)pv01.size(); ++p) weights[p] = pv01[p];
+    risks.assign(numBooks, 0.0);
+    for (int b = 0; b < numBooks; ++b) {
+        const long long* row = &quantities[(size_t)b * stride];
+        double acc[LANES] = {};
+        for (int p = 0; p < stride; p += LANES) {
+            for (int l = 0; l < LANES; ++l) acc[l] += row[p + l] * weights[p + l];
+        }
+        for (int l = 0; l < LANES; ++l) risks[b] += acc[l];
+    }
+}
+
+void PositionMatrix::RollupSectorRisk(const vector<double>& pv01, vector<double>& risks) const {
+    vector<long long> products;
+    RollupProducts(products);
+    products.resize(stride, 0);
+    vector<double> weighted(stride, 0.0);
+    for (int p = 0; p < numProducts && p < (int)pv01.size(); ++p) weighted[p] = products[p] * pv01[p];
+    risks.assign(sectorNames.size(), 0.0);
+    for (size_t k = 0; k < sectorNames.size(); ++k) {
+        const long long* mask = &sectorMasks[k * stride];
+        double acc[LANES] = {};
+        for (int p = 0; p < stride; p += LANES) {
+            for (int l = 0; l < LANES; ++l) acc[l] += weighted[p + l] * mask[p + l];
+        }
+        for (int l = 0; l < LANES; ++l) risks[k] += acc[l];
+    }
+}
+
+double PositionMatrix::RollupFirmRisk(const vector<double>& pv01) const {
+    vector<long long> products;
+    RollupProducts(products);
+    double total = 0;
+    for (int p = 0; p < numProducts && p < (int)pv01.size(); ++p) total += products[p] * pv01[p];
+    return total;
+}
+
+
+class BondPositionMatrixListener : public ServiceListener<Trade<Bond> > {
+public:
+    // ctor
+    BondPositionMatrixListener(PositionMatrix* _matrix) : matrix(_matrix) {};
+
+    void ProcessAdd(Trade<Bond>& data) override {
+        long long quantity = data.GetSide() == BUY ? data.GetQuantity() : -data.GetQuantity();
+        matrix->AddPosition(data.GetBook(), data.GetProduct().GetProductId(), quantity);
+    }
+
+    // no implementation
+    void ProcessRemove(Trade<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Trade<Bond>& data) override {}
+
+private:
+    PositionMatrix* matrix;
+};
+
+#endif
@@ -0,0 +1,373 @@
+/**
+* PreTradeRiskGate.hpp
+* Definition of PreTradeRiskGate class
+*
+* Checks every order from BondAlgoExecutionService before it reaches
+* BondExecutionService:
+*   position limit per product, position limit per book and product,
+*   open notional limit per product, PV01 limit per product (dollars,
+*   PV01 from BondAnalyticsEngine), order rate per product
+*
+* Limits sit in dense tables indexed by product / book, positions are
+* atomic snapshots written by the position listener, so a check is a few
+* array reads and never waits on booking. Orders that passed stay working
+* until their last fill: their leaves count on top of the position in the
+* direction they trade, so a burst of children cannot each pass against
+* the same booked position.
+*
+* 3 Listeners:
+* BondPreTradeRiskListener - between BondAlgoExecutionService and BondExecutionService
+* BondRiskGatePositionListener - position snapshots from BondPositionService
+* BondRiskGateFillListener - releases working quantity on fills from BondExecutionService
+*
+* @Yunze Sun
+*/
+
+#ifndef PreTradeRiskGate_h
+#define PreTradeRiskGate_h
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "executionservice.hpp"
+#include "positionservice.hpp"
+#include "BondAlgoExecutionService.hpp"
+#include "BondAnalytics.hpp"
+#include "utility.h"
+using namespace std;
+
+enum RiskCheckResult { RISK_PASS, RISK_POSITION_LIMIT, RISK_BOOK_LIMIT, RISK_NOTIONAL_LIMIT, RISK_PV01_LIMIT, RISK_RATE_LIMIT, RISK_UNKNOWN_PRODUCT };
+
+class PreTradeRiskGate {
+public:
+    // ctor, the product and book universes are fixed for the life of the gate, PV01 from GetPV01Value without analytics
+    PreTradeRiskGate(const vector<Bond>& _products, const vector<string>& _books, BondAnalyticsEngine* _analytics = nullptr);
+
+    // limits, all unlimited by default
+    void SetProductLimits(const ProductId& productId, long maxPosition, double maxNotional, double maxPV01);
+    void SetBookLimit(const string& book, long maxPosition);
+    void SetRateLimit(double ordersPerSecond, double burst);
+
+    // position snapshot of a product in a book, called from the position path
+    void UpdatePosition(const ProductId& productId, const string& book, long position);
+
+    // check an order, updates the rate limiter and rejection counters, a passed order is working until done
+    RiskCheckResult Check(const ExecutionOrder<Bond>& order);
+    RiskCheckResult Check(int productIndex, PricingSide side, double price, long quantity, long long nowNanos);
+
+    // fill of a working order, the filled quantity moves to the position, all leaves go when done
+    void OnFill(const OrderId& orderId, long quantity, bool isDone);
+
+    // dense index of a product, -1 if unknown
+    int GetProductIndex(const ProductId& productId) const;
+
+    long GetChecked() const { return checked; }
+    long GetRejected() const { return rejected; }
+    size_t GetWorkingCount() const { return working.size(); }
+
+    // rejections by product and reason
+    void PrintRejectionReport(ostream& out) const;
+
+    static string ToString(RiskCheckResult result);
+
+private:
+    static const int REASONS = RISK_UNKNOWN_PRODUCT + 1;
+
+    struct ProductLimits {
+        long maxPosition;
+        double maxNotional;
+        double maxPV01;
+        double pv01; // per 100 face, from GetPV01Value when there is no analytics engine
+        // token bucket
+        double tokens;
+        long long lastRefill;
+    };
+
+    struct WorkingOrder {
+        int product;
+        PricingSide side;
+        double price;
+        long leaves;
+    };
+
+    // dollar PV01 of a position
+    double PV01(int i, long position);
+    void Release(WorkingOrder& order, long quantity);
+
+    vector<Bond> products;
+    vector<string> books;
+    BondAnalyticsEngine* analytics;
+    unordered_map<ProductId, int> productIndex;
+    unordered_map<string, int> bookIndex;
+    vector<ProductLimits> limits;
+    vector<long> bookLimits;
+    unique_ptr<atomic<long>[]> positions; // product x book
+    unique_ptr<atomic<long>[]> aggregates; // product
+    unordered_map<OrderId, WorkingOrder> working;
+    vector<long> workingBuy; // product
+    vector<long> workingSell; // product
+    vector<double> workingNotional; // product
+    double ratePerNano;
+    double burst;
+    long checked;
+    long rejected;
+    vector<long> rejections; // product x reason
+};
+
+
+PreTradeRiskGate::PreTradeRiskGate(const vector<Bond>& _products, const vector<string>& _books, BondAnalyticsEngine* _analytics)
+    : products(_products), books(_books), analytics(_analytics), ratePerNano(0), burst(0), checked(0), rejected(0)
+{
+    for (int i = 0; i < (int)products.size(); ++i) {
+        productIndex.insert(pair<ProductId, int>(products[i].GetProductId(), i));
+        ProductLimits l;
+        l.maxPosition = LONG_MAX;
+        l.maxNotional = INFINITY;
+        l.maxPV01 = INFINITY;
+        l.pv01 = GetPV01Value(products[i].GetProductId());
+        l.tokens = 0;
+        l.lastRefill = 0;
+        limits.push_back(l);
+    }
+    for (int b = 0; b < (int)books.size(); ++b) {
+        bookIndex.insert(pair<string, int>(books[b], b));
+    }
+    bookLimits.assign(books.size(), LONG_MAX);
+
+    size_t n = products.size() * books.size();
+    positions.reset(new atomic<long>[n]);
+    for (size_t i = 0; i < n; ++i) positions[i].store(0);
+    aggregates.reset(new atomic<long>[products.size()]);
+    for (size_t i = 0; i < products.size(); ++i) aggregates[i].store(0);
+    workingBuy.assign(products.size(), 0);
+    workingSell.assign(products.size(), 0);
+    workingNotional.assign(products.size(), 0);
+    rejections.assign(products.size() * REASONS, 0);
+}
+
+void PreTradeRiskGate::SetProductLimits(const ProductId& productId, long maxPosition, double maxNotional, double maxPV01) {
+    int i = GetProductIndex(productId);
+    if (i < 0) return;
+    limits[i].maxPosition = maxPosition;
+    limits[i].maxNotional = maxNotional;
+    limits[i].maxPV01 = maxPV01;
+}
+
+void PreTradeRiskGate::SetBookLimit(const string& book, long maxPosition) {
+    auto it = bookIndex.find(book);
+    if (it != bookIndex.end()) bookLimits[it->second] = maxPosition;
+}
+
+void PreTradeRiskGate::SetRateLimit(double ordersPerSecond, double _burst) {
+    ratePerNano = ordersPerSecond / 1e9;
+    burst = _burst;
+    for (auto& l : limits) {
+        l.tokens = burst;
+        l.lastRefill = 0;
+    }
+}
+
+void PreTradeRiskGate::UpdatePosition(const ProductId& productId, const string& book, long position) {
+    int i = GetProductIndex(productId);
+    auto it = bookIndex.find(book);
+    if (i < 0 || it == bookIndex.end()) return;
+
+    atomic<long>& slot = positions[i * books.size() + it->second];
+    long previous = slot.exchange(position, memory_order_relaxed);
+    aggregates[i].fetch_add(position - previous, memory_order_release);
+}
+
+RiskCheckResult PreTradeRiskGate::Check(const ExecutionOrder<Bond>& order) {
+    auto now = chrono::steady_clock::now().time_since_epoch();
+    int i = GetProductIndex(order.GetProduct().GetProductId());
+    long quantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+    RiskCheckResult result = Check(i, order.GetSide(), order.GetPrice(), quantity, chrono::duration_cast<chrono::nanoseconds>(now).count());
+    if (result != RISK_PASS) return result;
+
+    // in flight from here to its last fill
+    WorkingOrder w = { i, order.GetSide(), order.GetPrice(), quantity };
+    if (!working.insert(pair<OrderId, WorkingOrder>(order.GetOrderId(), w)).second) return result;
+    if (w.side == BID) workingBuy[i] += quantity;
+    else workingSell[i] += quantity;
+    workingNotional[i] += quantity * w.price / 100.0;
+    return result;
+}
+
+void PreTradeRiskGate::OnFill(const OrderId& orderId, long quantity, bool isDone) {
+    auto it = working.find(orderId);
+    if (it == working.end()) return;
+    WorkingOrder& w = it->second;
+    Release(w, isDone ? w.leaves : min(quantity, w.leaves));
+    if (isDone) working.erase(it);
+}
+
+void PreTradeRiskGate::Release(WorkingOrder& w, long quantity) {
+    if (w.side == BID) workingBuy[w.product] -= quantity;
+    else workingSell[w.product] -= quantity;
+    workingNotional[w.product] = max(0.0, workingNotional[w.product] - quantity * w.price / 100.0);
+    w.leaves -= quantity;
+}
+
+double PreTradeRiskGate::PV01(int i, long position) {
+    double pv01 = analytics ? analytics->GetPV01(products[i].GetProductId()) : limits[i].pv01;
+    return fabs(position * pv01 / 100.0);
+}
+
+RiskCheckResult PreTradeRiskGate::Check(int i, PricingSide side, double price, long quantity, long long nowNanos) {
+    ++checked;
+    RiskCheckResult result = RISK_PASS;
+
+    if (i < 0 || i >= (int)limits.size()) {
+        ++rejected;
+        return RISK_UNKNOWN_PRODUCT;
+    }
+    ProductLimits& l = limits[i];
+    // a BID order buys, on top of whatever is still working on the same side
+    long delta = (side == BID) ? workingBuy[i] + quantity : -(workingSell[i] + quantity);
+    long after = aggregates[i].load(memory_order_acquire) + delta;
+
+    if (labs(after) > l.maxPosition) {
+        result = RISK_POSITION_LIMIT;
+    }
+    else if (workingNotional[i] + quantity * price / 100.0 > l.maxNotional) {
+        result = RISK_NOTIONAL_LIMIT;
+    }
+    else if (PV01(i, after) > l.maxPV01) {
+        result = RISK_PV01_LIMIT;
+    }
+    else {
+        // the booking book is picked at fill time, so every book must be able to take the working orders
+        const atomic<long>* row = &positions[i * books.size()];
+        for (size_t b = 0; b < books.size(); ++b) {
+            if (labs(row[b].load(memory_order_relaxed) + delta) > bookLimits[b]) {
+                result = RISK_BOOK_LIMIT;
+                break;
+            }
+        }
+    }
+
+    if (result == RISK_PASS && ratePerNano > 0) {
+        l.tokens = min(burst, l.tokens + (nowNanos - l.lastRefill) * ratePerNano);
+        l.lastRefill = nowNanos;
+        if (l.tokens < 1.0) result = RISK_RATE_LIMIT;
+        else l.tokens -= 1.0;
+    }
+
+    if (result != RISK_PASS) {
+        ++rejected;
+        ++rejections[i * REASONS + result];
+    }
+    return result;
+}
+
+int PreTradeRiskGate::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+void PreTradeRiskGate::PrintRejectionReport(ostream& out) const {
+    out << "Pre-trade risk: " << checked << " orders checked, " << rejected << " rejected" << endl;
+    for (size_t i = 0; i < products.size(); ++i) {
+        for (int r = RISK_POSITION_LIMIT; r < REASONS; ++r) {
+            long n = rejections[i * REASONS + r];
+            if (n > 0) out << "\t" << products[i].GetProductId() << "\t" << ToString((RiskCheckResult)r) << "\t" << n << endl;
+        }
+    }
+}
+
+string PreTradeRiskGate::ToString(RiskCheckResult result) {
+    switch (result) {
+    case RISK_PASS: return "PASS";
+    case RISK_POSITION_LIMIT: return "POSITION_LIMIT";
+    case RISK_BOOK_LIMIT: return "BOOK_LIMIT";
+    case RISK_NOTIONAL_LIMIT: return "NOTIONAL_LIMIT";
+    case RISK_PV01_LIMIT: return "PV01_LIMIT";
+    case RISK_RATE_LIMIT: return "RATE_LIMIT";
+    case RISK_UNKNOWN_PRODUCT: return "UNKNOWN_PRODUCT";
+    default: return "";
+    }
+}
+
+
+class BondPreTradeRiskListener : public ServiceListener<AlgoExecution<Bond> > {
+public:
+    // ctor, passed orders go on to the downstream listener
+    BondPreTradeRiskListener(PreTradeRiskGate* _gate, ServiceListener<AlgoExecution<Bond> >* _downstream, BondAlgoExecutionService* _bae_service)
+        : gate(_gate), downstream(_downstream), bae_service(_bae_service) {};
+
+    // check the order, a rejected order is reported done so its parent or split is not left open
+    void ProcessAdd(AlgoExecution<Bond>& data) override {
+        const ExecutionOrder<Bond>& order = data.GetOrder();
+        if (gate->Check(order) == RISK_PASS) {
+            downstream->ProcessAdd(data);
+        }
+        else {
+            bae_service->OnChildDone(order.GetOrderId());
+        }
+    }
+
+    // no implementation
+    void ProcessRemove(AlgoExecution<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(AlgoExecution<Bond>& data) override {}
+
+private:
+    PreTradeRiskGate* gate;
+    ServiceListener<AlgoExecution<Bond> >* downstream;
+    BondAlgoExecutionService* bae_service;
+};
+
+
+class BondRiskGatePositionListener : public ServiceListener<Position<Bond> > {
+public:
+    // ctor
+    BondRiskGatePositionListener(PreTradeRiskGate* _gate, const vector<string>& _books) : gate(_gate), books(_books) {};
+
+    // refresh the snapshot of every book of the product
+    void ProcessAdd(Position<Bond>& data) override {
+        const ProductId& id = data.GetProduct().GetProductId();
+        for (auto& book : books) {
+            gate->UpdatePosition(id, book, data.GetPosition(book));
+        }
+    }
+
+    // no implementation
+    void ProcessRemove(Position<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Position<Bond>& data) override {}
+
+private:
+    PreTradeRiskGate* gate;
+    vector<string> books;
+};
+
+
+class BondRiskGateFillListener : public ServiceListener<ExecutionFill<Bond> > {
+public:
+    // ctor
+    BondRiskGateFillListener(PreTradeRiskGate* _gate) : gate(_gate) {};
+
+    // the filled quantity is booked by now, take it off the working orders
+    void ProcessAdd(ExecutionFill<Bond>& data) override {
+        gate->OnFill(data.GetOrderId(), data.GetQuantity(), data.IsDone());
+    }
+
+    // no implementation
+    void ProcessRemove(ExecutionFill<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(ExecutionFill<Bond>& data) override {}
+
+private:
+    PreTradeRiskGate* gate;
+};
+
+#endif
@@ -0,0 +1,232 @@
+/**
+* PriceStreamRing.hpp
+* Shared-memory fan-out of the PriceStream<Bond> quotes
+*
+* PriceStreamShmPublisher - single writer, owned by BondStreamingServiceConnector
+* PriceStreamShmReader    - reader library, any number of local processes
+*
+* Segment in /dev/shm:
+*   [PriceStreamRingHeader][PriceStreamSlot x slots]
+* Record with sequence s (from 1) goes to slot s % slots. Every slot is a
+* seqlock: its version is 2s-1 while the record is being written and 2s
+* once it is complete. A reader expecting s and finding a larger version
+* was lapped by the writer and skips ahead, counting the lost records.
+* Quotes are conflatable, so a lapped reader resumes at the newest record.
+* The writer never waits for readers.
+*
+* @Yunze Sun
+*/
+
+#ifndef PriceStreamRing_h
+#define PriceStreamRing_h
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "streamingservice.hpp"
+using namespace std;
+
+static const unsigned long long PRICE_STREAM_RING_MAGIC = 0x3135383950525354ULL;
+
+#pragma pack(push, 1)
+struct PriceStreamRecord {
+    unsigned long long sequence;
+    long long publishTime; // ns, steady clock
+    char productId[12];
+    double bidPrice;
+    long long bidVisible;
+    long long bidHidden;
+    double offerPrice;
+    long long offerVisible;
+    long long offerHidden;
+    // client tiers, only the first tierCount entries are valid
+    unsigned char tierCount;
+    double tierBidPrice[MAX_QUOTE_TIERS];
+    double tierOfferPrice[MAX_QUOTE_TIERS];
+    long long tierBidQuantity[MAX_QUOTE_TIERS];
+    long long tierOfferQuantity[MAX_QUOTE_TIERS];
+};
+#pragma pack(pop)
+
+struct PriceStreamRingHeader {
+    unsigned long long magic;
+    unsigned long long slots;
+    alignas(64) atomic<unsigned long long> writeSequence; // last complete record
+};
+
+struct alignas(64) PriceStreamSlot {
+    atomic<unsigned long long> version;
+    PriceStreamRecord record;
+};
+
+class PriceStreamShmPublisher {
+public:
+    // ctor, name like "/bond_price_stream", slots rounded up to a power of two
+    PriceStreamShmPublisher(const string& _name, size_t _slots = 1 << 14);
+    ~PriceStreamShmPublisher() { if (header) munmap(header, mapped); }
+
+    void Publish(const PriceStream<Bond>& stream);
+
+    bool IsOpen() const { return header != nullptr; }
+    unsigned long long GetSequence() const { return sequence; }
+
+    // remove the segment name, mapped readers keep working
+    void Unlink() { shm_unlink(name.c_str()); }
+
+private:
+    string name;
+    size_t mapped;
+    PriceStreamRingHeader* header;
+    PriceStreamSlot* slots;
+    size_t mask;
+    unsigned long long sequence;
+};
+
+
+PriceStreamShmPublisher::PriceStreamShmPublisher(const string& _name, size_t _slots)
+    : name(_name), mapped(0), header(nullptr), slots(nullptr), mask(0), sequence(0)
+{
+    size_t count = 2;
+    while (count < _slots) count <<= 1;
+    mapped = sizeof(PriceStreamRingHeader) + count * sizeof(PriceStreamSlot);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, mapped) == 0) {
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            header = (PriceStreamRingHeader*)p;
+            slots = (PriceStreamSlot*)((char*)p + sizeof(PriceStreamRingHeader));
+            for (size_t i = 0; i < count; ++i) new (&slots[i].version) atomic<unsigned long long>(0);
+            new (&header->writeSequence) atomic<unsigned long long>(0);
+            header->slots = count;
+            header->magic = PRICE_STREAM_RING_MAGIC;
+            mask = count - 1;
+        }
+    }
+    close(fd);
+}
+
+void PriceStreamShmPublisher::Publish(const PriceStream<Bond>& stream) {
+    if (!header) return;
+    unsigned long long s = ++sequence;
+    PriceStreamSlot& slot = slots[s & mask];
+
+    slot.version.store(2 * s - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    PriceStreamRecord& record = slot.record;
+    const ProductId& id = stream.GetProduct().GetProductId();
+    const PriceStreamOrder& bid = stream.GetBidOrder();
+    const PriceStreamOrder& offer = stream.GetOfferOrder();
+    record.sequence = s;
+    record.publishTime = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    memset(record.productId, 0, sizeof(record.productId));
+    memcpy(record.productId, id.data(), min(id.size(), sizeof(record.productId)));
+    record.bidPrice = bid.GetPrice();
+    record.bidVisible = bid.GetVisibleQuantity();
+    record.bidHidden = bid.GetHiddenQuantity();
+    record.offerPrice = offer.GetPrice();
+    record.offerVisible = offer.GetVisibleQuantity();
+    record.offerHidden = offer.GetHiddenQuantity();
+    const QuoteTiers& tiers = stream.GetTiers();
+    record.tierCount = (unsigned char)tiers.count;
+    for (int i = 0; i < tiers.count; ++i) {
+        record.tierBidPrice[i] = tiers.bidPrice[i];
+        record.tierOfferPrice[i] = tiers.offerPrice[i];
+        record.tierBidQuantity[i] = tiers.bidQuantity[i];
+        record.tierOfferQuantity[i] = tiers.offerQuantity[i];
+    }
+
+    slot.version.store(2 * s, memory_order_release);
+    header->writeSequence.store(s, memory_order_release);
+}
+
+
+class PriceStreamShmReader {
+public:
+    // ctor, a reader joining late starts at the newest record unless fromStart is set
+    PriceStreamShmReader(const string& _name, bool fromStart = false);
+    ~PriceStreamShmReader() { if (header) munmap((void*)header, mapped); }
+
+    // next record, false if the writer has not published it yet
+    bool Read(PriceStreamRecord& record);
+
+    bool IsOpen() const { return header != nullptr; }
+    unsigned long long GetLost() const { return lost; }
+    unsigned long long GetNextSequence() const { return next; }
+
+private:
+    size_t mapped;
+    const PriceStreamRingHeader* header;
+    const PriceStreamSlot* slots;
+    unsigned long long count;
+    unsigned long long next;
+    unsigned long long lost;
+};
+
+
+PriceStreamShmReader::PriceStreamShmReader(const string& _name, bool fromStart)
+    : mapped(0), header(nullptr), slots(nullptr), count(0), next(1), lost(0)
+{
+    int fd = shm_open(_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PriceStreamRingHeader)) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            const PriceStreamRingHeader* h = (const PriceStreamRingHeader*)p;
+            if (h->magic == PRICE_STREAM_RING_MAGIC && sizeof(PriceStreamRingHeader) + h->slots * sizeof(PriceStreamSlot) <= (size_t)st.st_size) {
+                mapped = st.st_size;
+                header = h;
+                slots = (const PriceStreamSlot*)((const char*)p + sizeof(PriceStreamRingHeader));
+                count = h->slots;
+                if (!fromStart) next = h->writeSequence.load(memory_order_acquire) + 1;
+            }
+            else {
+                munmap(p, st.st_size);
+            }
+        }
+    }
+    close(fd);
+}
+
+bool PriceStreamShmReader::Read(PriceStreamRecord& record) {
+    if (!header) return false;
+    while (true) {
+        unsigned long long written = header->writeSequence.load(memory_order_acquire);
+        if (next > written) return false;
+
+        // lapped, resume at the newest record
+        if (written - next >= count) {
+            lost += written - next;
+            next = written;
+        }
+
+        const PriceStreamSlot& slot = slots[next & (count - 1)];
+        unsigned long long before = slot.version.load(memory_order_acquire);
+        if (before == 2 * next) {
+            memcpy(&record, &slot.record, sizeof(PriceStreamRecord));
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.version.load(memory_order_relaxed) == before) {
+                ++next;
+                return true;
+            }
+        }
+        else if (before < 2 * next) {
+            // not complete yet
+            return false;
+        }
+        // overwritten while we looked
+        ++lost;
+        ++next;
+    }
+}
+
+#endif
@@ -19,12 +19,16 @@ class ProductService : public Service<string, T>
 
 public:
     // ctor
-    ProductService() { products = map<string, T>(); };
+    ProductService() { products = map<ProductId, T>(); };
     ProductService(const vector<T> &_products){
         for (const auto& product : _products)
-            products.insert(pair<string, T>(product.GetProductId(), product));
+            products.insert(pair<ProductId, T>(product.GetProductId(), product));
+        productList = _products;
     };
 
+    // all products in load order, analytics precompute their schedules from it
+    const vector<T>& GetProducts() const { return productList; }
+
     // Implement all the virtual functions
     T& GetData(string key) override { return products.at(key); };
 
@@ -34,7 +38,8 @@ public:
     const vector< ServiceListener<T>* >& GetListeners() const override { return vector< ServiceListener<T>* >(); };
 
 private:
-    map<string, T> products;
+    map<ProductId, T> products;
+    vector<T> productList;
 
 };
 
@@ -0,0 +1,240 @@
+/**
+* QuoteDeltaEncoder.hpp
+* Definition of QuoteDeltaEncoder class
+*
+* Change detection and delta encoding of the two-way quotes of BondStreamingService.
+* The last published quote of every product is kept; a new quote equal to it
+* is suppressed, otherwise only the changed fields are encoded:
+*
+*   [QuoteDeltaHeader][one 8-byte value per bit set in fieldMask, in field order]
+*                     [one 8-byte value per bit set in tierMask, in tier order]
+*
+* Prices are doubles, quantities int64. Tier 0 of a multi-tier quote is the
+* bid/offer, the tiers above it take four bits each in tierMask (bid price,
+* offer price, bid size, offer size), so a move of any tier is a change. A
+* change of the tier count sends every tier. The first quote of a product
+* carries every field. Sequence numbers run across all products so a reader
+* can detect a gap and ask for a full refresh.
+*
+* @Yunze Sun
+*/
+
+#ifndef QuoteDeltaEncoder_h
+#define QuoteDeltaEncoder_h
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "streamingservice.hpp"
+using namespace std;
+
+enum QuoteField { BID_PRICE = 1, BID_VISIBLE = 2, BID_HIDDEN = 4, OFFER_PRICE = 8, OFFER_VISIBLE = 16, OFFER_HIDDEN = 32 };
+enum TierField { TIER_BID_PRICE = 0, TIER_OFFER_PRICE = 1, TIER_BID_QUANTITY = 2, TIER_OFFER_QUANTITY = 3 };
+
+static const int QUOTE_FIELDS = 6;
+static const unsigned char ALL_QUOTE_FIELDS = 63;
+static const int TIER_FIELDS = 4;
+
+#pragma pack(push, 1)
+struct QuoteDeltaHeader {
+    unsigned long long sequence;
+    char productId[12];
+    unsigned char fieldMask;
+    unsigned char fieldCount; // bits set in fieldMask and tierMask
+    unsigned char tierCount;
+    unsigned int tierMask; // bit (tier - 1) * TIER_FIELDS + TierField
+};
+#pragma pack(pop)
+
+// flat two-way quote with its tiers, the state a delta applies to
+struct QuoteState {
+    double bidPrice;
+    long long bidVisible;
+    long long bidHidden;
+    double offerPrice;
+    long long offerVisible;
+    long long offerHidden;
+    // tiers above tier 0, tier t at index t, tier 0 is the fields above
+    int tierCount;
+    double tierBidPrice[MAX_QUOTE_TIERS];
+    double tierOfferPrice[MAX_QUOTE_TIERS];
+    long long tierBidQuantity[MAX_QUOTE_TIERS];
+    long long tierOfferQuantity[MAX_QUOTE_TIERS];
+};
+
+class QuoteDeltaEncoder {
+public:
+    static const size_t MAX_MESSAGE = sizeof(QuoteDeltaHeader) + (QUOTE_FIELDS + (MAX_QUOTE_TIERS - 1) * TIER_FIELDS) * 8;
+
+    // ctor
+    QuoteDeltaEncoder() : sequence(1), published(0), suppressed(0), bytes(0) {}
+
+    // encode the changes against the last quote of the product, 0 if nothing changed
+    size_t Encode(const PriceStream<Bond>& stream);
+
+    // the last encoded message, valid until the next Encode
+    const char* Data() const { return buffer; }
+
+    // apply a message onto the reader's state of the product, false if malformed
+    static bool Decode(const char* data, size_t length, QuoteState& state, QuoteDeltaHeader& header);
+
+    long GetPublished() const { return published; }
+    long GetSuppressed() const { return suppressed; }
+    double GetSuppressionRatio() const { return published + suppressed ? (double)suppressed / (published + suppressed) : 0; }
+
+    // delta bytes sent, header included
+    long long GetBytes() const { return bytes; }
+    double GetAverageBytes() const { return published ? (double)bytes / published : 0; }
+
+private:
+    // address of a tier field in a quote
+    static char* TierSlot(QuoteState& state, int tier, int field);
+
+    unordered_map<ProductId, int> productIndex;
+    vector<QuoteState> last;
+    char buffer[MAX_MESSAGE];
+    unsigned long long sequence;
+    long published;
+    long suppressed;
+    long long bytes;
+};
+
+
+char* QuoteDeltaEncoder::TierSlot(QuoteState& state, int tier, int field) {
+    switch (field) {
+    case TIER_BID_PRICE: return (char*)&state.tierBidPrice[tier];
+    case TIER_OFFER_PRICE: return (char*)&state.tierOfferPrice[tier];
+    case TIER_BID_QUANTITY: return (char*)&state.tierBidQuantity[tier];
+    default: return (char*)&state.tierOfferQuantity[tier];
+    }
+}
+
+size_t QuoteDeltaEncoder::Encode(const PriceStream<Bond>& stream) {
+    const PriceStreamOrder& bid = stream.GetBidOrder();
+    const PriceStreamOrder& offer = stream.GetOfferOrder();
+    const QuoteTiers& tiers = stream.GetTiers();
+    QuoteState quote;
+    memset(&quote, 0, sizeof(quote));
+    quote.bidPrice = bid.GetPrice();
+    quote.bidVisible = bid.GetVisibleQuantity();
+    quote.bidHidden = bid.GetHiddenQuantity();
+    quote.offerPrice = offer.GetPrice();
+    quote.offerVisible = offer.GetVisibleQuantity();
+    quote.offerHidden = offer.GetHiddenQuantity();
+    quote.tierCount = min(tiers.count, MAX_QUOTE_TIERS);
+    for (int t = 1; t < quote.tierCount; ++t) {
+        quote.tierBidPrice[t] = tiers.bidPrice[t];
+        quote.tierOfferPrice[t] = tiers.offerPrice[t];
+        quote.tierBidQuantity[t] = tiers.bidQuantity[t];
+        quote.tierOfferQuantity[t] = tiers.offerQuantity[t];
+    }
+
+    const ProductId& id = stream.GetProduct().GetProductId();
+    unsigned char mask = 0;
+    unsigned int tierMask = 0;
+    auto it = productIndex.find(id);
+    if (it == productIndex.end() || last[it->second].tierCount != quote.tierCount) {
+        if (it == productIndex.end()) {
+            productIndex.insert(pair<ProductId, int>(id, (int)last.size()));
+            last.push_back(quote);
+        }
+        else last[it->second] = quote;
+        mask = ALL_QUOTE_FIELDS;
+        for (int t = 1; t < quote.tierCount; ++t) tierMask |= 15u << ((t - 1) * TIER_FIELDS);
+    }
+    else {
+        QuoteState& previous = last[it->second];
+        if (quote.bidPrice != previous.bidPrice) mask |= BID_PRICE;
+        if (quote.bidVisible != previous.bidVisible) mask |= BID_VISIBLE;
+        if (quote.bidHidden != previous.bidHidden) mask |= BID_HIDDEN;
+        if (quote.offerPrice != previous.offerPrice) mask |= OFFER_PRICE;
+        if (quote.offerVisible != previous.offerVisible) mask |= OFFER_VISIBLE;
+        if (quote.offerHidden != previous.offerHidden) mask |= OFFER_HIDDEN;
+        for (int t = 1; t < quote.tierCount; ++t) {
+            unsigned int bits = 0;
+            if (quote.tierBidPrice[t] != previous.tierBidPrice[t]) bits |= 1u << TIER_BID_PRICE;
+            if (quote.tierOfferPrice[t] != previous.tierOfferPrice[t]) bits |= 1u << TIER_OFFER_PRICE;
+            if (quote.tierBidQuantity[t] != previous.tierBidQuantity[t]) bits |= 1u << TIER_BID_QUANTITY;
+            if (quote.tierOfferQuantity[t] != previous.tierOfferQuantity[t]) bits |= 1u << TIER_OFFER_QUANTITY;
+            tierMask |= bits << ((t - 1) * TIER_FIELDS);
+        }
+        if (mask == 0 && tierMask == 0) {
+            ++suppressed;
+            return 0;
+        }
+        previous = quote;
+    }
+
+    QuoteDeltaHeader& header = *(QuoteDeltaHeader*)buffer;
+    header.sequence = sequence++;
+    memset(header.productId, 0, sizeof(header.productId));
+    memcpy(header.productId, id.data(), min(id.size(), sizeof(header.productId)));
+    header.fieldMask = mask;
+    header.tierCount = (unsigned char)quote.tierCount;
+    header.tierMask = tierMask;
+
+    // the top of QuoteState is six 8-byte fields in QuoteField order
+    const char* fields = (const char*)&quote;
+    char* out = buffer + sizeof(QuoteDeltaHeader);
+    unsigned char count = 0;
+    for (int f = 0; f < QUOTE_FIELDS; ++f) {
+        if (mask & (1 << f)) {
+            memcpy(out, fields + f * 8, 8);
+            out += 8;
+            ++count;
+        }
+    }
+    for (int t = 1; t < quote.tierCount; ++t) {
+        for (int f = 0; f < TIER_FIELDS; ++f) {
+            if (tierMask & (1u << ((t - 1) * TIER_FIELDS + f))) {
+                memcpy(out, TierSlot(quote, t, f), 8);
+                out += 8;
+                ++count;
+            }
+        }
+    }
+    header.fieldCount = count;
+
+    size_t length = out - buffer;
+    ++published;
+    bytes += length;
+    return length;
+}
+
+bool QuoteDeltaEncoder::Decode(const char* data, size_t length, QuoteState& state, QuoteDeltaHeader& header) {
+    if (length < sizeof(QuoteDeltaHeader)) return false;
+    memcpy(&header, data, sizeof(QuoteDeltaHeader));
+    if (header.tierCount > MAX_QUOTE_TIERS) return false;
+    int tierBits = header.tierCount > 1 ? (header.tierCount - 1) * TIER_FIELDS : 0;
+    if (tierBits < 32 && (header.tierMask >> tierBits) != 0) return false;
+    int count = 0;
+    for (int f = 0; f < QUOTE_FIELDS; ++f) {
+        if (header.fieldMask & (1 << f)) ++count;
+    }
+    for (int b = 0; b < tierBits; ++b) {
+        if (header.tierMask & (1u << b)) ++count;
+    }
+    if (count != header.fieldCount || length != sizeof(QuoteDeltaHeader) + count * 8) return false;
+
+    char* fields = (char*)&state;
+    const char* in = data + sizeof(QuoteDeltaHeader);
+    for (int f = 0; f < QUOTE_FIELDS; ++f) {
+        if (header.fieldMask & (1 << f)) {
+            memcpy(fields + f * 8, in, 8);
+            in += 8;
+        }
+    }
+    state.tierCount = header.tierCount;
+    for (int t = 1; t < header.tierCount; ++t) {
+        for (int f = 0; f < TIER_FIELDS; ++f) {
+            if (header.tierMask & (1u << ((t - 1) * TIER_FIELDS + f))) {
+                memcpy(TierSlot(state, t, f), in, 8);
+                in += 8;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
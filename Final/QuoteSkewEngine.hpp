@@ -0,0 +1,224 @@
+/**
+* QuoteSkewEngine.hpp
+* Definition of QuoteSkewEngine class
+*
+* Skews the streamed quotes of BondAlgoStreamingService by position and risk:
+*   shift  = -positionSkew * position (in MM), both sides move to work the position off
+*   widen  = riskWiden * |PV01 risk|, split over both sides
+*   sizes  = the side reducing the position shows more, the other side less
+*
+* Position and PV01 arrive through listeners on BondPositionService and
+* BondRiskService and are kept as atomic snapshots per product with a
+* version counter; the streaming side recomputes a product's skew only
+* when its version moved.
+*
+* 2 Listeners:
+* BondQuoteSkewPositionListener - listen from BondPositionService
+* BondQuoteSkewRiskListener - listen from BondRiskService
+*
+* @Yunze Sun
+*/
+
+#ifndef QuoteSkewEngine_h
+#define QuoteSkewEngine_h
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "products.hpp"
+using namespace std;
+
+struct SkewParameters {
+    double positionSkew; // price points per 1MM of position
+    double maxShift; // price points
+    double riskWiden; // price points per unit of PV01 risk
+    double maxWiden; // price points
+    long maxPosition; // position where the size skew saturates
+    double minSizeFactor; // smallest fraction of the base size shown
+    long sizeIncrement; // quoted sizes are rounded to this
+};
+
+// skew of one product, applied to a symmetric quote
+struct QuoteSkew {
+    double shift;
+    double widen;
+    double bidSizeFactor;
+    double offerSizeFactor;
+};
+
+class QuoteSkewEngine {
+public:
+    // ctor, one snapshot slot per product
+    QuoteSkewEngine(const vector<Bond>& products, const SkewParameters& _parameters);
+
+    static SkewParameters DefaultParameters();
+
+    // writers, called from the position / risk path
+    void UpdatePosition(const ProductId& productId, long position);
+    void UpdateRisk(const ProductId& productId, double pv01Risk);
+
+    // skew of a product, recomputed only if its inputs changed, null if unknown
+    const QuoteSkew* GetSkew(const ProductId& productId);
+
+    // skew the quote in place
+    void Apply(const ProductId& productId, double& bidPrice, double& offerPrice, long& bidQuantity, long& offerQuantity);
+
+    long GetRecomputes() const { return recomputes; }
+
+private:
+    struct Snapshot {
+        atomic<long> position;
+        atomic<double> risk;
+        atomic<unsigned long> version;
+    };
+
+    struct Cached {
+        unsigned long version;
+        QuoteSkew skew;
+    };
+
+    SkewParameters parameters;
+    unordered_map<ProductId, int> productIndex;
+    unique_ptr<Snapshot[]> snapshots;
+    vector<Cached> cache; // owned by the streaming side
+    long recomputes;
+
+    int GetProductIndex(const ProductId& productId) const;
+    void Recompute(int i, unsigned long version);
+};
+
+
+QuoteSkewEngine::QuoteSkewEngine(const vector<Bond>& products, const SkewParameters& _parameters)
+    : parameters(_parameters), recomputes(0)
+{
+    snapshots.reset(new Snapshot[products.size()]);
+    for (int i = 0; i < (int)products.size(); ++i) {
+        productIndex.insert(pair<ProductId, int>(products[i].GetProductId(), i));
+        snapshots[i].position.store(0);
+        snapshots[i].risk.store(0);
+        snapshots[i].version.store(0);
+    }
+    Cached flat;
+    flat.version = 0;
+    flat.skew = QuoteSkew{ 0, 0, 1.0, 1.0 };
+    cache.assign(products.size(), flat);
+}
+
+SkewParameters QuoteSkewEngine::DefaultParameters() {
+    SkewParameters p;
+    p.positionSkew = 1.0 / 256.0;
+    p.maxShift = 1.0 / 32.0;
+    p.riskWiden = 1.0 / 256.0 / 100000.0;
+    p.maxWiden = 1.0 / 64.0;
+    p.maxPosition = 50000000;
+    p.minSizeFactor = 0.5;
+    p.sizeIncrement = 100000;
+    return p;
+}
+
+void QuoteSkewEngine::UpdatePosition(const ProductId& productId, long position) {
+    int i = GetProductIndex(productId);
+    if (i < 0 || snapshots[i].position.load(memory_order_relaxed) == position) return;
+    snapshots[i].position.store(position, memory_order_relaxed);
+    snapshots[i].version.fetch_add(1, memory_order_release);
+}
+
+void QuoteSkewEngine::UpdateRisk(const ProductId& productId, double pv01Risk) {
+    int i = GetProductIndex(productId);
+    if (i < 0 || snapshots[i].risk.load(memory_order_relaxed) == pv01Risk) return;
+    snapshots[i].risk.store(pv01Risk, memory_order_relaxed);
+    snapshots[i].version.fetch_add(1, memory_order_release);
+}
+
+const QuoteSkew* QuoteSkewEngine::GetSkew(const ProductId& productId) {
+    int i = GetProductIndex(productId);
+    if (i < 0) return nullptr;
+    unsigned long version = snapshots[i].version.load(memory_order_acquire);
+    if (version != cache[i].version) Recompute(i, version);
+    return &cache[i].skew;
+}
+
+void QuoteSkewEngine::Apply(const ProductId& productId, double& bidPrice, double& offerPrice, long& bidQuantity, long& offerQuantity) {
+    const QuoteSkew* skew = GetSkew(productId);
+    if (!skew) return;
+
+    bidPrice += skew->shift - skew->widen / 2.0;
+    offerPrice += skew->shift + skew->widen / 2.0;
+
+    long step = parameters.sizeIncrement;
+    bidQuantity = max(step, lround(bidQuantity * skew->bidSizeFactor / step) * step);
+    offerQuantity = max(step, lround(offerQuantity * skew->offerSizeFactor / step) * step);
+}
+
+void QuoteSkewEngine::Recompute(int i, unsigned long version) {
+    long position = snapshots[i].position.load(memory_order_relaxed);
+    double risk = snapshots[i].risk.load(memory_order_relaxed);
+    QuoteSkew& skew = cache[i].skew;
+
+    double shift = -parameters.positionSkew * position / 1000000.0;
+    skew.shift = max(-parameters.maxShift, min(parameters.maxShift, shift));
+    skew.widen = min(parameters.maxWiden, parameters.riskWiden * fabs(risk));
+
+    // long: offer more, bid less; short: the other way round
+    double load = min(1.0, fabs((double)position) / parameters.maxPosition);
+    double reduce = 1.0 + load;
+    double add = max(parameters.minSizeFactor, 1.0 - load);
+    skew.bidSizeFactor = position > 0 ? add : reduce;
+    skew.offerSizeFactor = position > 0 ? reduce : add;
+    if (position == 0) skew.bidSizeFactor = skew.offerSizeFactor = 1.0;
+
+    cache[i].version = version;
+    ++recomputes;
+}
+
+int QuoteSkewEngine::GetProductIndex(const ProductId& productId) const {
+    auto it = productIndex.find(productId);
+    return it == productIndex.end() ? -1 : it->second;
+}
+
+
+class BondQuoteSkewPositionListener : public ServiceListener<Position<Bond> > {
+public:
+    // ctor
+    BondQuoteSkewPositionListener(QuoteSkewEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(Position<Bond>& data) override {
+        engine->UpdatePosition(data.GetProduct().GetProductId(), data.GetAggregatePosition());
+    }
+
+    // no implementation
+    void ProcessRemove(Position<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(Position<Bond>& data) override {}
+
+private:
+    QuoteSkewEngine* engine;
+};
+
+
+class BondQuoteSkewRiskListener : public ServiceListener<PV01<Bond> > {
+public:
+    // ctor
+    BondQuoteSkewRiskListener(QuoteSkewEngine* _engine) : engine(_engine) {};
+
+    void ProcessAdd(PV01<Bond>& data) override {
+        engine->UpdateRisk(data.GetProduct().GetProductId(), data.GetPV01() * data.GetQuantity());
+    }
+
+    // no implementation
+    void ProcessRemove(PV01<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(PV01<Bond>& data) override {}
+
+private:
+    QuoteSkewEngine* engine;
+};
+
+#endif
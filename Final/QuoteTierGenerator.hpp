@@ -0,0 +1,114 @@
+/**
+* QuoteTierGenerator.hpp
+* Definition of QuoteTierGenerator class
+*
+* Client tiers of the streamed quotes. Every product has a TierSchedule
+* (the default one unless set): per tier a spread multiplier, an extra
+* half-spread and a size multiplier. All tiers of a product come out of
+* one pass over fixed-size arrays, which the compiler vectorizes:
+*
+*   half[i]  = spread / 2 * spreadMultiplier[i] + spreadAdd[i] + widen / 2
+*   bid[i]   = mid + shift - half[i],  offer[i] = mid + shift + half[i]
+*   size[i]  = base * sizeMultiplier[i] * side size factor, rounded to the increment
+*
+* shift / widen / size factors come from the QuoteSkewEngine when one is used.
+*
+* @Yunze Sun
+*/
+
+#ifndef QuoteTierGenerator_h
+#define QuoteTierGenerator_h
+
+#include <string>
+#include <unordered_map>
+#include "streamingservice.hpp"
+#include "QuoteSkewEngine.hpp"
+using namespace std;
+
+struct TierSchedule {
+    int count;
+    double spreadMultiplier[MAX_QUOTE_TIERS];
+    double spreadAdd[MAX_QUOTE_TIERS]; // price points added to the half spread
+    double sizeMultiplier[MAX_QUOTE_TIERS];
+};
+
+class QuoteTierGenerator {
+public:
+    // ctor
+    QuoteTierGenerator(const TierSchedule& _defaultSchedule, long _sizeIncrement = 100000)
+        : defaultSchedule(_defaultSchedule), sizeIncrement(_sizeIncrement) {}
+
+    // one tier, the plain two-way quote
+    static TierSchedule SingleTier();
+
+    // tier 0 as the plain quote, then 2x / 3x / 5x the spread with growing size
+    static TierSchedule DefaultTiers();
+
+    void SetSchedule(const ProductId& productId, const TierSchedule& schedule) { schedules[productId] = schedule; }
+    const TierSchedule& GetSchedule(const ProductId& productId) const;
+
+    // all tiers of a product, skew may be null
+    void Generate(const ProductId& productId, double mid, double spread, long baseQuantity, const QuoteSkew* skew, QuoteTiers& tiers) const;
+
+private:
+    TierSchedule defaultSchedule;
+    unordered_map<ProductId, TierSchedule> schedules;
+    long sizeIncrement;
+};
+
+
+TierSchedule QuoteTierGenerator::SingleTier() {
+    TierSchedule schedule;
+    schedule.count = 1;
+    for (int i = 0; i < MAX_QUOTE_TIERS; ++i) {
+        schedule.spreadMultiplier[i] = 1.0;
+        schedule.spreadAdd[i] = 0.0;
+        schedule.sizeMultiplier[i] = 1.0;
+    }
+    return schedule;
+}
+
+TierSchedule QuoteTierGenerator::DefaultTiers() {
+    TierSchedule schedule = SingleTier();
+    double spreads[4] = { 1.0, 2.0, 3.0, 5.0 };
+    double sizes[4] = { 1.0, 2.0, 5.0, 10.0 };
+    schedule.count = 4;
+    for (int i = 0; i < schedule.count; ++i) {
+        schedule.spreadMultiplier[i] = spreads[i];
+        schedule.sizeMultiplier[i] = sizes[i];
+    }
+    return schedule;
+}
+
+const TierSchedule& QuoteTierGenerator::GetSchedule(const ProductId& productId) const {
+    auto it = schedules.find(productId);
+    return it == schedules.end() ? defaultSchedule : it->second;
+}
+
+void QuoteTierGenerator::Generate(const ProductId& productId, double mid, double spread, long baseQuantity, const QuoteSkew* skew, QuoteTiers& tiers) const {
+    const TierSchedule& schedule = GetSchedule(productId);
+    double shift = skew ? skew->shift : 0.0;
+    double widen = skew ? skew->widen : 0.0;
+    double bidSize = baseQuantity * (skew ? skew->bidSizeFactor : 1.0) / sizeIncrement;
+    double offerSize = baseQuantity * (skew ? skew->offerSizeFactor : 1.0) / sizeIncrement;
+    double center = mid + shift;
+    double halfSpread = spread / 2.0;
+    double halfWiden = widen / 2.0;
+    long step = sizeIncrement;
+
+    // fixed trip count over every slot, the unused tiers are computed and ignored
+    for (int i = 0; i < MAX_QUOTE_TIERS; ++i) {
+        double half = halfSpread * schedule.spreadMultiplier[i] + schedule.spreadAdd[i] + halfWiden;
+        tiers.bidPrice[i] = center - half;
+        tiers.offerPrice[i] = center + half;
+    }
+    for (int i = 0; i < MAX_QUOTE_TIERS; ++i) {
+        long bid = (long)(bidSize * schedule.sizeMultiplier[i] + 0.5) * step;
+        long offer = (long)(offerSize * schedule.sizeMultiplier[i] + 0.5) * step;
+        tiers.bidQuantity[i] = bid < step ? step : bid;
+        tiers.offerQuantity[i] = offer < step ? step : offer;
+    }
+    tiers.count = schedule.count;
+}
+
+#endif
@@ -0,0 +1,213 @@
+/**
+* SmartOrderRouter.hpp
+* Definition of SmartOrderRouter class
+*
+* Splits an execution order across BROKERTEC, ESPEED and CME.
+* Per venue and product the router keeps the displayed depth at the touch,
+* per venue the fee and a decayed fill rate (filled / sent quantity).
+* All of it is updated as books and fills come in, so routing an order
+* only ranks the three venues:
+*   cost (per 1MM) = fee + (1 - fill rate) * miss penalty
+*   cheapest venue first, up to depth * fill rate, the rest to the cheapest venue
+*
+* A split order goes out as one slice per venue, id = order id + "-B" / "-E" / "-C".
+* The router remembers how many slices are open so execution reports can
+* be mapped back to the original order.
+*
+* @Yunze Sun
+*/
+
+#ifndef SmartOrderRouter_h
+#define SmartOrderRouter_h
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "executionservice.hpp"
+#include "marketdataservice.hpp"
+using namespace std;
+
+struct RouteSlice {
+    Market market;
+    long quantity;
+};
+
+class SmartOrderRouter {
+public:
+    static const int VENUES = 3;
+
+    // ctor, decay applies to the fill rate on every routed quantity
+    SmartOrderRouter(double _decay = 0.95);
+
+    // cost model
+    void SetFee(Market market, double feePerMillion) { venues[market].fee = feePerMillion; }
+    void SetMissPenalty(double perMillion) { missPenalty = perMillion; }
+
+    // displayed quantity at the touch of one venue
+    void UpdateDepth(Market market, const ProductId& productId, long bidDepth, long offerDepth);
+
+    // split an order, returns the number of slices written (1 to VENUES)
+    int Route(const ExecutionOrder<Bond>& order, RouteSlice* slices);
+
+    // filled quantity reported by a venue
+    void OnFill(Market market, long quantity);
+
+    // original order id of a slice, the id itself for orders that were not split
+    OrderId GetOrderId(const OrderId& sliceId) const;
+
+    // a slice is done, true once all slices of its order are done
+    bool OnSliceDone(const OrderId& sliceId, OrderId& orderId);
+
+    double GetFillRate(Market market) const;
+    long GetRouted(Market market) const { return venues[market].routedQuantity; }
+    long GetSplitOrders() const { return splitOrders; }
+
+    static OrderId SliceId(const OrderId& orderId, Market market);
+
+private:
+    struct VenueState {
+        double fee;
+        double sentQuantity; // decayed
+        double filledQuantity; // decayed
+        long routedQuantity;
+    };
+
+    struct Depth {
+        long bid;
+        long offer;
+    };
+
+    VenueState venues[VENUES];
+    double decay;
+    double missPenalty;
+    unordered_map<ProductId, int> productIndex;
+    vector<Depth> depth; // product x venue
+    unordered_map<OrderId, int> openSlices; // order id -> slices not done
+    long splitOrders;
+
+    int GetProductIndex(const ProductId& productId);
+};
+
+
+SmartOrderRouter::SmartOrderRouter(double _decay) : decay(_decay), splitOrders(0)
+{
+    // default fees per 1MM face, and one 1/256 tick on 1MM for a missed fill
+    double fees[VENUES] = { 15.0, 12.0, 10.0 };
+    for (int v = 0; v < VENUES; ++v) {
+        venues[v].fee = fees[v];
+        venues[v].sentQuantity = 0;
+        venues[v].filledQuantity = 0;
+        venues[v].routedQuantity = 0;
+    }
+    missPenalty = 1000000.0 / 256.0 / 100.0;
+}
+
+void SmartOrderRouter::UpdateDepth(Market market, const ProductId& productId, long bidDepth, long offerDepth) {
+    Depth& d = depth[GetProductIndex(productId) * VENUES + market];
+    d.bid = bidDepth;
+    d.offer = offerDepth;
+}
+
+int SmartOrderRouter::Route(const ExecutionOrder<Bond>& order, RouteSlice* slices) {
+    const Depth* d = &depth[GetProductIndex(order.GetProduct().GetProductId()) * VENUES];
+    long quantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+
+    // rank the venues by expected cost, insertion sort of three
+    int rank[VENUES];
+    double cost[VENUES];
+    for (int v = 0; v < VENUES; ++v) {
+        cost[v] = venues[v].fee + (1.0 - GetFillRate((Market)v)) * missPenalty;
+        int i = v;
+        while (i > 0 && cost[rank[i - 1]] > cost[v]) {
+            rank[i] = rank[i - 1];
+            --i;
+        }
+        rank[i] = v;
+    }
+
+    // a BID order takes the offers
+    int count = 0;
+    long remaining = quantity;
+    for (int i = 0; i < VENUES && remaining > 0; ++i) {
+        int v = rank[i];
+        long displayed = order.GetSide() == BID ? d[v].offer : d[v].bid;
+        long take = min(remaining, (long)(displayed * GetFillRate((Market)v)));
+        if (take <= 0) continue;
+        slices[count].market = (Market)v;
+        slices[count].quantity = take;
+        ++count;
+        remaining -= take;
+    }
+    if (remaining > 0) {
+        int i = 0;
+        while (i < count && slices[i].market != rank[0]) ++i;
+        if (i == count) {
+            slices[count].market = (Market)rank[0];
+            slices[count].quantity = 0;
+            ++count;
+        }
+        slices[i].quantity += remaining;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        VenueState& venue = venues[slices[i].market];
+        venue.sentQuantity = venue.sentQuantity * decay + slices[i].quantity;
+        venue.filledQuantity *= decay;
+        venue.routedQuantity += slices[i].quantity;
+    }
+    if (count > 1) {
+        openSlices[order.GetOrderId()] = count;
+        ++splitOrders;
+    }
+    return count;
+}
+
+void SmartOrderRouter::OnFill(Market market, long quantity) {
+    venues[market].filledQuantity += quantity;
+}
+
+OrderId SmartOrderRouter::GetOrderId(const OrderId& sliceId) const {
+    size_t n = sliceId.size();
+    if (n > 2 && sliceId.data()[n - 2] == '-') {
+        OrderId orderId(sliceId.data(), n - 2);
+        if (openSlices.find(orderId) != openSlices.end()) return orderId;
+    }
+    return sliceId;
+}
+
+bool SmartOrderRouter::OnSliceDone(const OrderId& sliceId, OrderId& orderId) {
+    orderId = GetOrderId(sliceId);
+    auto it = openSlices.find(orderId);
+    if (it == openSlices.end()) return true;
+    if (--it->second > 0) return false;
+    openSlices.erase(it);
+    return true;
+}
+
+double SmartOrderRouter::GetFillRate(Market market) const {
+    const VenueState& venue = venues[market];
+    if (venue.sentQuantity <= 0) return 1.0;
+    return min(1.0, venue.filledQuantity / venue.sentQuantity);
+}
+
+OrderId SmartOrderRouter::SliceId(const OrderId& orderId, Market market) {
+    static const char suffix[VENUES] = { 'B', 'E', 'C' };
+    char id[sizeof(OrderId)];
+    size_t n = orderId.size();
+    memcpy(id, orderId.data(), n);
+    id[n] = '-';
+    id[n + 1] = suffix[market];
+    return OrderId(id, n + 2);
+}
+
+int SmartOrderRouter::GetProductIndex(const ProductId& productId) {
+    auto it = productIndex.find(productId);
+    if (it != productIndex.end()) return it->second;
+    int i = (int)productIndex.size();
+    productIndex.insert(pair<ProductId, int>(productId, i));
+    depth.resize(depth.size() + VENUES, Depth{ 0, 0 });
+    return i;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/**
+* SpscQueue.hpp
+* Definition of SpscQueue class
+*
+* Bounded lock-free single-producer / single-consumer ring buffer.
+* Capacity is rounded up to a power of two, head and tail sit on
+* separate cache lines so producer and consumer do not false-share.
+*
+* @Yunze Sun
+*/
+
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <atomic>
+#include <vector>
+using namespace std;
+
+template<typename T>
+class SpscQueue {
+public:
+    // ctor
+    SpscQueue(size_t _capacity = 4096);
+
+    // producer side, false if the queue is full
+    bool TryPush(const T& item);
+
+    // consumer side, false if the queue is empty
+    bool TryPop(T& item);
+
+    bool Empty() const { return head.load(memory_order_acquire) == tail.load(memory_order_acquire); }
+
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    vector<T> buffer;
+    size_t mask;
+    alignas(64) atomic<size_t> head; // next slot to read, owned by the consumer
+    alignas(64) atomic<size_t> tail; // next slot to write, owned by the producer
+};
+
+
+template<typename T>
+SpscQueue<T>::SpscQueue(size_t _capacity) : head(0), tail(0)
+{
+    size_t capacity = 2;
+    while (capacity < _capacity) capacity <<= 1;
+    buffer.resize(capacity);
+    mask = capacity - 1;
+}
+
+template<typename T>
+bool SpscQueue<T>::TryPush(const T& item) {
+    size_t t = tail.load(memory_order_relaxed);
+    if (t - head.load(memory_order_acquire) > mask) return false;
+    buffer[t & mask] = item;
+    tail.store(t + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool SpscQueue<T>::TryPop(T& item) {
+    size_t h = head.load(memory_order_relaxed);
+    if (h == tail.load(memory_order_acquire)) return false;
+    item = std::move(buffer[h & mask]);
+    head.store(h + 1, memory_order_release);
+    return true;
+}
+
+#endif
@@ -0,0 +1,323 @@
+/**
+* TimerWheel.hpp
+* Definition of TimerWheel class
+*
+* Hashed hierarchical timer wheel shared by the services.
+* 4 levels of 256 slots, each level 256 times coarser than the one below.
+* Schedule / Cancel are O(1), timers are cascaded down as the wheel turns.
+*
+* The wheel can be driven by
+*   WALL_TIME  - steady clock, ms since the wheel was created
+*   EVENT_TIME - timestamps carried by the data (e.g. price.txt), in ms
+*
+* One-shot timers are work that ends (a slice, a deadline), periodic ones
+* run for the life of their service. Flush runs out the one-shots pending
+* at the end of the data and the ones they chain, with the periodic timers
+* due on the way; work a periodic timer starts meanwhile is left pending.
+*
+* @Yunze Sun
+*/
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+using namespace std;
+
+enum TimeSource { WALL_TIME, EVENT_TIME };
+
+class TimerWheel {
+public:
+    typedef function<void()> Callback;
+    typedef unsigned long long TimerId; // never 0, callers may use 0 for no timer
+
+    // ctor, resolution is the length of one tick in ms
+    TimerWheel(TimeSource _source = WALL_TIME, long _resolution = 1);
+
+    // schedule a one-shot callback delay ms from now
+    TimerId Schedule(long delay, Callback callback);
+
+    // schedule a callback every interval ms, first one interval ms from now
+    TimerId SchedulePeriodic(long interval, Callback callback);
+
+    // cancel a pending timer, false if it already fired or was cancelled
+    bool Cancel(TimerId id);
+
+    // called by connectors on every message,
+    // the event timestamp is used in EVENT_TIME and ignored in WALL_TIME
+    void OnEvent(long long eventTime);
+
+    // move the wheel to the given time (ms) and fire everything due
+    void AdvanceTo(long long now);
+
+    // advance until the one-shot timers pending now, and those scheduled from their callbacks, have fired
+    void Flush();
+
+    // current time of the wheel in ms
+    long long Now() const { return (long long)currentTick * resolution; }
+
+    // number of pending timers
+    size_t Size() const { return pending; }
+
+    TimeSource GetTimeSource() const { return source; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int SLOT_MASK = SLOTS - 1;
+
+    enum NodeState { NODE_FREE, NODE_PENDING, NODE_FIRING };
+
+    struct TimerNode {
+        unsigned long long expiry;  // in ticks
+        unsigned long long interval;  // in ticks, 0 for one-shot
+        Callback callback;
+        int prev;
+        int next;
+        int level;
+        int slot;
+        unsigned int generation;
+        NodeState state;
+        bool flushed; // run out by the current Flush
+    };
+
+    TimeSource source;
+    long resolution;
+    chrono::steady_clock::time_point startTime;
+    unsigned long long currentTick;
+    size_t pending;
+    bool flushing; // scheduling from a flushed callback
+
+    vector<TimerNode> nodes;
+    vector<int> freeNodes;
+    int heads[LEVELS][SLOTS];
+    long levelCount[LEVELS];
+
+    TimerId Add(unsigned long long delayTicks, unsigned long long intervalTicks, Callback& callback);
+    unsigned long long ToTicks(long ms) const;
+    void Insert(int index);
+    void Unlink(int index);
+    void Release(int index);
+    void Cascade(int level, int slot);
+    void Tick();
+};
+
+
+TimerWheel::TimerWheel(TimeSource _source, long _resolution)
+    : source(_source), resolution(_resolution > 0 ? _resolution : 1), currentTick(0), pending(0), flushing(false)
+{
+    startTime = chrono::steady_clock::now();
+    for (int l = 0; l < LEVELS; ++l) {
+        levelCount[l] = 0;
+        for (int s = 0; s < SLOTS; ++s) heads[l][s] = -1;
+    }
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(long delay, Callback callback) {
+    return Add(ToTicks(delay), 0, callback);
+}
+
+TimerWheel::TimerId TimerWheel::SchedulePeriodic(long interval, Callback callback) {
+    unsigned long long ticks = ToTicks(interval);
+    return Add(ticks, ticks, callback);
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+    int index = (int)(id & 0xffffffffULL);
+    unsigned int generation = (unsigned int)(id >> 32);
+    if (index < 0 || index >= (int)nodes.size()) return false;
+
+    TimerNode& node = nodes[index];
+    if (node.generation != generation) return false;
+
+    switch (node.state) {
+    case NODE_PENDING:
+        Unlink(index);
+        Release(index);
+        return true;
+    case NODE_FIRING:
+        // cancelled from inside its own callback: just stop it re-arming
+        node.interval = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void TimerWheel::OnEvent(long long eventTime) {
+    if (source == EVENT_TIME) {
+        AdvanceTo(eventTime);
+    }
+    else {
+        auto elapsed = chrono::steady_clock::now() - startTime;
+        AdvanceTo(chrono::duration_cast<chrono::milliseconds>(elapsed).count());
+    }
+}
+
+void TimerWheel::AdvanceTo(long long now) {
+    if (now < 0) return;
+    unsigned long long target = (unsigned long long)now / resolution;
+
+    while (currentTick < target) {
+        if (pending == 0) {
+            // nothing to fire, jump straight there
+            currentTick = target;
+            break;
+        }
+        if (levelCount[0] == 0) {
+            // nothing due before the next level-0 wrap, skip to it
+            unsigned long long boundary = (currentTick | SLOT_MASK) + 1;
+            if (boundary > target) {
+                currentTick = target;
+                break;
+            }
+            currentTick = boundary - 1;
+        }
+        Tick();
+    }
+}
+
+void TimerWheel::Flush() {
+    for (auto& node : nodes) node.flushed = node.state == NODE_PENDING && node.interval == 0;
+    while (true) {
+        // the last one-shot due, its callbacks may chain more
+        unsigned long long last = 0;
+        for (auto& node : nodes) {
+            if (node.state == NODE_PENDING && node.flushed) last = max(last, node.expiry);
+        }
+        if (last == 0) break;
+        AdvanceTo((long long)(last * resolution));
+    }
+    for (auto& node : nodes) node.flushed = false;
+}
+
+TimerWheel::TimerId TimerWheel::Add(unsigned long long delayTicks, unsigned long long intervalTicks, Callback& callback) {
+    int index;
+    if (!freeNodes.empty()) {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else {
+        index = (int)nodes.size();
+        nodes.push_back(TimerNode());
+        nodes[index].generation = 1;
+    }
+
+    TimerNode& node = nodes[index];
+    node.expiry = currentTick + (delayTicks > 0 ? delayTicks : 1);
+    node.interval = intervalTicks;
+    node.callback = std::move(callback);
+    node.state = NODE_PENDING;
+    node.flushed = flushing && intervalTicks == 0;
+    Insert(index);
+    ++pending;
+
+    return ((TimerId)node.generation << 32) | (TimerId)index;
+}
+
+unsigned long long TimerWheel::ToTicks(long ms) const {
+    if (ms <= 0) return 0;
+    // round up so a timer never fires early
+    return (unsigned long long)((ms + resolution - 1) / resolution);
+}
+
+// put a node into the slot matching its distance from the current tick
+void TimerWheel::Insert(int index) {
+    TimerNode& node = nodes[index];
+    // only a cascade can see expiry == currentTick, it then fires in this tick
+    unsigned long long expiry = node.expiry > currentTick ? node.expiry : currentTick;
+    unsigned long long diff = expiry - currentTick;
+
+    int level = 0;
+    while (level < LEVELS - 1 && diff >= (1ULL << (SLOT_BITS * (level + 1)))) ++level;
+    if (level == LEVELS - 1 && diff >= (1ULL << (SLOT_BITS * LEVELS))) {
+        // beyond the wheel horizon, park in the farthest slot and re-cascade later
+        expiry = currentTick + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    }
+    int slot = (int)((expiry >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    node.level = level;
+    node.slot = slot;
+    node.prev = -1;
+    node.next = heads[level][slot];
+    if (node.next != -1) nodes[node.next].prev = index;
+    heads[level][slot] = index;
+    ++levelCount[level];
+}
+
+void TimerWheel::Unlink(int index) {
+    TimerNode& node = nodes[index];
+    if (node.prev != -1) nodes[node.prev].next = node.next;
+    else heads[node.level][node.slot] = node.next;
+    if (node.next != -1) nodes[node.next].prev = node.prev;
+    --levelCount[node.level];
+    --pending;
+}
+
+void TimerWheel::Release(int index) {
+    TimerNode& node = nodes[index];
+    node.state = NODE_FREE;
+    node.callback = nullptr;
+    if (++node.generation == 0) node.generation = 1;
+    freeNodes.push_back(index);
+}
+
+// re-insert every timer of a higher-level slot, they land in finer slots
+void TimerWheel::Cascade(int level, int slot) {
+    int index = heads[level][slot];
+    heads[level][slot] = -1;
+    while (index != -1) {
+        int next = nodes[index].next;
+        --levelCount[level];
+        Insert(index);
+        index = next;
+    }
+}
+
+// advance one tick: cascade wrapped levels and fire the level-0 slot
+void TimerWheel::Tick() {
+    ++currentTick;
+
+    for (int level = 1; level < LEVELS; ++level) {
+        if ((currentTick & ((1ULL << (SLOT_BITS * level)) - 1)) != 0) break;
+        Cascade(level, (int)((currentTick >> (SLOT_BITS * level)) & SLOT_MASK));
+    }
+
+    int slot = (int)(currentTick & SLOT_MASK);
+    while (heads[0][slot] != -1) {
+        int index = heads[0][slot];
+        Unlink(index);
+
+        if (nodes[index].expiry > currentTick) {
+            // parked beyond the horizon, not due yet
+            ++pending;
+            Insert(index);
+            continue;
+        }
+
+        // the callback may schedule new timers and grow the pool, so run it off a local copy
+        nodes[index].state = NODE_FIRING;
+        Callback callback = std::move(nodes[index].callback);
+        flushing = nodes[index].flushed;
+        callback();
+        flushing = false;
+
+        TimerNode& node = nodes[index];
+        if (node.interval > 0) {
+            node.callback = std::move(callback);
+            node.expiry = currentTick + node.interval;
+            node.state = NODE_PENDING;
+            ++pending;
+            Insert(index);
+        }
+        else {
+            Release(index);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,241 @@
+/**
+* TradeJournal.hpp
+* Definition of TradeJournal class
+*
+* Append-only journal of the booked trades in a memory-mapped file:
+*   [TradeJournalHeader][TradeRecord x capacity]
+* Every trade is one fixed 64 byte record written at the end, the header
+* count is moved past it once the record is complete. The file doubles
+* when it is full: it is extended first and the mapping moved with mremap,
+* so a failed growth leaves the journal as it was. Records are handed out
+* by value, the mapping may move on any Append.
+*
+* An open-addressing hash index maps a trade id to its latest record, so
+* booking is an append plus one insert and a lookup is O(1). Memory is the
+* index only (16 bytes per trade id), the records stay in the page cache.
+* Opening an existing journal rebuilds the index by scanning the records.
+*
+* @Yunze Sun
+*/
+
+#ifndef TradeJournal_h
+#define TradeJournal_h
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "tradebookingservice.hpp"
+#include "products.hpp"
+#include "utility.h"
+using namespace std;
+
+static const unsigned long long TRADE_JOURNAL_MAGIC = 0x314C4E524A445254ULL;
+
+#pragma pack(push, 1)
+struct TradeRecord {
+    char tradeId[24];
+    char productId[12];
+    char book[11];
+    unsigned char side;
+    double price;
+    long long quantity;
+};
+#pragma pack(pop)
+
+struct TradeJournalHeader {
+    unsigned long long magic;
+    unsigned long long count; // complete records
+    char pad[48];
+};
+
+class TradeJournal {
+public:
+    // ctor, an existing journal is scanned back in unless recover is false, then it starts empty
+    TradeJournal(const string& _path, bool recover = true, size_t _capacity = 1 << 16);
+    ~TradeJournal();
+
+    bool IsOpen() const { return header != nullptr; }
+
+    // append a trade, returns its record number, -1 if the journal is not open or cannot grow
+    long long Append(const Trade<Bond>& trade);
+
+    // latest record of a trade id, -1 if never booked
+    long long Find(const string& tradeId) const;
+
+    // copy of a record, the mapping moves when the journal grows
+    TradeRecord GetRecord(long long record) const { return records[record]; }
+    Trade<Bond> GetTrade(long long record);
+
+    // write the mapped pages back to the file
+    void Sync();
+
+    long long Size() const { return header ? (long long)header->count : 0; }
+    size_t GetTradeIds() const { return indexSize; }
+    size_t GetIndexBytes() const { return index.size() * sizeof(IndexSlot); }
+
+private:
+    struct IndexSlot {
+        unsigned long long hash;
+        long long record; // -1 when empty
+    };
+
+    string path;
+    int fd;
+    size_t capacity; // records
+    size_t mapped;
+    TradeJournalHeader* header;
+    TradeRecord* records;
+
+    vector<IndexSlot> index;
+    size_t indexMask, indexSize;
+    unordered_map<ProductId, Bond> products; // bonds seen, for decoding
+
+    // map the file at _capacity records, an existing mapping is only replaced once the new one is there
+    bool Map(size_t _capacity);
+    static unsigned long long Hash(const char* id, size_t length);
+    static void Copy(char* field, size_t size, const string& value);
+    static string Field(const char* field, size_t size);
+    void Index(long long record);
+    void GrowIndex();
+};
+
+
+TradeJournal::TradeJournal(const string& _path, bool recover, size_t _capacity)
+    : path(_path), fd(-1), capacity(0), mapped(0), header(nullptr), records(nullptr), index(1024, IndexSlot{ 0, -1 }), indexMask(1023), indexSize(0)
+{
+    fd = open(path.c_str(), O_CREAT | O_RDWR | (recover ? 0 : O_TRUNC), 0644);
+    if (fd < 0) return;
+    struct stat st;
+    size_t existing = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    size_t stored = existing > sizeof(TradeJournalHeader) ? (existing - sizeof(TradeJournalHeader)) / sizeof(TradeRecord) : 0;
+    if (!Map(max(_capacity, stored))) return;
+
+    if (header->magic != TRADE_JOURNAL_MAGIC || header->count > capacity) {
+        header->magic = TRADE_JOURNAL_MAGIC;
+        header->count = 0;
+        return;
+    }
+    // restart: every record back into the index, the last booking of an id wins
+    for (long long r = 0; r < (long long)header->count; ++r) Index(r);
+}
+
+TradeJournal::~TradeJournal() {
+    if (header) munmap(header, mapped);
+    if (fd >= 0) close(fd);
+}
+
+bool TradeJournal::Map(size_t _capacity) {
+    size_t size = sizeof(TradeJournalHeader) + _capacity * sizeof(TradeRecord);
+    // a longer file does not disturb the pages mapped so far
+    if (size > mapped && ftruncate(fd, size) != 0) return false;
+    void* p = header ? mremap(header, mapped, size, MREMAP_MAYMOVE) : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+    mapped = size;
+    capacity = _capacity;
+    header = (TradeJournalHeader*)p;
+    records = (TradeRecord*)((char*)p + sizeof(TradeJournalHeader));
+    return true;
+}
+
+unsigned long long TradeJournal::Hash(const char* id, size_t length) {
+    // FNV-1a
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < length && id[i]; ++i) {
+        h ^= (unsigned char)id[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void TradeJournal::Copy(char* field, size_t size, const string& value) {
+    // truncated to size - 1, always NUL terminated
+    size_t n = min(value.size(), size - 1);
+    memcpy(field, value.data(), n);
+    memset(field + n, 0, size - n);
+}
+
+string TradeJournal::Field(const char* field, size_t size) {
+    return string(field, strnlen(field, size));
+}
+
+void TradeJournal::GrowIndex() {
+    vector<IndexSlot> old;
+    old.swap(index);
+    index.assign(old.size() * 2, IndexSlot{ 0, -1 });
+    indexMask = index.size() - 1;
+    for (auto& slot : old) {
+        if (slot.record < 0) continue;
+        size_t i = slot.hash & indexMask;
+        while (index[i].record >= 0) i = (i + 1) & indexMask;
+        index[i] = slot;
+    }
+}
+
+void TradeJournal::Index(long long record) {
+    const char* id = records[record].tradeId;
+    unsigned long long h = Hash(id, sizeof(records[record].tradeId));
+    size_t i = h & indexMask;
+    while (index[i].record >= 0) {
+        if (index[i].hash == h && strncmp(records[index[i].record].tradeId, id, sizeof(records[record].tradeId)) == 0) {
+            index[i].record = record;
+            return;
+        }
+        i = (i + 1) & indexMask;
+    }
+    index[i] = IndexSlot{ h, record };
+    // keep the load under one half so probes stay short
+    if (++indexSize * 2 > index.size()) GrowIndex();
+}
+
+long long TradeJournal::Append(const Trade<Bond>& trade) {
+    if (!header) return -1;
+    if (header->count == capacity && !Map(capacity * 2)) return -1;
+
+    long long r = (long long)header->count;
+    TradeRecord& record = records[r];
+    Copy(record.tradeId, sizeof(record.tradeId), trade.GetTradeId());
+    Copy(record.productId, sizeof(record.productId), trade.GetProduct().GetProductId());
+    Copy(record.book, sizeof(record.book), trade.GetBook());
+    record.side = (unsigned char)trade.GetSide();
+    record.price = trade.GetPrice();
+    record.quantity = trade.GetQuantity();
+    // the record is only part of the journal once the count moves past it
+    header->count = r + 1;
+
+    if (products.find(trade.GetProduct().GetProductId()) == products.end()) {
+        products.insert(pair<ProductId, Bond>(trade.GetProduct().GetProductId(), trade.GetProduct()));
+    }
+    Index(r);
+    return r;
+}
+
+long long TradeJournal::Find(const string& tradeId) const {
+    if (!header) return -1;
+    char id[sizeof(TradeRecord::tradeId)];
+    Copy(id, sizeof(id), tradeId);
+    unsigned long long h = Hash(id, sizeof(id));
+    for (size_t i = h & indexMask; index[i].record >= 0; i = (i + 1) & indexMask) {
+        if (index[i].hash == h && strncmp(records[index[i].record].tradeId, id, sizeof(id)) == 0) return index[i].record;
+    }
+    return -1;
+}
+
+Trade<Bond> TradeJournal::GetTrade(long long r) {
+    const TradeRecord& record = records[r];
+    ProductId productId = Field(record.productId, sizeof(record.productId));
+    auto it = products.find(productId);
+    if (it == products.end()) it = products.insert(pair<ProductId, Bond>(productId, GetBond(productId))).first;
+    return Trade<Bond>(it->second, Field(record.tradeId, sizeof(record.tradeId)), record.price,
+        Field(record.book, sizeof(record.book)), (long)record.quantity, (Side)record.side);
+}
+
+void TradeJournal::Sync() {
+    if (header) msync(header, mapped, MS_SYNC);
+}
+
+#endif
@@ -0,0 +1,519 @@
+/**
+* VenueSimulator.hpp
+* Definition of VenueSimulator class
+*
+* In-process exchange standing in for one Market (BROKERTEC, ESPEED, CME).
+* Orders are matched against the replayed market data book:
+*   MARKET - sweeps the opposite side
+*   IOC    - takes what is available up to the limit, cancels the rest
+*   FOK    - fills completely up to the limit or not at all
+*   LIMIT  - takes what is available, rests the rest and fills when crossed,
+*            crossing liquidity first goes to the displayed queue ahead of it
+*   STOP   - waits for the mid to reach the stop, then behaves as MARKET
+*
+* Every venue shows its own share of each replayed level, so the three
+* venues have different depth on the same consolidated book.
+* Order entry and execution reports go through lock-free SPSC queues, the
+* matching runs on the venue thread (Start) or inline on Pump. Reports are
+* stamped when they are generated, so the round trip does not depend on
+* when the execution service drains them.
+* Books are arrays of price levels indexed by 1/256 tick.
+*
+* 1 Listener: BondVenueMarketDataListener
+* replays the BondMarketDataService books into the venues and hands the
+* depth each venue shows at the touch to the SmartOrderRouter
+*
+* @Yunze Sun
+*/
+
+#ifndef VenueSimulator_h
+#define VenueSimulator_h
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "executionservice.hpp"
+#include "marketdataservice.hpp"
+#include "BondMarketDataService.hpp"
+#include "SmartOrderRouter.hpp"
+#include "SpscQueue.hpp"
+#include "utility.h"
+using namespace std;
+
+// raw execution report from a venue, see ExecutionFill
+struct VenueFill {
+    string orderId;
+    ProductId productId;
+    string tradeId;
+    PricingSide side;
+    double price;
+    long quantity;
+    long leavesQuantity;
+    bool isDone;
+    bool passive; // fill of a resting order, not an answer to its entry
+    long long submitTime; // steady clock ns when the order entered the venue
+    long long reportTime; // steady clock ns when the venue generated the report
+};
+
+class VenueSimulator {
+public:
+    // ctor, the venue shows share of every replayed level
+    VenueSimulator(Market _market, double _share = 1.0, size_t _queueCapacity = 1 << 16);
+    ~VenueSimulator() { Stop(); }
+
+    // order entry, called by the execution connector
+    void SubmitOrder(const ExecutionOrder<Bond>& order);
+
+    // replace the book of a product, called on every market data update
+    void UpdateBook(const OrderBook<Bond>& book);
+
+    // quantity this venue displays at the touch of a replayed book
+    void GetTouchDepth(const OrderBook<Bond>& book, long& bidDepth, long& offerDepth) const;
+
+    // execution reports, false when there is nothing to read
+    bool PollFill(VenueFill& fill);
+
+    // match everything queued so far on the calling thread
+    void Pump();
+
+    // run the matching on a dedicated thread
+    void Start();
+    void Stop();
+    bool IsRunning() const { return running.load(memory_order_acquire); }
+
+    Market GetMarket() const { return market; }
+    double GetShare() const { return share; }
+
+    // nanoseconds on the clock used for the submit timestamps
+    static long long NowNanos() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    static const long TICKS_PER_POINT = 256;
+    static const int BOOK_LEVELS = 2048; // +/- 4 points around the first mid
+    static const int MAX_LEVELS = 8; // replayed levels kept per side
+
+    enum MessageType { NEW_ORDER, BOOK_UPDATE };
+
+    struct VenueOrder {
+        string orderId;
+        ProductId productId;
+        PricingSide side;
+        OrderType orderType;
+        long tick;
+        long quantity;
+        long queueAhead; // displayed quantity in front of us while resting
+        bool resting;
+        long long submitTime;
+    };
+
+    struct Level {
+        long tick;
+        long quantity;
+    };
+
+    // fixed size, a book update allocates nothing
+    struct VenueMessage {
+        MessageType type;
+        VenueOrder order;
+        int bidCount;
+        int offerCount;
+        Level bids[MAX_LEVELS];
+        Level offers[MAX_LEVELS];
+    };
+
+    struct VenueBook {
+        long baseTick;
+        vector<long> bids;
+        vector<long> offers;
+        int bestBid; // level index, -1 if empty
+        int bestOffer;
+        int worstBid;
+        int worstOffer;
+        vector<VenueOrder> resting; // resting LIMIT and pending STOP orders
+    };
+
+    Market market;
+    double share;
+    SpscQueue<VenueMessage> inbound;
+    SpscQueue<VenueFill> fills;
+    unordered_map<ProductId, VenueBook> books;
+    atomic<bool> running;
+    thread worker;
+    long tradeCount;
+    vector<VenueFill> backlog; // reports that did not fit in the queue, owned by the matching side
+    size_t backlogHead;
+
+    static long ToTick(double price) { return lround(price * TICKS_PER_POINT); }
+    static double ToPrice(long tick) { return (double)tick / TICKS_PER_POINT; }
+
+    void Enqueue(const VenueMessage& message);
+    void Run();
+    void Process(VenueMessage& message);
+    void ApplyBook(VenueBook& book, const Level* bids, int bidCount, const Level* offers, int offerCount);
+    void NewOrder(VenueOrder& order);
+    void CheckResting(VenueBook& book);
+    long Available(const VenueBook& book, const VenueOrder& order) const;
+    long Match(VenueBook& book, VenueOrder& order, bool anyPrice, bool report = true);
+    // this venue's share of a replayed level
+    long Shown(long quantity) const { return (long)(quantity * share); }
+    void Report(const VenueOrder& order, long tick, long quantity, bool isDone);
+    void FlushBacklog();
+    string NextTradeId();
+};
+
+
+class BondVenueMarketDataListener : public ServiceListener<OrderBook<Bond> > {
+public:
+    // ctor, the router gets the depth of every venue if given
+    BondVenueMarketDataListener(BondMarketDataService* _bmd_service, const vector<VenueSimulator*>& _venues, SmartOrderRouter* _router = nullptr)
+        : bmd_service(_bmd_service), venues(_venues), router(_router) {};
+
+    // the service only flows the top of book, replay its full depth
+    void ProcessAdd(OrderBook<Bond>& data) override {
+        auto& book = bmd_service->GetData(data.GetProduct().GetProductId());
+        for (auto& venue : venues) {
+            venue->UpdateBook(book);
+            if (!router) continue;
+            long bidDepth, offerDepth;
+            venue->GetTouchDepth(book, bidDepth, offerDepth);
+            router->UpdateDepth(venue->GetMarket(), book.GetProduct().GetProductId(), bidDepth, offerDepth);
+        }
+    }
+
+    // no implementation
+    void ProcessRemove(OrderBook<Bond>& data) override {}
+
+    // no implementation
+    void ProcessUpdate(OrderBook<Bond>& data) override {}
+
+private:
+    BondMarketDataService* bmd_service;
+    vector<VenueSimulator*> venues;
+    SmartOrderRouter* router;
+};
+
+
+VenueSimulator::VenueSimulator(Market _market, double _share, size_t _queueCapacity)
+    : market(_market), share(_share), inbound(_queueCapacity), fills(_queueCapacity), running(false), tradeCount(1), backlogHead(0)
+{
+}
+
+bool VenueSimulator::PollFill(VenueFill& fill) {
+    if (fills.TryPop(fill)) return true;
+    // inline mode: the caller is also the matching side and may drain the backlog
+    if (IsRunning() || backlogHead == backlog.size()) return false;
+    FlushBacklog();
+    return fills.TryPop(fill);
+}
+
+void VenueSimulator::SubmitOrder(const ExecutionOrder<Bond>& order) {
+    VenueMessage message;
+    message.type = NEW_ORDER;
+    message.order.orderId = order.GetOrderId();
+    message.order.productId = order.GetProduct().GetProductId();
+    message.order.side = order.GetSide();
+    message.order.orderType = order.GetOrderType();
+    message.order.tick = ToTick(order.GetPrice());
+    message.order.quantity = order.GetVisibleQuantity() + order.GetHiddenQuantity();
+    message.order.queueAhead = 0;
+    message.order.resting = false;
+    message.order.submitTime = NowNanos();
+    message.bidCount = message.offerCount = 0;
+    Enqueue(message);
+}
+
+void VenueSimulator::UpdateBook(const OrderBook<Bond>& book) {
+    VenueMessage message;
+    message.type = BOOK_UPDATE;
+    message.order.productId = book.GetProduct().GetProductId();
+    message.bidCount = message.offerCount = 0;
+    for (auto& order : book.GetBidStack()) {
+        if (message.bidCount == MAX_LEVELS) break;
+        message.bids[message.bidCount++] = Level{ ToTick(order.GetPrice()), Shown(order.GetQuantity()) };
+    }
+    for (auto& order : book.GetOfferStack()) {
+        if (message.offerCount == MAX_LEVELS) break;
+        message.offers[message.offerCount++] = Level{ ToTick(order.GetPrice()), Shown(order.GetQuantity()) };
+    }
+    Enqueue(message);
+}
+
+void VenueSimulator::GetTouchDepth(const OrderBook<Bond>& book, long& bidDepth, long& offerDepth) const {
+    bidDepth = offerDepth = 0;
+    const vector<Order>& bids = book.GetBidStack();
+    const vector<Order>& offers = book.GetOfferStack();
+    if (bids.empty() || offers.empty()) return;
+    BidOffer bidOffer = book.GetBestBidOffer();
+    double bestBid = bidOffer.GetBidOrder().GetPrice();
+    double bestOffer = bidOffer.GetOfferOrder().GetPrice();
+    for (auto& order : bids) if (order.GetPrice() == bestBid) bidDepth += Shown(order.GetQuantity());
+    for (auto& order : offers) if (order.GetPrice() == bestOffer) offerDepth += Shown(order.GetQuantity());
+}
+
+void VenueSimulator::Pump() {
+    VenueMessage message;
+    while (inbound.TryPop(message)) Process(message);
+    FlushBacklog();
+}
+
+void VenueSimulator::Start() {
+    if (running.exchange(true)) return;
+    worker = thread(&VenueSimulator::Run, this);
+}
+
+void VenueSimulator::Stop() {
+    if (!running.exchange(false)) return;
+    worker.join();
+    Pump();
+}
+
+void VenueSimulator::Enqueue(const VenueMessage& message) {
+    // back-pressure: wait for the venue to catch up
+    while (!inbound.TryPush(message)) {
+        if (IsRunning()) this_thread::yield();
+        else Pump();
+    }
+}
+
+void VenueSimulator::Run() {
+    VenueMessage message;
+    while (running.load(memory_order_acquire)) {
+        FlushBacklog();
+        if (inbound.TryPop(message)) Process(message);
+        else this_thread::yield();
+    }
+}
+
+void VenueSimulator::Process(VenueMessage& message) {
+    if (message.type == NEW_ORDER) {
+        NewOrder(message.order);
+        return;
+    }
+
+    auto it = books.find(message.order.productId);
+    if (it == books.end()) {
+        VenueBook book;
+        book.baseTick = 0;
+        book.bids.assign(BOOK_LEVELS, 0);
+        book.offers.assign(BOOK_LEVELS, 0);
+        book.bestBid = book.bestOffer = book.worstBid = book.worstOffer = -1;
+        it = books.insert(pair<ProductId, VenueBook>(message.order.productId, book)).first;
+    }
+    ApplyBook(it->second, message.bids, message.bidCount, message.offers, message.offerCount);
+    CheckResting(it->second);
+}
+
+// the replayed snapshot replaces whatever liquidity was left on the venue
+void VenueSimulator::ApplyBook(VenueBook& book, const Level* bids, int bidCount, const Level* offers, int offerCount) {
+    if (bidCount == 0 && offerCount == 0) return;
+
+    long anchor = bidCount > 0 ? bids[0].tick : offers[0].tick;
+    bool recenter = book.bestBid < 0 && book.bestOffer < 0;
+    for (int k = 0; k < bidCount; ++k) recenter |= bids[k].tick - book.baseTick < 0 || bids[k].tick - book.baseTick >= BOOK_LEVELS;
+    for (int k = 0; k < offerCount; ++k) recenter |= offers[k].tick - book.baseTick < 0 || offers[k].tick - book.baseTick >= BOOK_LEVELS;
+
+    if (recenter) {
+        // drop resting orders that would fall outside the new window
+        long newBase = anchor - BOOK_LEVELS / 2;
+        vector<VenueOrder> kept;
+        for (auto& order : book.resting) {
+            if (order.tick - newBase >= 0 && order.tick - newBase < BOOK_LEVELS) kept.push_back(order);
+            else Report(order, order.tick, 0, true);
+        }
+        book.resting.swap(kept);
+        book.baseTick = newBase;
+        book.bids.assign(BOOK_LEVELS, 0);
+        book.offers.assign(BOOK_LEVELS, 0);
+    }
+    else {
+        // clear only the levels that were populated
+        for (int i = book.bestBid; i >= 0 && i >= book.worstBid; --i) book.bids[i] = 0;
+        for (int i = book.bestOffer; i >= 0 && i <= book.worstOffer; ++i) book.offers[i] = 0;
+    }
+
+    book.bestBid = book.worstBid = book.bestOffer = book.worstOffer = -1;
+    for (int k = 0; k < bidCount; ++k) {
+        int i = (int)(bids[k].tick - book.baseTick);
+        if (i < 0 || i >= BOOK_LEVELS || bids[k].quantity <= 0) continue;
+        book.bids[i] += bids[k].quantity;
+        if (book.bestBid < 0 || i > book.bestBid) book.bestBid = i;
+        if (book.worstBid < 0 || i < book.worstBid) book.worstBid = i;
+    }
+    for (int k = 0; k < offerCount; ++k) {
+        int i = (int)(offers[k].tick - book.baseTick);
+        if (i < 0 || i >= BOOK_LEVELS || offers[k].quantity <= 0) continue;
+        book.offers[i] += offers[k].quantity;
+        if (book.bestOffer < 0 || i < book.bestOffer) book.bestOffer = i;
+        if (book.worstOffer < 0 || i > book.worstOffer) book.worstOffer = i;
+    }
+}
+
+void VenueSimulator::NewOrder(VenueOrder& order) {
+    auto it = books.find(order.productId);
+    if (it == books.end()) {
+        // no market for this product yet
+        Report(order, order.tick, 0, true);
+        return;
+    }
+    VenueBook& book = it->second;
+
+    switch (order.orderType) {
+    case MARKET:
+        Match(book, order, true);
+        if (order.quantity > 0) Report(order, order.tick, 0, true);
+        break;
+    case IOC:
+        Match(book, order, false);
+        if (order.quantity > 0) Report(order, order.tick, 0, true);
+        break;
+    case FOK:
+        if (Available(book, order) >= order.quantity) Match(book, order, false);
+        else Report(order, order.tick, 0, true);
+        break;
+    case LIMIT:
+        Match(book, order, false);
+        if (order.quantity > 0) {
+            // join the queue behind what is displayed at our price
+            int i = (int)(order.tick - book.baseTick);
+            if (i < 0 || i >= BOOK_LEVELS) {
+                Report(order, order.tick, 0, true);
+                break;
+            }
+            order.queueAhead = (order.side == BID) ? book.bids[i] : book.offers[i];
+            order.resting = true;
+            book.resting.push_back(order);
+        }
+        break;
+    case STOP:
+        order.resting = true;
+        book.resting.push_back(order);
+        CheckResting(book);
+        break;
+    }
+}
+
+// fill resting limits that became marketable and trigger stops
+void VenueSimulator::CheckResting(VenueBook& book) {
+    if (book.resting.empty()) return;
+
+    double mid = (book.bestBid >= 0 && book.bestOffer >= 0) ? (book.bestBid + book.bestOffer) / 2.0 : -1;
+    size_t kept = 0;
+    for (size_t k = 0; k < book.resting.size(); ++k) {
+        VenueOrder& order = book.resting[k];
+        long i = order.tick - book.baseTick;
+
+        if (order.orderType == STOP) {
+            bool triggered = mid >= 0 && ((order.side == BID && mid >= i) || (order.side == OFFER && mid <= i));
+            if (triggered) {
+                Match(book, order, true);
+                if (order.quantity > 0) Report(order, order.tick, 0, true);
+                continue;
+            }
+        }
+        else {
+            // liquidity crossing our price trades with the queue ahead of us first
+            if (order.queueAhead > 0) {
+                VenueOrder ahead = order;
+                ahead.quantity = order.queueAhead;
+                order.queueAhead -= Match(book, ahead, false, false);
+            }
+            if (order.queueAhead == 0) Match(book, order, false);
+            if (order.quantity > 0 && i >= 0 && i < BOOK_LEVELS) {
+                long displayed = (order.side == BID) ? book.bids[i] : book.offers[i];
+                order.queueAhead = min(order.queueAhead, displayed);
+            }
+            if (order.quantity == 0) continue;
+        }
+        if (kept != k) book.resting[kept] = book.resting[k];
+        ++kept;
+    }
+    book.resting.resize(kept);
+}
+
+// quantity available to the order up to its limit
+long VenueSimulator::Available(const VenueBook& book, const VenueOrder& order) const {
+    long total = 0;
+    long limit = order.tick - book.baseTick;
+    if (order.side == BID) {
+        for (int i = book.bestOffer; i >= 0 && i <= book.worstOffer && i <= limit; ++i) total += book.offers[i];
+    }
+    else {
+        for (int i = book.bestBid; i >= 0 && i >= book.worstBid && i >= limit; --i) total += book.bids[i];
+    }
+    return total;
+}
+
+// take liquidity level by level, one report per level unless report is false, returns the quantity filled
+long VenueSimulator::Match(VenueBook& book, VenueOrder& order, bool anyPrice, bool report) {
+    long filled = 0;
+    long limit = order.tick - book.baseTick;
+
+    if (order.side == BID) {
+        while (order.quantity > 0 && book.bestOffer >= 0 && book.bestOffer <= book.worstOffer && (anyPrice || book.bestOffer <= limit)) {
+            long& level = book.offers[book.bestOffer];
+            long qty = min(level, order.quantity);
+            if (qty > 0) {
+                level -= qty;
+                order.quantity -= qty;
+                filled += qty;
+                if (report) Report(order, book.bestOffer + book.baseTick, qty, order.quantity == 0);
+            }
+            if (level == 0) ++book.bestOffer;
+        }
+        if (book.bestOffer > book.worstOffer) book.bestOffer = book.worstOffer = -1;
+    }
+    else {
+        while (order.quantity > 0 && book.bestBid >= 0 && book.bestBid >= book.worstBid && (anyPrice || book.bestBid >= limit)) {
+            long& level = book.bids[book.bestBid];
+            long qty = min(level, order.quantity);
+            if (qty > 0) {
+                level -= qty;
+                order.quantity -= qty;
+                filled += qty;
+                if (report) Report(order, book.bestBid + book.baseTick, qty, order.quantity == 0);
+            }
+            if (level == 0) --book.bestBid;
+        }
+        if (book.bestBid < book.worstBid) book.bestBid = book.worstBid = -1;
+    }
+    return filled;
+}
+
+void VenueSimulator::Report(const VenueOrder& order, long tick, long quantity, bool isDone) {
+    VenueFill fill;
+    fill.orderId = order.orderId;
+    fill.productId = order.productId;
+    fill.tradeId = quantity > 0 ? NextTradeId() : "";
+    fill.side = order.side;
+    fill.price = ToPrice(tick);
+    fill.quantity = quantity;
+    fill.leavesQuantity = isDone ? 0 : order.quantity;
+    fill.isDone = isDone;
+    fill.passive = order.resting;
+    fill.submitTime = order.submitTime;
+    fill.reportTime = NowNanos();
+    // never block the matching: park the report if the execution service is behind
+    if (backlogHead != backlog.size() || !fills.TryPush(fill)) backlog.push_back(fill);
+}
+
+void VenueSimulator::FlushBacklog() {
+    while (backlogHead < backlog.size() && fills.TryPush(backlog[backlogHead])) ++backlogHead;
+    if (backlogHead == backlog.size()) {
+        backlog.clear();
+        backlogHead = 0;
+    }
+}
+
+// 12 character trade id: venue prefix + sequence
+string VenueSimulator::NextTradeId() {
+    string prefix = (market == BROKERTEC) ? "BT" : (market == ESPEED) ? "ES" : "CM";
+    return prefix + IdGenerator(tradeCount++, 10);
+}
+
+#endif
@@ -0,0 +1,156 @@
+/**
+* WorkStealingPool.hpp
+* Definition of WorkStealingPool class
+*
+* Fixed set of worker threads for data-parallel batch jobs. ParallelFor
+* cuts a range into chunks dealt round-robin onto one deque per thread
+* (the caller takes part as the last one). A thread works its own deque
+* from the back and, when it runs dry, steals from the front of the
+* others, so uneven chunks even out across the cores. One ParallelFor
+* runs at a time; workers sleep between jobs.
+*
+* @Yunze Sun
+*/
+
+#ifndef WorkStealingPool_h
+#define WorkStealingPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+class WorkStealingPool {
+public:
+    // ctor, threads including the caller, 0 for every core
+    WorkStealingPool(int threads = 0);
+    ~WorkStealingPool();
+
+    // body(begin, end) over [begin, end) in chunks of grain, returns when all are done
+    void ParallelFor(long begin, long end, long grain, const function<void(long, long)>& body);
+
+    int Size() const { return (int)queues.size(); }
+    long GetSteals() const { return steals.load(); }
+    long GetChunks() const { return chunks; }
+
+private:
+    struct Queue {
+        mutex lock;
+        deque<pair<long, long> > tasks;
+    };
+
+    vector<unique_ptr<Queue> > queues;
+    vector<thread> workers;
+
+    mutex jobLock; // one ParallelFor at a time
+    mutex wakeLock;
+    condition_variable wake;
+    long generation;
+    bool stop;
+
+    const function<void(long, long)>* body;
+    atomic<long> remaining;
+    atomic<long> steals;
+    long chunks;
+
+    // run one chunk, own deque first then steal, false if nothing was left
+    bool RunOne(int self);
+    void Work(int self);
+};
+
+
+WorkStealingPool::WorkStealingPool(int threads)
+    : generation(0), stop(false), body(nullptr), remaining(0), steals(0), chunks(0)
+{
+    if (threads <= 0) threads = max(1, (int)thread::hardware_concurrency());
+    for (int i = 0; i < threads; ++i) queues.push_back(unique_ptr<Queue>(new Queue()));
+    for (int i = 0; i < threads - 1; ++i) workers.push_back(thread(&WorkStealingPool::Work, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> guard(wakeLock);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void WorkStealingPool::ParallelFor(long begin, long end, long grain, const function<void(long, long)>& _body) {
+    if (end <= begin) return;
+    lock_guard<mutex> job(jobLock);
+    if (grain < 1) grain = 1;
+    int n = Size();
+
+    // body and count go first, a worker still spinning from the last job may pick up a chunk at once
+    long count = (end - begin + grain - 1) / grain;
+    body = &_body;
+    remaining.store(count);
+    chunks += count;
+    for (long i = 0; i < count; ++i) {
+        Queue& q = *queues[i % n];
+        long lo = begin + i * grain;
+        lock_guard<mutex> guard(q.lock);
+        q.tasks.push_back(pair<long, long>(lo, min(end, lo + grain)));
+    }
+    {
+        lock_guard<mutex> guard(wakeLock);
+        ++generation;
+    }
+    wake.notify_all();
+
+    // the caller works as the last thread until every chunk is done
+    while (remaining.load(memory_order_acquire) > 0) {
+        if (!RunOne(n - 1)) this_thread::yield();
+    }
+    body = nullptr;
+}
+
+bool WorkStealingPool::RunOne(int self) {
+    pair<long, long> task;
+    bool found = false;
+    int n = Size();
+    {
+        Queue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+    for (int k = 1; !found && k < n; ++k) {
+        Queue& victim = *queues[(self + k) % n];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            found = true;
+            steals.fetch_add(1, memory_order_relaxed);
+        }
+    }
+    if (!found) return false;
+    (*body)(task.first, task.second);
+    remaining.fetch_sub(1, memory_order_release);
+    return true;
+}
+
+void WorkStealingPool::Work(int self) {
+    long seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> guard(wakeLock);
+            wake.wait(guard, [&] { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+        }
+        while (RunOne(self)) {}
+    }
+}
+
+#endif
@@ -0,0 +1,869 @@
+//
+//  benchmark.cpp
+//
+//  MTH9815_Final_TradingSystem
+//  Throughput / latency benchmarks of the trading system components
+//
+//  @ Yunze_Sun
+//
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "products.hpp"
+#include "utility.h"
+#include "TimerWheel.hpp"
+#include "AlgoExecutionEngine.hpp"
+#include "PreTradeRiskGate.hpp"
+#include "SmartOrderRouter.hpp"
+#include "PriceStreamRing.hpp"
+#include "QuoteTierGenerator.hpp"
+#include "QuoteDeltaEncoder.hpp"
+#include "BondCurveService.hpp"
+#include "BondAnalytics.hpp"
+#include "BondPositionService.hpp"
+#include "PositionMatrix.hpp"
+#include "CurveScenarioEngine.hpp"
+#include "BondPnLService.hpp"
+#include "KeyRateRisk.hpp"
+#include "PV01HedgingEngine.hpp"
+#include "BondTradeBookingService.hpp"
+#include "BondRiskService.hpp"
+#include "BondHistoricalDataService.hpp"
+#include "TradeJournal.hpp"
+#include "FixedString.hpp"
+#include "BondInquiryService.hpp"
+#include "InquiryQuotingEngine.hpp"
+#include <cstdio>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+using namespace std::chrono;
+
+// Parent/child execution engine: numParents concurrent parents on one product,
+// every child filled in two halves, timer turned in 1ms steps until all parents are done
+void BenchmarkAlgoEngine(int numParents)
+{
+    Bond bond = GetBond("9128283F5");
+    TimerWheel timer(EVENT_TIME);
+    vector<pair<string, long> > fills;
+    fills.reserve(numParents * 4);
+    long numChildren = 0;
+    AlgoExecutionEngine<Bond> engine(&timer, [&](ExecutionOrder<Bond>& child) {
+        ++numChildren;
+        fills.push_back(pair<string, long>(child.GetOrderId(), child.GetVisibleQuantity()));
+    }, numParents);
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < numParents; ++i) {
+        AlgoSchedule schedule;
+        schedule.algoType = (i % 3 == 0) ? TWAP : (i % 3 == 1) ? VWAP : ICEBERG;
+        schedule.duration = 1000;
+        schedule.numSlices = 10;
+        schedule.volumeProfile = { 1, 2, 3, 4, 5, 5, 4, 3, 2, 1 };
+        schedule.displayQuantity = 1000000;
+        engine.AddParentOrder(bond, i % 2 ? BID : OFFER, 100.0, 10000000, schedule);
+    }
+
+    long events = 0;
+    long long now = 0;
+    while (engine.GetWorkingParents() > 0) {
+        vector<pair<string, long> > batch;
+        batch.swap(fills);
+        for (auto& fill : batch) {
+            engine.OnChildFill(fill.first, fill.second / 2);
+            engine.OnChildFill(fill.first, fill.second - fill.second / 2);
+            events += 2;
+        }
+        if (batch.empty()) timer.AdvanceTo(++now);
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "AlgoExecutionEngine: " << numParents << " parents, " << numChildren << " children, "
+        << events << " fills in " << secs * 1000 << " ms -> "
+        << (events + numChildren) / secs / 1e6 << " M events/s" << endl;
+}
+
+// Pre-trade risk gate: numChecks orders spread over the 7 bonds, a position
+// update every 8th order, tight enough limits that some orders are rejected
+void BenchmarkPreTradeRisk(int numChecks)
+{
+    vector<string> cusips = { "9128283H1", "9128283L2", "912828M80", "9128283J7", "9128283F5", "912810TM0", "912810RZ3" };
+    vector<string> books = { "TRSY1", "TRSY2", "TRSY3" };
+    vector<Bond> bonds;
+    for (auto& cusip : cusips) bonds.push_back(GetBond(cusip));
+
+    BondAnalyticsEngine analytics(bonds);
+    PreTradeRiskGate gate(bonds, books, &analytics);
+    for (auto& cusip : cusips) gate.SetProductLimits(cusip, 20000000, 3000000.0, 25000.0);
+    for (auto& book : books) gate.SetBookLimit(book, 10000000);
+    gate.SetRateLimit(1e9, 1000.0);
+
+    vector<int> index;
+    for (auto& cusip : cusips) index.push_back(gate.GetProductIndex(cusip));
+
+    long passed = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < numChecks; ++i) {
+        int p = i % 7;
+        if ((i & 7) == 0) gate.UpdatePosition(cusips[p], books[i % 3], (i % 23 - 11) * 1000000L);
+        long long now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        if (gate.Check(index[p], i % 2 ? BID : OFFER, 99.5, 1000000 * (1 + i % 4), now) == RISK_PASS) ++passed;
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "PreTradeRiskGate: " << numChecks << " checks, " << passed << " passed in " << secs * 1000 << " ms -> "
+        << secs * 1e9 / numChecks << " ns/check" << endl;
+    gate.PrintRejectionReport(cout);
+}
+
+// Smart order router: a book update every 4th order, orders of 1-8MM against
+// 1-5MM at the touch, fills coming back at venue dependent rates
+void BenchmarkRouter(int numOrders)
+{
+    vector<string> cusips = { "9128283H1", "9128283L2", "912828M80", "9128283J7", "9128283F5", "912810TM0", "912810RZ3" };
+    vector<Bond> bonds;
+    for (auto& cusip : cusips) bonds.push_back(GetBond(cusip));
+    double fillRates[SmartOrderRouter::VENUES] = { 0.95, 0.9, 0.7 };
+
+    SmartOrderRouter router;
+    RouteSlice slices[SmartOrderRouter::VENUES];
+    long numSlices = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < numOrders; ++i) {
+        const Bond& bond = bonds[i % 7];
+        if ((i & 3) == 0) {
+            for (int v = 0; v < SmartOrderRouter::VENUES; ++v) {
+                router.UpdateDepth((Market)v, bond.GetProductId(), 1000000L * (1 + (i + v) % 5), 1000000L * (1 + (i + 2 * v) % 5));
+            }
+        }
+        ExecutionOrder<Bond> order(bond, i % 2 ? BID : OFFER, "A", IOC, 99.5, 1000000.0 * (1 + i % 8), 0, "", false);
+        int count = router.Route(order, slices);
+        numSlices += count;
+        for (int s = 0; s < count; ++s) {
+            router.OnFill(slices[s].market, (long)(slices[s].quantity * fillRates[slices[s].market]));
+        }
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "SmartOrderRouter: " << numOrders << " orders, " << numSlices << " slices in " << secs * 1000 << " ms -> "
+        << secs * 1e9 / numOrders << " ns/order" << endl;
+    for (int v = 0; v < SmartOrderRouter::VENUES; ++v) {
+        cout << "	venue " << v << "	routed: " << router.GetRouted((Market)v) << "	fill rate: " << router.GetFillRate((Market)v) << endl;
+    }
+}
+
+// Shared-memory price stream: one writer publishing numRecords quotes, at ratePerSecond or
+// as fast as it can if 0, numReaders readers each on their own mapping of the segment, as
+// separate processes would be
+void BenchmarkPriceStreamRing(int numRecords, int numReaders, double ratePerSecond)
+{
+    string name = "/bond_price_stream_bench";
+    PriceStreamShmPublisher publisher(name, 1 << 14);
+    if (!publisher.IsOpen()) {
+        cout << "PriceStreamRing: cannot open " << name << endl;
+        return;
+    }
+    Bond bond = GetBond("9128283H1");
+    PriceStream<Bond> stream(bond, PriceStreamOrder(99.99, 1000000, 2000000, BID), PriceStreamOrder(100.01, 1000000, 2000000, OFFER));
+
+    atomic<bool> done(false);
+    atomic<int> ready(0);
+    vector<long> reads(numReaders, 0), lost(numReaders, 0);
+    vector<double> lag(numReaders, 0), maxLag(numReaders, 0);
+    vector<thread> readers;
+    for (int r = 0; r < numReaders; ++r) {
+        readers.push_back(thread([&, r]() {
+            PriceStreamShmReader reader(name, true);
+            PriceStreamRecord record;
+            ++ready;
+            while (true) {
+                bool finished = done.load(memory_order_acquire);
+                if (reader.Read(record)) {
+                    long long now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+                    double l = (double)(now - record.publishTime);
+                    lag[r] += l;
+                    maxLag[r] = max(maxLag[r], l);
+                    ++reads[r];
+                }
+                else if (finished) break;
+            }
+            lost[r] = (long)reader.GetLost();
+        }));
+    }
+    while (ready.load() < numReaders) this_thread::yield();
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < numRecords; ++i) {
+        if (ratePerSecond > 0) {
+            auto due = start + nanoseconds((long long)(i * 1e9 / ratePerSecond));
+            while (steady_clock::now() < due) {}
+        }
+        publisher.Publish(stream);
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+    done.store(true, memory_order_release);
+    for (auto& t : readers) t.join();
+    publisher.Unlink();
+
+    cout << "PriceStreamRing: " << numRecords << " records in " << secs * 1000 << " ms -> "
+        << numRecords / secs / 1e6 << " M records/s, " << numReaders << " readers" << endl;
+    for (int r = 0; r < numReaders; ++r) {
+        cout << "\treader " << r << "\tread: " << reads[r] << "\tlost: " << lost[r]
+            << "\tavg lag (ns): " << (reads[r] ? lag[r] / reads[r] : 0) << "\tmax lag (ns): " << maxLag[r] << endl;
+    }
+}
+
+// Quote tiers: numQuotes multi-tier quotes with 1 to MAX_QUOTE_TIERS tiers, skewed
+void BenchmarkQuoteTiers(int numQuotes)
+{
+    QuoteSkew skew = { 1.0 / 256.0, 1.0 / 512.0, 0.8, 1.2 };
+    for (int count = 1; count <= MAX_QUOTE_TIERS; count *= 2) {
+        TierSchedule schedule = QuoteTierGenerator::SingleTier();
+        schedule.count = count;
+        for (int i = 0; i < count; ++i) {
+            schedule.spreadMultiplier[i] = 1.0 + i;
+            schedule.sizeMultiplier[i] = 1.0 + 2 * i;
+        }
+        QuoteTierGenerator generator(schedule);
+        ProductId id("9128283H1");
+        QuoteTiers tiers;
+        double checksum = 0;
+        auto start = steady_clock::now();
+        for (int q = 0; q < numQuotes; ++q) {
+            generator.Generate(id, 99.5 + (q & 255) / 256.0, 1.0 / 128.0, q % 2 ? 1000000 : 2000000, &skew, tiers);
+            checksum += tiers.bidPrice[count - 1] + tiers.offerQuantity[count - 1];
+        }
+        double secs = duration<double>(steady_clock::now() - start).count();
+        cout << "QuoteTierGenerator: " << count << " tiers, " << numQuotes << " quotes in " << secs * 1000 << " ms -> "
+            << secs * 1e9 / numQuotes << " ns/quote (checksum " << checksum << ")" << endl;
+    }
+}
+
+// Quote deltas: numQuotes four-tier quotes round-robin over the 7 bonds, a bond's price moves a
+// tick on every moveEvery-th of its quotes and its sizes on every 4th move, repeats in between.
+// Every message is decoded onto a reader's state of the bond and checked against the quote
+void BenchmarkQuoteDelta(int numQuotes, int moveEvery)
+{
+    vector<string> cusips = { "9128283H1", "9128283L2", "912828M80", "9128283J7", "9128283F5", "912810TM0", "912810RZ3" };
+    vector<PriceStream<Bond> > streams;
+    for (auto& cusip : cusips) {
+        streams.push_back(PriceStream<Bond>(GetBond(cusip), PriceStreamOrder(99.5, 1000000, 2000000, BID), PriceStreamOrder(99.5 + 1.0 / 128.0, 1000000, 2000000, OFFER)));
+    }
+    vector<QuoteState> readers(cusips.size());
+    QuoteTierGenerator generator(QuoteTierGenerator::DefaultTiers());
+    QuoteTiers tiers;
+
+    QuoteDeltaEncoder encoder;
+    long mismatches = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < numQuotes; ++i) {
+        int p = i % 7;
+        int n = i / 7;
+        if (n % moveEvery == 0) {
+            int move = n / moveEvery;
+            generator.Generate(cusips[p], 99.5 + (move % 64) / 256.0, 1.0 / 128.0, 1000000L * (1 + (move / 4) % 3), nullptr, tiers);
+            streams[p] = PriceStream<Bond>(streams[p].GetProduct(), PriceStreamOrder(tiers.bidPrice[0], tiers.bidQuantity[0], 2 * tiers.bidQuantity[0], BID),
+                PriceStreamOrder(tiers.offerPrice[0], tiers.offerQuantity[0], 2 * tiers.offerQuantity[0], OFFER));
+            streams[p].SetTiers(tiers);
+        }
+
+        size_t length = encoder.Encode(streams[p]);
+        if (length == 0) continue;
+
+        QuoteDeltaHeader header;
+        QuoteState& state = readers[p];
+        if (!QuoteDeltaEncoder::Decode(encoder.Data(), length, state, header)) ++mismatches;
+        else if (state.bidPrice != streams[p].GetBidOrder().GetPrice() || state.bidVisible != streams[p].GetBidOrder().GetVisibleQuantity()
+            || state.offerPrice != streams[p].GetOfferOrder().GetPrice() || state.offerHidden != streams[p].GetOfferOrder().GetHiddenQuantity()) ++mismatches;
+        else {
+            const QuoteTiers& quoted = streams[p].GetTiers();
+            for (int t = 1; t < quoted.count; ++t) {
+                if (state.tierBidPrice[t] != quoted.bidPrice[t] || state.tierOfferQuantity[t] != quoted.offerQuantity[t]) {
+                    ++mismatches;
+                    break;
+                }
+            }
+        }
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "QuoteDeltaEncoder: " << numQuotes << " quotes, move every " << moveEvery << ": " << encoder.GetPublished() << " published, "
+        << encoder.GetSuppressed() << " suppressed (" << encoder.GetSuppressionRatio() * 100 << "%)\tdelta bytes: " << encoder.GetBytes()
+        << " (avg " << encoder.GetAverageBytes() << " of " << QuoteDeltaEncoder::MAX_MESSAGE << ")\t" << secs * 1e9 / numQuotes
+        << " ns/quote encoded and decoded\tmismatches: " << mismatches << endl;
+}
+
+// Curve refit: numBonds bonds (the 7 on-the-run ones, or a synthetic universe with coupons
+// 1-5% and maturities up to 30y) priced off an NSS curve plus noise, then numTicks ticks
+// each moving one bond and refitting warm-started
+void BenchmarkCurveFit(int numBonds, int numTicks)
+{
+    date settlement = from_string(DEFAULT_SETTLEMENT_DATE);
+    vector<Bond> bonds;
+    if (numBonds == 7) {
+        for (auto& cusip : { "9128283H1", "9128283L2", "912828M80", "9128283J7", "9128283F5", "912810TM0", "912810RZ3" }) {
+            bonds.push_back(GetBond(cusip));
+        }
+    }
+    else {
+        for (int i = 0; i < numBonds; ++i) {
+            float coupon = 0.01f + 0.00125f * (i % 33);
+            date maturity = settlement + months(3 + (i * 357) / numBonds);
+            bonds.push_back(Bond("B" + IdGenerator(i, 8), CUSIP, "UST", coupon, maturity));
+        }
+    }
+
+    // market prices from a known curve
+    vector<CashflowSchedule> schedules;
+    for (auto& bond : bonds) schedules.push_back(BuildCashflowSchedule(bond, settlement));
+    double beta[4] = { 0.028, -0.01, 0.005, 0.01 };
+    vector<double> prices;
+    for (auto& s : schedules) {
+        double dirty = 0;
+        for (size_t k = 0; k < s.times.size(); ++k) {
+            double t = s.times[k];
+            double e1 = exp(-t / 2.0), e2 = exp(-t / 10.0);
+            double f1 = (1 - e1) / (t / 2.0), f3 = (1 - e2) / (t / 10.0) - e2;
+            double z = beta[0] + beta[1] * f1 + beta[2] * (f1 - e1) + beta[3] * f3;
+            dirty += s.amounts[k] * exp(-z * t);
+        }
+        prices.push_back(dirty - s.accrued);
+    }
+
+    NssCurveFitter fitter;
+    for (size_t i = 0; i < bonds.size(); ++i) {
+        fitter.AddBond(schedules[i], bonds[i].GetCoupon());
+        fitter.SetMarketPrice((int)i, prices[i]);
+    }
+    int coldIterations = fitter.Fit();
+
+    long iterations = 0;
+    unsigned int seed = 12345;
+    auto start = steady_clock::now();
+    for (int tick = 0; tick < numTicks; ++tick) {
+        seed = seed * 1103515245u + 12345u;
+        int i = (seed >> 8) % bonds.size();
+        double noise = ((int)((seed >> 4) % 9) - 4) / 256.0;
+        fitter.SetMarketPrice(i, prices[i] + noise);
+        iterations += fitter.Fit();
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "NssCurveFitter: " << bonds.size() << " bonds, cold fit " << coldIterations << " iterations, "
+        << numTicks << " refits in " << secs * 1000 << " ms -> " << secs * 1e6 / numTicks << " us/refit, "
+        << (double)iterations / numTicks << " iterations/refit, rmse " << fitter.GetRmse() << endl;
+}
+
+// Bond analytics: one price tick then a pv01 lookup, as BondRiskService::AddPosition sees it,
+// and a full re-solve of the universe after every bond moved; ticks stay within +-1/16 on the 1/256 grid
+void BenchmarkBondAnalytics(int numBonds, int numTicks, int cacheSlots)
+{
+    date settlement = from_string(DEFAULT_SETTLEMENT_DATE);
+    vector<Bond> bonds;
+    vector<string> ids;
+    for (int i = 0; i < numBonds; ++i) {
+        float coupon = 0.01f + 0.00125f * (i % 33);
+        date maturity = settlement + months(3 + (i * 357) / numBonds);
+        bonds.push_back(Bond("B" + IdGenerator(i, 8), CUSIP, "UST", coupon, maturity));
+        ids.push_back(bonds.back().GetProductId());
+    }
+    BondAnalyticsEngine engine(bonds, settlement, cacheSlots);
+    for (int i = 0; i < numBonds; ++i) engine.SetPrice(ids[i], 100.0);
+    engine.Evaluate();
+
+    double sum = 0;
+    unsigned int seed = 12345;
+    auto start = steady_clock::now();
+    for (int tick = 0; tick < numTicks; ++tick) {
+        seed = seed * 1103515245u + 12345u;
+        int i = (seed >> 8) % numBonds;
+        engine.SetPrice(ids[i], 100.0 + ((int)((seed >> 4) % 33) - 16) / 256.0);
+        sum += engine.GetPV01(ids[i]);
+    }
+    double tickSecs = duration<double>(steady_clock::now() - start).count();
+
+    // cached lookups, no price change in between
+    start = steady_clock::now();
+    for (int tick = 0; tick < numTicks; ++tick) sum += engine.GetPV01(ids[tick % numBonds]);
+    double lookupSecs = duration<double>(steady_clock::now() - start).count();
+
+    int rounds = max(1, numTicks / numBonds);
+    start = steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (int i = 0; i < numBonds; ++i) engine.SetPrice(ids[i], 100.0 + ((round + i) % 17 - 8) / 256.0);
+        engine.Evaluate();
+    }
+    double fullSecs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "BondAnalyticsEngine: " << numBonds << " bonds, cache " << cacheSlots << " slots (hit rate "
+        << engine.GetCache().GetHitRate() * 100 << "%), tick + pv01 " << tickSecs * 1e9 / numTicks << " ns, cached pv01 "
+        << lookupSecs * 1e9 / numTicks << " ns, full universe " << fullSecs * 1e6 / rounds << " us ("
+        << fullSecs * 1e9 / rounds / numBonds << " ns/bond)\t(checksum " << sum << ")" << endl;
+}
+
+// Position keeping: numTrades trades over numBooks x numBonds through BondPositionService, a listener
+// reading the aggregate as BondRiskService does; against the old design, a map of books copied per trade
+// and summed for the aggregate
+class AggregateReader : public ServiceListener<Position<Bond> > {
+public:
+    long sum = 0;
+    void ProcessAdd(Position<Bond>& data) override { sum += data.GetAggregatePosition(); }
+    void ProcessRemove(Position<Bond>& data) override {}
+    void ProcessUpdate(Position<Bond>& data) override {}
+};
+
+void BenchmarkPositions(int numBooks, int numBonds, int numTrades)
+{
+    date maturity = from_string(DEFAULT_SETTLEMENT_DATE) + years(5);
+    vector<Bond> bonds;
+    for (int i = 0; i < numBonds; ++i) bonds.push_back(Bond("P" + IdGenerator(i, 8), CUSIP, "UST", 0.02f, maturity));
+    vector<string> books;
+    for (int i = 0; i < numBooks; ++i) books.push_back("BOOK" + IdGenerator(i, 4));
+    vector<Trade<Bond> > trades;
+    trades.reserve(numTrades);
+    unsigned int seed = 12345;
+    for (int i = 0; i < numTrades; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        trades.push_back(Trade<Bond>(bonds[(seed >> 8) % numBonds], "T", 99.5, books[(seed >> 4) % numBooks],
+            1000000L * (1 + (seed >> 20) % 5), (seed >> 28) & 1 ? BUY : SELL));
+    }
+
+    BondPositionService service;
+    AggregateReader reader;
+    service.AddListener(&reader);
+    auto start = steady_clock::now();
+    for (auto& trade : trades) service.AddTrade(trade);
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    map<string, map<string, long> > legacy;
+    long legacySum = 0;
+    start = steady_clock::now();
+    for (auto& trade : trades) {
+        map<string, long> pos = legacy[trade.GetProduct().GetProductId()];
+        pos[trade.GetBook()] += trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity();
+        legacy[trade.GetProduct().GetProductId()] = pos;
+        for (auto& book : pos) legacySum += book.second;
+    }
+    double legacySecs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "BondPositionService: " << numBooks << " books x " << numBonds << " bonds, " << numTrades << " trades -> "
+        << secs * 1e9 / numTrades << " ns/trade (copied map of books: " << legacySecs * 1e9 / numTrades << " ns/trade)"
+        << (reader.sum == legacySum ? "" : " MISMATCH") << endl;
+}
+
+// Position matrix roll-ups over numBooks x numProducts, three sectors over the products
+void BenchmarkPositionMatrix(int numBooks, int numProducts, int numRounds)
+{
+    date maturity = from_string(DEFAULT_SETTLEMENT_DATE) + years(5);
+    vector<Bond> bonds;
+    for (int i = 0; i < numProducts; ++i) bonds.push_back(Bond("M" + IdGenerator(i, 8), CUSIP, "UST", 0.02f, maturity));
+    PositionMatrix matrix(bonds, numBooks);
+    vector<Bond> sectors[3];
+    for (int i = 0; i < numProducts; ++i) sectors[i * 3 / numProducts].push_back(bonds[i]);
+    for (int k = 0; k < 3; ++k) matrix.AddSector(BucketedSector<Bond>(sectors[k], "S" + IdGenerator(k, 1)));
+    vector<double> pv01(numProducts);
+    for (int i = 0; i < numProducts; ++i) pv01[i] = 0.0001 * (1 + i % 30);
+
+    unsigned int seed = 12345;
+    long long expected = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < 1000000; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        long long quantity = 1000000LL * ((int)((seed >> 20) % 11) - 5);
+        matrix.AddPosition((seed >> 4) % numBooks, (seed >> 8) % numProducts, quantity);
+        expected += quantity;
+    }
+    double addSecs = duration<double>(steady_clock::now() - start).count();
+
+    vector<long long> totals;
+    vector<double> risks;
+    long long check = 0;
+    double times[6] = {};
+    for (int r = 0; r < numRounds; ++r) {
+        auto t0 = steady_clock::now();
+        matrix.RollupBooks(totals);
+        auto t1 = steady_clock::now();
+        matrix.RollupProducts(totals);
+        auto t2 = steady_clock::now();
+        matrix.RollupSectors(totals);
+        auto t3 = steady_clock::now();
+        check += matrix.RollupFirm();
+        auto t4 = steady_clock::now();
+        matrix.RollupBookRisk(pv01, risks);
+        auto t5 = steady_clock::now();
+        matrix.RollupSectorRisk(pv01, risks);
+        auto t6 = steady_clock::now();
+        times[0] += duration<double>(t1 - t0).count();
+        times[1] += duration<double>(t2 - t1).count();
+        times[2] += duration<double>(t3 - t2).count();
+        times[3] += duration<double>(t4 - t3).count();
+        times[4] += duration<double>(t5 - t4).count();
+        times[5] += duration<double>(t6 - t5).count();
+    }
+
+    cout << "PositionMatrix: " << numBooks << " books x " << numProducts << " products, add " << addSecs * 1e3 << " ns, roll-ups (us): by book "
+        << times[0] * 1e6 / numRounds << "\tby product " << times[1] * 1e6 / numRounds << "\tby sector " << times[2] * 1e6 / numRounds
+        << "\tfirm " << times[3] * 1e6 / numRounds << "\tbook pv01 " << times[4] * 1e6 / numRounds << "\tsector pv01 " << times[5] * 1e6 / numRounds
+        << (check == expected * numRounds ? "" : "\tMISMATCH") << endl;
+}
+
+// Stress run: the standard scenario set over numBonds held bonds out to 30y on numThreads threads
+void BenchmarkScenarios(int numBonds, int numThreads)
+{
+    date settlement = from_string(DEFAULT_SETTLEMENT_DATE);
+    vector<Bond> bonds;
+    vector<Bond> sectors[3];
+    for (int i = 0; i < numBonds; ++i) {
+        float coupon = 0.01f + 0.00125f * (i % 33);
+        date maturity = settlement + months(3 + (i * 357) / numBonds);
+        bonds.push_back(Bond("S" + IdGenerator(i, 8), CUSIP, "UST", coupon, maturity));
+        sectors[i * 3 / numBonds].push_back(bonds.back());
+    }
+    BondAnalyticsEngine analytics(bonds, settlement);
+    WorkStealingPool pool(numThreads);
+    CurveScenarioEngine engine(bonds, &analytics, &pool, settlement);
+    engine.AddBucket(BucketedSector<Bond>(sectors[0], "FrontEnd"));
+    engine.AddBucket(BucketedSector<Bond>(sectors[1], "Belly"));
+    engine.AddBucket(BucketedSector<Bond>(sectors[2], "LongEnd"));
+    for (int i = 0; i < numBonds; ++i) {
+        analytics.SetPrice(bonds[i].GetProductId(), 99.0 + (i % 65) / 32.0);
+        engine.SetPosition(bonds[i].GetProductId(), 1000000L * ((i % 21) - 10));
+    }
+    analytics.Evaluate();
+
+    vector<CurveScenario> scenarios = CurveScenarioEngine::StandardScenarios();
+    ScenarioPnL pnl = engine.Run(scenarios);
+    int worst = pnl.Worst((int)pnl.buckets.size() - 1);
+    cout << "CurveScenarioEngine: " << numBonds << " bonds x " << scenarios.size() << " scenarios on " << pool.Size() << " threads in "
+        << engine.GetLastRunTime() * 1000 << " ms (" << pool.GetSteals() << " steals), worst " << pnl.scenarios[worst]
+        << " " << pnl.Get(worst, (int)pnl.buckets.size() - 1) << endl;
+}
+
+// Intraday P&L: numEvents trades and ticks (one trade per three ticks) over 100 bonds and 10 books,
+// 100k events/s of event time, snapshots every 100ms or on every event
+void BenchmarkPnL(int numEvents, bool conflate)
+{
+    date maturity = from_string(DEFAULT_SETTLEMENT_DATE) + years(5);
+    vector<Bond> bonds;
+    for (int i = 0; i < 100; ++i) bonds.push_back(Bond("L" + IdGenerator(i, 8), CUSIP, "UST", 0.02f, maturity));
+    vector<string> books;
+    for (int i = 0; i < 10; ++i) books.push_back("PNL" + IdGenerator(i, 2));
+    vector<Trade<Bond> > trades;
+    unsigned int seed = 12345;
+    for (int i = 0; i < 4096; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        trades.push_back(Trade<Bond>(bonds[(seed >> 8) % 100], "T", 99.0 + ((seed >> 4) % 513) / 256.0, books[(seed >> 16) % 10],
+            1000000L * (1 + (seed >> 20) % 5), (seed >> 28) & 1 ? BUY : SELL));
+    }
+
+    TimerWheel timer(EVENT_TIME);
+    BondPnLService service(bonds, conflate ? &timer : nullptr, 100);
+    auto start = steady_clock::now();
+    for (int i = 0; i < numEvents; ++i) {
+        if ((i & 3) == 0) service.AddTrade(trades[(i >> 2) & 4095]);
+        else service.UpdateMark(bonds[i % 100].GetProductId(), 99.0 + (i % 513) / 256.0);
+        timer.AdvanceTo(i / 100);
+    }
+    service.Flush();
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "BondPnLService: " << numEvents << " events, " << (conflate ? "conflated" : "every update") << " -> "
+        << secs * 1e9 / numEvents << " ns/event, " << service.GetPublished() << " snapshots, total " << service.GetTotal() << endl;
+}
+
+// Key rate PV01: numUpdates position changes over numBonds bonds out to 30y, against rebuilding
+// the portfolio vector from every held bond
+void BenchmarkKeyRates(int numBonds, int numUpdates)
+{
+    date settlement = from_string(DEFAULT_SETTLEMENT_DATE);
+    vector<Bond> bonds;
+    for (int i = 0; i < numBonds; ++i) {
+        float coupon = 0.01f + 0.00125f * (i % 33);
+        date maturity = settlement + months(3 + (i * 357) / numBonds);
+        bonds.push_back(Bond("K" + IdGenerator(i, 8), CUSIP, "UST", coupon, maturity));
+    }
+    BondAnalyticsEngine analytics(bonds, settlement);
+    for (int i = 0; i < numBonds; ++i) analytics.SetPrice(bonds[i].GetProductId(), 99.0 + (i % 65) / 32.0);
+    analytics.Evaluate();
+    KeyRateRiskEngine engine(bonds, &analytics, settlement);
+
+    unsigned int seed = 12345;
+    auto start = steady_clock::now();
+    for (int i = 0; i < numUpdates; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        engine.UpdatePosition(bonds[(seed >> 8) % numBonds].GetProductId(), 1000000L * ((int)((seed >> 20) % 21) - 10));
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+    double incremental = engine.GetPortfolioPV01();
+
+    int rounds = 100;
+    start = steady_clock::now();
+    for (int r = 0; r < rounds; ++r) engine.Refresh();
+    double refreshSecs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "KeyRateRiskEngine: " << numBonds << " bonds, " << secs * 1e9 / numUpdates << " ns/position update, full rebuild "
+        << refreshSecs * 1e6 / rounds << " us, portfolio PV01 " << incremental << " (rebuilt " << engine.GetPortfolioPV01() << ")" << endl;
+}
+
+// PV01 hedge solve in the 7 benchmarks on numTicks random key rate books, keeping the
+// factorization between ticks or refactoring on every tick
+void BenchmarkHedgeSolver(int numTicks, bool reuse)
+{
+    date settlement = from_string(DEFAULT_SETTLEMENT_DATE);
+    vector<Bond> bonds;
+    for (int i = 0; i < KEY_RATES; ++i) {
+        bonds.push_back(Bond("H" + IdGenerator(i, 8), CUSIP, "UST", 0.02f + 0.0025f * i, settlement + years((int)KEY_RATE_TENORS[i])));
+    }
+    KeyRateRiskEngine risk(bonds, nullptr, settlement);
+    HedgeSolver solver(KEY_RATES);
+    double unit[KeyRateVector::LANES];
+    for (int j = 0; j < KEY_RATES; ++j) {
+        for (int i = 0; i < KEY_RATES; ++i) unit[i] = risk.GetBondKeyRates(bonds[j].GetProductId())->value[i] / 100.0;
+        solver.SetExposure(j, unit);
+        solver.SetPenalty(j, (1.0 / 25600.0) * (1.0 / 25600.0));
+    }
+
+    unsigned int seed = 12345;
+    double book[KeyRateVector::LANES], hedge[KeyRateVector::LANES];
+    double residual = 0, before = 0;
+    auto start = steady_clock::now();
+    for (int t = 0; t < numTicks; ++t) {
+        for (int i = 0; i < KEY_RATES; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            book[i] = ((int)((seed >> 8) % 20001) - 10000);
+        }
+        if (!reuse) solver.SetPenalty(t % KEY_RATES, solver.GetPenalty(t % KEY_RATES));
+        solver.Solve(book, hedge);
+        for (int i = 0; i < KEY_RATES; ++i) {
+            double r = book[i];
+            for (int j = 0; j < KEY_RATES; ++j) r += hedge[j] * solver.GetExposure(j)[i];
+            residual += fabs(r);
+            before += fabs(book[i]);
+        }
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "HedgeSolver: " << numTicks << " ticks, " << (reuse ? "factorization kept" : "refactored every tick") << " -> "
+        << secs * 1e9 / numTicks << " ns/tick, " << solver.GetFactorizations() << " factorizations, residual "
+        << residual / before * 100 << "% of the book PV01" << endl;
+}
+
+// Trades/s booked through trade booking and positions, with the PV01 risk and its historical
+// writer on or off; the writer goes to disk on every update or conflated to every 100ms of a
+// 100k trades/s stream
+void BenchmarkRiskPath(int numTrades, bool risk, bool conflate)
+{
+    vector<string> cusips = { "9128283H1", "9128283L2", "912828M80", "9128283J7", "9128283F5", "912810TM0", "912810RZ3" };
+    vector<Bond> bonds;
+    for (auto& cusip : cusips) bonds.push_back(GetBond(cusip));
+    vector<string> books = { "TRSY1", "TRSY2", "TRSY3" };
+    vector<Trade<Bond> > trades;
+    trades.reserve(numTrades);
+    unsigned int seed = 12345;
+    for (int i = 0; i < numTrades; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        trades.push_back(Trade<Bond>(bonds[(seed >> 8) % bonds.size()], "T" + IdGenerator(i, 11), 99.5, books[(seed >> 4) % books.size()],
+            1000000L * (1 + (seed >> 20) % 5), (seed >> 28) & 1 ? BUY : SELL));
+    }
+
+    TimerWheel timer(EVENT_TIME);
+    BondTradeBookingService booking;
+    BondPositionService positions;
+    BondPositionServiceListener positionListener(&positions);
+    booking.AddListener(&positionListener);
+    BondRiskService riskService;
+    BondRiskServiceListener riskListener(&riskService);
+    BondHistoricalRiskServiceConnector connector("benchmark_risk.txt");
+    BondHistoricalRiskService history(&connector, conflate ? &timer : nullptr, 100);
+    BondHistoricalRiskServiceListener historyListener(&history);
+    if (risk) {
+        positions.AddListener(&riskListener);
+        riskService.AddListener(&historyListener);
+    }
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < numTrades; ++i) {
+        booking.OnMessage(trades[i]);
+        timer.AdvanceTo(i / 100);
+    }
+    history.Flush();
+    double secs = duration<double>(steady_clock::now() - start).count();
+    remove("benchmark_risk.txt");
+
+    cout << "Risk path: " << numTrades << " trades, risk " << (risk ? (conflate ? "on, conflated" : "on, every update") : "off") << " -> "
+        << numTrades / secs << " trades/s, " << history.GetWritten() << " risk records written" << endl;
+}
+
+// Trade journal: numTrades bookings appended and looked up, against the map erase/insert store,
+// then the journal reopened and its index rebuilt
+void BenchmarkTradeJournal(int numTrades)
+{
+    vector<Bond> bonds = { GetBond("9128283H1"), GetBond("912828M80"), GetBond("9128283F5"), GetBond("912810RZ3") };
+    vector<string> books = { "TRSY1", "TRSY2", "TRSY3" };
+    vector<Trade<Bond> > trades;
+    trades.reserve(numTrades);
+    unsigned int seed = 12345;
+    for (int i = 0; i < numTrades; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        trades.push_back(Trade<Bond>(bonds[(seed >> 8) % bonds.size()], "BT" + IdGenerator(i, 10), 99.5, books[(seed >> 4) % books.size()],
+            1000000L * (1 + (seed >> 20) % 5), (seed >> 28) & 1 ? BUY : SELL));
+    }
+    double secs, lookupSecs, mapSecs, mapLookupSecs, recoverSecs;
+    long long found = 0, mapFound = 0;
+    {
+        TradeJournal journal("benchmark_trades.journal", false);
+        auto start = steady_clock::now();
+        for (auto& trade : trades) journal.Append(trade);
+        secs = duration<double>(steady_clock::now() - start).count();
+        start = steady_clock::now();
+        for (int i = 0; i < numTrades; i += 3) found += journal.Find(trades[i].GetTradeId()) >= 0;
+        lookupSecs = duration<double>(steady_clock::now() - start).count();
+    }
+    {
+        map<string, Trade<Bond> > store;
+        auto start = steady_clock::now();
+        for (auto& trade : trades) {
+            if (store.find(trade.GetTradeId()) != store.end()) store.erase(trade.GetTradeId());
+            store.insert(pair<string, Trade<Bond> >(trade.GetTradeId(), trade));
+        }
+        mapSecs = duration<double>(steady_clock::now() - start).count();
+        start = steady_clock::now();
+        for (int i = 0; i < numTrades; i += 3) mapFound += store.find(trades[i].GetTradeId()) != store.end();
+        mapLookupSecs = duration<double>(steady_clock::now() - start).count();
+    }
+    auto start = steady_clock::now();
+    TradeJournal reopened("benchmark_trades.journal");
+    recoverSecs = duration<double>(steady_clock::now() - start).count();
+    bool recovered = reopened.Size() == numTrades && reopened.Find(trades[numTrades / 2].GetTradeId()) == numTrades / 2;
+    remove("benchmark_trades.journal");
+
+    int lookups = (numTrades + 2) / 3;
+    cout << "TradeJournal: " << numTrades << " trades -> append " << secs * 1e9 / numTrades << " ns, lookup " << lookupSecs * 1e9 / lookups
+        << " ns (map: insert " << mapSecs * 1e9 / numTrades << " ns, lookup " << mapLookupSecs * 1e9 / lookups << " ns), index "
+        << reopened.GetIndexBytes() / 1024 << " KB, restart scan " << recoverSecs * 1000 << " ms"
+        << (recovered && found == mapFound ? "" : " MISMATCH") << endl;
+}
+
+// Id keyed maps: numLookups finds and id copies over numIds order ids, std::string against FixedString
+void BenchmarkIdMaps(int numIds, int numLookups)
+{
+    vector<string> ids;
+    for (int i = 0; i < numIds; ++i) ids.push_back("AE" + IdGenerator(i, 11));
+    vector<OrderId> fixedIds(ids.begin(), ids.end());
+    unordered_map<string, int> stringMap;
+    unordered_map<OrderId, int> fixedMap;
+    for (int i = 0; i < numIds; ++i) {
+        stringMap.insert(pair<string, int>(ids[i], i));
+        fixedMap.insert(pair<OrderId, int>(fixedIds[i], i));
+    }
+    // lookups come from copies of the ids, as when they are read off a message
+    unsigned int seed = 12345;
+    vector<int> order(numLookups);
+    for (auto& o : order) {
+        seed = seed * 1103515245u + 12345u;
+        o = (seed >> 8) % numIds;
+    }
+    long long sum = 0, fixedSum = 0;
+    auto start = steady_clock::now();
+    for (int o : order) {
+        string id = ids[o];
+        sum += stringMap.find(id)->second;
+    }
+    double stringSecs = duration<double>(steady_clock::now() - start).count();
+    start = steady_clock::now();
+    for (int o : order) {
+        OrderId id = fixedIds[o];
+        fixedSum += fixedMap.find(id)->second;
+    }
+    double fixedSecs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "IdMaps: " << numIds << " ids, " << numLookups << " lookups -> string " << stringSecs * 1e9 / numLookups << " ns, FixedString "
+        << fixedSecs * 1e9 / numLookups << " ns" << (sum == fixedSum ? "" : " MISMATCH") << endl;
+}
+
+// Inquiry quoting: numInquiries RFQs through BondInquiryService, inFlight of them queued before the quoter
+// answers, on 100 bonds with live mids, 5 level books and positions, 1ms budget
+void BenchmarkInquiryQuoting(int numInquiries, int inFlight)
+{
+    date maturity = from_string(DEFAULT_SETTLEMENT_DATE) + years(5);
+    vector<Bond> bonds;
+    for (int i = 0; i < 100; ++i) bonds.push_back(Bond("Q" + IdGenerator(i, 8), CUSIP, "UST", 0.02f, maturity));
+
+    QuoteSkewEngine skew(bonds, QuoteSkewEngine::DefaultParameters());
+    InquiryQuotingEngine quoter(bonds, &skew, 1000000);
+    for (int i = 0; i < 100; ++i) {
+        double mid = 99.0 + i / 256.0;
+        vector<Order> bids, offers;
+        for (int l = 0; l < 5; ++l) {
+            bids.push_back(Order(mid - (l + 1) / 256.0, 10000000L * (l + 1), BID));
+            offers.push_back(Order(mid + (l + 1) / 256.0, 10000000L * (l + 1), OFFER));
+        }
+        quoter.UpdatePrice(bonds[i].GetProductId(), mid, 1.0 / 128.0);
+        quoter.UpdateBook(OrderBook<Bond>(bonds[i], bids, offers));
+        skew.UpdatePosition(bonds[i].GetProductId(), 1000000L * (i % 21 - 10));
+    }
+
+    BondInquiryServiceConnector2 connector;
+    BondInquiryService service(&connector, &quoter);
+    vector<Inquiry<Bond> > inquiries;
+    unsigned int seed = 12345;
+    for (int i = 0; i < numInquiries; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        inquiries.push_back(Inquiry<Bond>("RFQ" + IdGenerator(i, 10), bonds[(seed >> 8) % 100], (seed >> 28) & 1 ? BUY : SELL,
+            1000000L * (1 + (seed >> 16) % 40), 0.0, RECEIVED));
+    }
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < numInquiries; i += inFlight) {
+        for (int j = i; j < min(numInquiries, i + inFlight); ++j) service.OnMessage(inquiries[j]);
+        service.QuotePending();
+    }
+    double secs = duration<double>(steady_clock::now() - start).count();
+
+    cout << "InquiryQuoting: " << numInquiries << " RFQs, " << inFlight << " in flight -> " << secs * 1e9 / numInquiries << " ns/RFQ" << endl << "  ";
+    quoter.PrintLatency(cout);
+}
+
+int main() {
+    BenchmarkAlgoEngine(1000);
+    BenchmarkAlgoEngine(10000);
+    BenchmarkPreTradeRisk(10000000);
+    BenchmarkRouter(1000000);
+    BenchmarkPriceStreamRing(1000000, 1, 0);
+    BenchmarkPriceStreamRing(1000000, 4, 0);
+    BenchmarkPriceStreamRing(1000000, 4, 1e6);
+    BenchmarkQuoteTiers(1000000);
+    BenchmarkQuoteDelta(1000000, 1);
+    BenchmarkQuoteDelta(1000000, 4);
+    BenchmarkCurveFit(7, 100000);
+    BenchmarkCurveFit(300, 10000);
+    BenchmarkBondAnalytics(7, 1000000, 0);
+    BenchmarkBondAnalytics(7, 1000000, 1024);
+    BenchmarkBondAnalytics(300, 100000, 0);
+    BenchmarkBondAnalytics(300, 100000, 1024);
+    BenchmarkPositions(100, 1000, 1000000);
+    BenchmarkPositionMatrix(100, 1000, 1000);
+    BenchmarkPositionMatrix(500, 1000, 200);
+    BenchmarkScenarios(3000, 1);
+    BenchmarkScenarios(3000, 0);
+    BenchmarkPnL(1000000, true);
+    BenchmarkPnL(1000000, false);
+    BenchmarkKeyRates(300, 1000000);
+    BenchmarkKeyRates(3000, 1000000);
+    BenchmarkHedgeSolver(1000000, true);
+    BenchmarkHedgeSolver(1000000, false);
+    BenchmarkRiskPath(1000000, false, false);
+    BenchmarkRiskPath(1000000, true, false);
+    BenchmarkRiskPath(1000000, true, true);
+    BenchmarkTradeJournal(1000000);
+    BenchmarkIdMaps(1000, 10000000);
+    BenchmarkIdMaps(1000000, 10000000);
+    BenchmarkInquiryQuoting(1000000, 1);
+    BenchmarkInquiryQuoting(1000000, 1000);
+    BenchmarkInquiryQuoting(1000000, 10000);
+    return 0;
+}
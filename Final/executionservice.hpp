@@ -5,6 +5,7 @@
  * @author Breman Thuraisingham
  * 
  * New: define the AlgoExecution class here
+ * New: define the ExecutionFill class here
  */
 #ifndef EXECUTION_SERVICE_HPP
 #define EXECUTION_SERVICE_HPP
@@ -28,7 +29,7 @@ class ExecutionOrder
 public:
 
   // ctor for an order
-  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+  ExecutionOrder(const T &_product, PricingSide _side, const OrderId& _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, const OrderId& _parentOrderId, bool _isChildOrder);
 
   // Get the product
   const T& GetProduct() const;
@@ -37,7 +38,8 @@ public:
   PricingSide GetSide() const { return side; };
 
   // Get the order ID
-  const string& GetOrderId() const;
+  // New: inline fixed-size ids
+  const OrderId& GetOrderId() const;
 
   // Get the order type on this order
   OrderType GetOrderType() const;
@@ -52,7 +54,7 @@ public:
   long GetHiddenQuantity() const;
 
   // Get the parent order ID
-  const string& GetParentOrderId() const;
+  const OrderId& GetParentOrderId() const;
 
   // Is child order?
   bool IsChildOrder() const;
@@ -60,12 +62,12 @@ public:
 private:
   T product;
   PricingSide side;
-  string orderId;
+  OrderId orderId;
   OrderType orderType;
   double price;
   double visibleQuantity;
   double hiddenQuantity;
-  string parentOrderId;
+  OrderId parentOrderId;
   bool isChildOrder;
 
 };
@@ -87,7 +89,7 @@ public:
 };
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, const OrderId& _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, const OrderId& _parentOrderId, bool _isChildOrder) :
   product(_product)
 {
   side = _side;
@@ -107,7 +109,7 @@ const T& ExecutionOrder<T>::GetProduct() const
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetOrderId() const
+const OrderId& ExecutionOrder<T>::GetOrderId() const
 {
   return orderId;
 }
@@ -137,7 +139,7 @@ long ExecutionOrder<T>::GetHiddenQuantity() const
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetParentOrderId() const
+const OrderId& ExecutionOrder<T>::GetParentOrderId() const
 {
   return parentOrderId;
 }
@@ -162,7 +164,42 @@ public:
     AlgoExecution(ExecutionOrder<T> _exe_order, Market _market = CME) : exe_order(_exe_order), market(_market) {};
 
     ExecutionOrder<T> GetOrder() const { return exe_order; }
-    Market GetMarket() { return market; }
+    Market GetMarket() const { return market; }
+
+};
+
+
+// Define the ExecutionFill class: an execution report sent back by a venue
+// A report with zero quantity and isDone set means the rest of the order was cancelled
+// Type T is the product type.
+template <typename T>
+class ExecutionFill {
+private:
+    T product;
+    OrderId orderId;
+    TradeId tradeId;
+    PricingSide side;
+    double price;
+    long quantity;
+    long leavesQuantity;
+    bool isDone;
+    Market market;
+
+public:
+    // ctor
+    ExecutionFill(const T& _product, const OrderId& _orderId, const TradeId& _tradeId, PricingSide _side, double _price, long _quantity, long _leavesQuantity, bool _isDone, Market _market)
+        : product(_product), orderId(_orderId), tradeId(_tradeId), side(_side), price(_price), quantity(_quantity),
+        leavesQuantity(_leavesQuantity), isDone(_isDone), market(_market) {};
+
+    const T& GetProduct() const { return product; }
+    const OrderId& GetOrderId() const { return orderId; }
+    const TradeId& GetTradeId() const { return tradeId; }
+    PricingSide GetSide() const { return side; }
+    double GetPrice() const { return price; }
+    long GetQuantity() const { return quantity; }
+    long GetLeavesQuantity() const { return leavesQuantity; }
+    bool IsDone() const { return isDone; }
+    Market GetMarket() const { return market; }
 
 };
 #endif
@@ -24,10 +24,11 @@ class Inquiry
 public:
 
   // ctor for an inquiry
-  Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
+  Inquiry(const InquiryId& _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
 
   // Get the inquiry ID
-  const string& GetInquiryId() const;
+  // New: inline fixed-size id
+  const InquiryId& GetInquiryId() const;
 
   // Get the product
   const T& GetProduct() const;
@@ -44,14 +45,14 @@ public:
   // Get the current state on the inquiry
   InquiryState GetState() const;
 
-  // NEW: set the state
+  // NEW: set the state, and the price unless it is left at -1
   void SetState(InquiryState _state, double _price=-1.0) { 
-	  if (price != -1.0) price = _price; 
+	  if (_price != -1.0) price = _price; 
 	  state = _state; 
   };
 
 private:
-  string inquiryId;
+  InquiryId inquiryId;
   T product;
   Side side;
   long quantity;
@@ -72,15 +73,15 @@ class InquiryService : public Service<string,Inquiry <T> >
 public:
 
   // Send a quote back to the client
-	void SendQuote(const string& inquiryId, double price) {};
+	void SendQuote(const InquiryId& inquiryId, double price) {};
 
   // Reject an inquiry from the client
-	void RejectInquiry(const string& inquiryId) {};
+	void RejectInquiry(const InquiryId& inquiryId) {};
 
 };
 
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
+Inquiry<T>::Inquiry(const InquiryId& _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
   product(_product)
 {
   inquiryId = _inquiryId;
@@ -91,7 +92,7 @@ Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quan
 }
 
 template<typename T>
-const string& Inquiry<T>::GetInquiryId() const
+const InquiryId& Inquiry<T>::GetInquiryId() const
 {
   return inquiryId;
 }
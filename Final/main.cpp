@@ -30,6 +30,17 @@
 #include "BondRiskService.hpp"
 #include "GUIService.hpp"
 #include "BondHistoricalDataService.hpp"
+#include "TimerWheel.hpp"
+#include "VenueSimulator.hpp"
+#include "PreTradeRiskGate.hpp"
+#include "BondCurveService.hpp"
+#include "BondAnalytics.hpp"
+#include "PositionMatrix.hpp"
+#include "CurveScenarioEngine.hpp"
+#include "BondPnLService.hpp"
+#include "KeyRateRisk.hpp"
+#include "PV01HedgingEngine.hpp"
+#include "InquiryQuotingEngine.hpp"
 
 using namespace std;
 
@@ -51,16 +62,34 @@ int main() {
     }
     cout << "finished";
     ProductService<Bond>* bondproductservice = new ProductService<Bond>(bonds);
+    // cashflow schedules of the universe built once here, risk follows the live prices
+    BondAnalyticsEngine* bondanalyticsengine = new BondAnalyticsEngine(bondproductservice->GetProducts());
+
+    // shared timer wheel, turned by the price and book timestamps so a run does not depend on the machine
+    TimerWheel* timerwheel = new TimerWheel(EVENT_TIME);
     
     BondPricingService* bondpricingservice = new BondPricingService();
-    BondPricingServiceConnector* bondpricingserviceconnector = new BondPricingServiceConnector(bondpricingservice, bondproductservice);
+    BondPricingServiceConnector* bondpricingserviceconnector = new BondPricingServiceConnector(bondpricingservice, bondproductservice, timerwheel);
 
-    BondAlgoStreamingService* bondalgostreamingservice = new BondAlgoStreamingService();
+    // streamed quotes are skewed by position and risk
+    QuoteSkewEngine* quoteskewengine = new QuoteSkewEngine(bonds, QuoteSkewEngine::DefaultParameters());
+    // four client tiers on every product, SetSchedule overrides a product
+    QuoteTierGenerator* quotetiergenerator = new QuoteTierGenerator(QuoteTierGenerator::DefaultTiers());
+    BondAlgoStreamingService* bondalgostreamingservice = new BondAlgoStreamingService(quoteskewengine, quotetiergenerator);
     BondAlgoStreamingServiceListener* bondalgostreamingservicelistener = new BondAlgoStreamingServiceListener(bondalgostreamingservice);
 
     bondpricingservice->AddListener(bondalgostreamingservicelistener);
 
-    BondStreamingServiceConnector* bondstreamingserviceconnector = new BondStreamingServiceConnector();
+    // fair values off a curve fitted across the pricing stream
+    BondCurveService* bondcurveservice = new BondCurveService(bonds);
+    BondCurveServiceListener* bondcurveservicelistener = new BondCurveServiceListener(bondcurveservice);
+    bondpricingservice->AddListener(bondcurveservicelistener);
+    BondAnalyticsPriceListener* bondanalyticspricelistener = new BondAnalyticsPriceListener(bondanalyticsengine);
+    bondpricingservice->AddListener(bondanalyticspricelistener);
+
+    // quotes fan out through /dev/shm/bond_price_stream, pass print = true to see them on the console
+    PriceStreamShmPublisher* pricestreampublisher = new PriceStreamShmPublisher("/bond_price_stream");
+    BondStreamingServiceConnector* bondstreamingserviceconnector = new BondStreamingServiceConnector(pricestreampublisher, false);
     BondStreamingService* bondstreamingservice = new BondStreamingService(bondstreamingserviceconnector);
     BondStreamingServiceListener* bondstreamingservicelistener = new BondStreamingServiceListener(bondstreamingservice);
 
@@ -70,44 +99,135 @@ int main() {
 
 
     BondMarketDataService* bondmarketdataservice = new BondMarketDataService();
-    BondMarketDataServiceConnector* bondmarketdataserviceconnector = new BondMarketDataServiceConnector(bondmarketdataservice, bondproductservice);
+    BondMarketDataServiceConnector* bondmarketdataserviceconnector = new BondMarketDataServiceConnector(bondmarketdataservice, bondproductservice, timerwheel);
 
-    BondAlgoExecutionService* bondalgoexecutionservice = new BondAlgoExecutionService();
+    // one simulated venue per market, matching against its share of the replayed books when the fills are polled,
+    // venue->Start() would match on its own thread and make the fills depend on the scheduling
+    vector<VenueSimulator*> venues = { new VenueSimulator(BROKERTEC, 0.45), new VenueSimulator(ESPEED, 0.35), new VenueSimulator(CME, 0.2) };
+    BondAlgoExecutionService* bondalgoexecutionservice = new BondAlgoExecutionService(timerwheel);
     BondAlgoExecutionServiceListener* bondalgoexecutionservicelistener = new BondAlgoExecutionServiceListener(bondalgoexecutionservice);
+    BondVenueMarketDataListener* bondvenuemarketdatalistener = new BondVenueMarketDataListener(bondmarketdataservice, venues, &bondalgoexecutionservice->GetRouter());
 
+    // the venues and the router must see a book before the algo trades on it
+    bondmarketdataservice->AddListener(bondvenuemarketdatalistener);
     bondmarketdataservice->AddListener(bondalgoexecutionservicelistener);
 
     BondExecutionServiceConnector* bondexecutionserviceconnector = new BondExecutionServiceConnector();
-    BondExecutionService* bondexecutionservice = new BondExecutionService(bondexecutionserviceconnector);
+    for (auto& venue : venues) {
+        bondexecutionserviceconnector->SetVenue(venue);
+    }
+    // binary order log, add a DebugPrintOrderSink to see the orders on the console
+    bondexecutionserviceconnector->AddSink(new FileOrderSink("orders.bin"));
+    BondExecutionService* bondexecutionservice = new BondExecutionService(bondexecutionserviceconnector, timerwheel);
     BondExecutionServiceListener* bondexecutionservicelistener = new BondExecutionServiceListener(bondexecutionservice);
 
-    bondalgoexecutionservice->AddListener(bondexecutionservicelistener);
+    // every algo order passes the pre-trade risk gate before execution
+    // the algo alternates sides on a global count, so with the tight-spread filter most products only trade one way;
+    // the limits cap that flow at 10 of its 10M clips: 100M face and 200M open notional per product, $150k PV01, 250M per book
+    vector<string> books = { "TRSY1", "TRSY2", "TRSY3" };
+    PreTradeRiskGate* pretraderiskgate = new PreTradeRiskGate(bonds, books, bondanalyticsengine);
+    for (auto& cusip : bondCusip) {
+        pretraderiskgate->SetProductLimits(cusip, 100000000, 200000000.0, 150000.0);
+    }
+    for (auto& book : books) {
+        pretraderiskgate->SetBookLimit(book, 250000000);
+    }
+    pretraderiskgate->SetRateLimit(100000.0, 1000.0);
+    BondPreTradeRiskListener* bondpretraderisklistener = new BondPreTradeRiskListener(pretraderiskgate, bondexecutionservicelistener, bondalgoexecutionservice);
 
+    bondalgoexecutionservice->AddListener(bondpretraderisklistener);
 
 
 
-    BondTradeBookingService* bondtradebookingservice = new BondTradeBookingService();
+
+    // a fresh trade journal for the day, pass true to continue the last one after a restart
+    BondTradeBookingService* bondtradebookingservice = new BondTradeBookingService("trades.journal", false);
     BondTradeBookingServiceConnector* bondtradebookingserviceconnector = new BondTradeBookingServiceConnector(bondtradebookingservice);
-    BondTradeBookingServiceListener* bondtradebookingservicelistener = new BondTradeBookingServiceListener(bondtradebookingservice);
+    BondTradeBookingFillListener* bondtradebookingfilllistener = new BondTradeBookingFillListener(bondtradebookingservice);
+    BondAlgoExecutionFillListener* bondalgoexecutionfilllistener = new BondAlgoExecutionFillListener(bondalgoexecutionservice);
+    BondRiskGateFillListener* bondriskgatefilllistener = new BondRiskGateFillListener(pretraderiskgate);
 
-    bondexecutionservice->AddListener(bondtradebookingservicelistener);
+    // trades are booked from the venue fills, the gate releases the working quantity before the algos send more
+    bondexecutionservice->AddFillListener(bondtradebookingfilllistener);
+    bondexecutionservice->AddFillListener(bondriskgatefilllistener);
+    bondexecutionservice->AddFillListener(bondalgoexecutionfilllistener);
 
     BondPositionService* bondpositionservice = new BondPositionService();
     BondPositionServiceListener* bondpositionservicelistener = new BondPositionServiceListener(bondpositionservice);
 
     bondtradebookingservice->AddListener(bondpositionservicelistener);
 
-    //BondRiskService* bondriskservice = new BondRiskService();
-    //BondRiskServiceListener* bondriskservicelistener = new BondRiskServiceListener(bondriskservice);
-
-    //bondpositionservice->AddListener(bondriskservicelistener);
-
+    // firm-wide books x products matrix for the roll-ups
+    PositionMatrix* positionmatrix = new PositionMatrix(bonds);
+    vector<Bond> frontend = { bonds[0], bonds[1] };
+    vector<Bond> belly = { bonds[2], bonds[3], bonds[4] };
+    vector<Bond> longend = { bonds[5], bonds[6] };
+    positionmatrix->AddSector(BucketedSector<Bond>(frontend, "FrontEnd"));
+    positionmatrix->AddSector(BucketedSector<Bond>(belly, "Belly"));
+    positionmatrix->AddSector(BucketedSector<Bond>(longend, "LongEnd"));
+    BondPositionMatrixListener* bondpositionmatrixlistener = new BondPositionMatrixListener(positionmatrix);
+    bondtradebookingservice->AddListener(bondpositionmatrixlistener);
+
+    // curve stress of the position book on every core
+    WorkStealingPool* workstealingpool = new WorkStealingPool();
+    CurveScenarioEngine* curvescenarioengine = new CurveScenarioEngine(bonds, bondanalyticsengine, workstealingpool);
+    curvescenarioengine->AddBucket(BucketedSector<Bond>(frontend, "FrontEnd"));
+    curvescenarioengine->AddBucket(BucketedSector<Bond>(belly, "Belly"));
+    curvescenarioengine->AddBucket(BucketedSector<Bond>(longend, "LongEnd"));
+    BondScenarioPositionListener* bondscenariopositionlistener = new BondScenarioPositionListener(curvescenarioengine);
+    bondpositionservice->AddListener(bondscenariopositionlistener);
+
+    // key rate PV01 of the book, kept as positions change
+    KeyRateRiskEngine* keyrateriskengine = new KeyRateRiskEngine(bonds, bondanalyticsengine);
+    BondKeyRatePositionListener* bondkeyratepositionlistener = new BondKeyRatePositionListener(keyrateriskengine);
+    bondpositionservice->AddListener(bondkeyratepositionlistener);
+
+    // key rate hedges in the benchmarks, checked every 50ms after the key rates have moved, at most 10 a second
+    PV01HedgingEngine* pv01hedgingengine = new PV01HedgingEngine(bonds, keyrateriskengine, bondalgoexecutionservice, timerwheel, 50);
+    pv01hedgingengine->SetThreshold(1000.0);
+    pv01hedgingengine->SetTrigger(5000.0);
+    pv01hedgingengine->SetRateLimit(10.0, 7.0);
+    BondHedgingPositionListener* bondhedgingpositionlistener = new BondHedgingPositionListener(pv01hedgingengine);
+    BondHedgingPriceListener* bondhedgingpricelistener = new BondHedgingPriceListener(pv01hedgingengine);
+    bondpositionservice->AddListener(bondhedgingpositionlistener);
+    bondpricingservice->AddListener(bondhedgingpricelistener);
+
+    // intraday P&L of the booked trades marked to the mids, snapshots every 100ms
+    BondPnLService* bondpnlservice = new BondPnLService(bonds, timerwheel, 100);
+    BondPnLTradeListener* bondpnltradelistener = new BondPnLTradeListener(bondpnlservice);
+    BondPnLPriceListener* bondpnlpricelistener = new BondPnLPriceListener(bondpnlservice);
+    bondtradebookingservice->AddListener(bondpnltradelistener);
+    bondpricingservice->AddListener(bondpnlpricelistener);
+
+    BondRiskGatePositionListener* bondriskgatepositionlistener = new BondRiskGatePositionListener(pretraderiskgate, books);
+    bondpositionservice->AddListener(bondriskgatepositionlistener);
+    BondQuoteSkewPositionListener* bondquoteskewpositionlistener = new BondQuoteSkewPositionListener(quoteskewengine);
+    bondpositionservice->AddListener(bondquoteskewpositionlistener);
+
+    BondRiskService* bondriskservice = new BondRiskService(bondanalyticsengine);
+    BondRiskServiceListener* bondriskservicelistener = new BondRiskServiceListener(bondriskservice);
+    bondriskservice->AddSector(BucketedSector<Bond>(frontend, "FrontEnd"));
+    bondriskservice->AddSector(BucketedSector<Bond>(belly, "Belly"));
+    bondriskservice->AddSector(BucketedSector<Bond>(longend, "LongEnd"));
+
+    bondpositionservice->AddListener(bondriskservicelistener);
+    BondQuoteSkewRiskListener* bondquoteskewrisklistener = new BondQuoteSkewRiskListener(quoteskewengine);
+    bondriskservice->AddListener(bondquoteskewrisklistener);
+
+
+    // RFQs priced off the live mid, the book depth and the position skew
+    // the drain deadline is on the 1ms wheel, so the budget leaves a 2ms batch window
+    InquiryQuotingEngine* inquiryquotingengine = new InquiryQuotingEngine(bonds, quoteskewengine, 4000000);
+    BondInquiryPriceListener* bondinquirypricelistener = new BondInquiryPriceListener(inquiryquotingengine);
+    bondpricingservice->AddListener(bondinquirypricelistener);
+    BondInquiryMarketDataListener* bondinquirymarketdatalistener = new BondInquiryMarketDataListener(inquiryquotingengine, bondmarketdataservice);
+    bondmarketdataservice->AddListener(bondinquirymarketdatalistener);
 
     BondInquiryServiceConnector2* bis_conn2 = new BondInquiryServiceConnector2();
-    BondInquiryService* bondinquiryservice = new BondInquiryService(bis_conn2);
+    BondInquiryService* bondinquiryservice = new BondInquiryService(bis_conn2, inquiryquotingengine, timerwheel);
     BondInquiryServiceConnector* bondinquiryserviceconnector = new BondInquiryServiceConnector(bondinquiryservice, bondproductservice);
 
-    GUIService<Bond>* guiservice = new GUIService<Bond>();
+    GUIService<Bond>* guiservice = new GUIService<Bond>(timerwheel);
     GUIConnector<Bond>* guiserviceconnector = new GUIConnector<Bond>(guiservice);
     GUIServiceListener<Bond>* guiservicelistener = new GUIServiceListener<Bond>(guiservice);
 
@@ -122,9 +242,10 @@ int main() {
     bondpositionservice->AddListener(bondhistoricalpositionservicelistener);
 
     BondHistoricalRiskServiceConnector* bondhistoricalriskserviceconnector = new BondHistoricalRiskServiceConnector();
-    BondHistoricalRiskService* bondhistoricalriskservice = new BondHistoricalRiskService(bondhistoricalriskserviceconnector);
+    // only the latest risk of every product is written, every 100ms
+    BondHistoricalRiskService* bondhistoricalriskservice = new BondHistoricalRiskService(bondhistoricalriskserviceconnector, timerwheel, 100);
     BondHistoricalRiskServiceListener* bondhistoricalriskservicelistener = new BondHistoricalRiskServiceListener(bondhistoricalriskservice);
-    //bondriskservice->AddListener(bondhistoricalriskservicelistener);
+    bondriskservice->AddListener(bondhistoricalriskservicelistener);
 
     BondHistoricalExecutionServiceConnector* bondhistoricalexecutionserviceconnector = new BondHistoricalExecutionServiceConnector();
     BondHistoricalExecutionService* bondhistoricalexecutionservice = new BondHistoricalExecutionService(bondhistoricalexecutionserviceconnector);
@@ -142,10 +263,90 @@ int main() {
     bondinquiryservice->AddListener(bondhistoricalinquiryservicelistener);
 
 
-    bondpricingserviceconnector->Subscribe();
-    bondmarketdataserviceconnector->Subscribe();
+    // prices and books merged on their timestamps, the prices first at the same time
+    long long replaytime = 0;
+    while (replaytime >= 0) {
+        long long nextprice = bondpricingserviceconnector->Replay(replaytime);
+        long long nextbook = bondmarketdataserviceconnector->Replay(replaytime);
+        replaytime = nextprice < 0 ? nextbook : nextbook < 0 ? nextprice : min(nextprice, nextbook);
+    }
+    // trades and inquiries carry no timestamps, they come in at the end of the replay
     bondtradebookingserviceconnector->Subscribe();
     bondinquiryserviceconnector->Subscribe();
+
+    // run out the TWAP slices and RFQ deadlines still on the wheel
+    timerwheel->Flush();
+    bondhistoricalinquiryserviceconnector->Flush();
+
+    // drain the last execution reports
+    for (auto& venue : venues) {
+        venue->Stop();
+    }
+    bondexecutionservice->ProcessFills();
+    bondhistoricalriskservice->Flush();
+    bondexecutionserviceconnector->Flush();
+    bondexecutionserviceconnector->GetEgressLatency().Print(cout);
+    cout << "Fills: " << bondexecutionservice->GetFillCount()
+        << "\tavg round trip (us): " << bondexecutionservice->GetAverageRoundTrip()
+        << "\tmax round trip (us): " << bondexecutionservice->GetMaxRoundTrip()
+        << "\tuntracked orders: " << bondexecutionservice->GetUntracked() << endl;
+    pretraderiskgate->PrintRejectionReport(cout);
+    cout << "Curve: " << bondcurveservice->GetFits() << " refits\tavg iterations: " << bondcurveservice->GetAverageIterations()
+        << "\tavg refit (us): " << bondcurveservice->GetAverageFitTime() << "\trmse: " << bondcurveservice->GetFitter().GetRmse() << endl;
+    const QuoteDeltaEncoder& quotes = bondstreamingservice->GetEncoder();
+    cout << "Quotes: " << quotes.GetPublished() << " published, " << quotes.GetSuppressed() << " suppressed ("
+        << quotes.GetSuppressionRatio() * 100 << "%)\tdelta bytes: " << quotes.GetBytes() << " (avg " << quotes.GetAverageBytes() << " per message)" << endl;
+    const AnalyticsTickCache& analyticscache = bondanalyticsengine->GetCache();
+    cout << "Analytics: " << bondanalyticsengine->GetSolves() << " yield solves\tcache hit rate: " << analyticscache.GetHitRate() * 100
+        << "% (" << analyticscache.GetHits() << " hits, " << analyticscache.GetEvictions() << " evictions)" << endl;
+    vector<long long> sectortotals;
+    positionmatrix->RollupSectors(sectortotals);
+    cout << "Positions: firm " << positionmatrix->RollupFirm();
+    for (int i = 0; i < positionmatrix->GetSectors(); ++i) {
+        cout << "\t" << positionmatrix->GetSectorName(i) << " " << sectortotals[i];
+    }
+    for (int i = 0; i < positionmatrix->GetBooks(); ++i) {
+        cout << "\t" << BookRegistry::GetBook(i) << " " << positionmatrix->RollupBook(i);
+    }
+    cout << endl;
+    bondpnlservice->Flush();
+    cout << "P&L: total " << bondpnlservice->GetTotal();
+    for (auto& book : books) {
+        cout << "\t" << book << " realized " << bondpnlservice->GetBookRealized(book) << " unrealized " << bondpnlservice->GetBookUnrealized(book);
+    }
+    cout << "\t(" << bondpnlservice->GetTrades() << " trades, " << bondpnlservice->GetTicks() << " ticks, "
+        << bondpnlservice->GetPublished() << " snapshots)" << endl;
+    const KeyRateVector& keyrates = keyrateriskengine->GetPortfolio();
+    cout << "Key rate PV01:";
+    for (int i = 0; i < KEY_RATES; ++i) cout << "\t" << KEY_RATE_TENORS[i] << "y " << keyrates.value[i];
+    cout << "\ttotal " << keyrateriskengine->GetPortfolioPV01() << endl;
+    TradeJournal& journal = bondtradebookingservice->GetJournal();
+    cout << "Journal: " << journal.Size() << " trades, " << journal.GetTradeIds() << " trade ids, index "
+        << journal.GetIndexBytes() / 1024 << " KB" << endl;
+    cout << "Risk:";
+    for (auto& sector : { "FrontEnd", "Belly", "LongEnd" }) {
+        cout << "\t" << sector << " " << bondriskservice->GetBucketedRisk(string(sector)).GetPV01();
+    }
+    cout << "\t(" << bondhistoricalriskservice->GetPersisted() << " updates, " << bondhistoricalriskservice->GetWritten() << " written)" << endl;
+    cout << "Hedging: " << pv01hedgingengine->GetHedges() << " hedges (" << pv01hedgingengine->GetHedgedQuantity() << " face), "
+        << pv01hedgingengine->GetRateLimited() << " rate limited, " << pv01hedgingengine->GetCancelled() << " cancelled, "
+        << pv01hedgingengine->GetTriggered() << " triggered by updates\t"
+        << pv01hedgingengine->GetSolver().GetSolves() << " solves on " << pv01hedgingengine->GetSolver().GetFactorizations()
+        << " factorizations\tresidual PV01 " << pv01hedgingengine->GetResidualPV01() << endl;
+    inquiryquotingengine->PrintLatency(cout);
+    ScenarioPnL stress = curvescenarioengine->Run(CurveScenarioEngine::StandardScenarios());
+    cout << "Stress: " << stress.scenarios.size() << " scenarios in " << curvescenarioengine->GetLastRunTime() * 1000 << " ms";
+    for (int i = 0; i < (int)stress.buckets.size(); ++i) {
+        int worst = stress.Worst(i);
+        cout << "\t" << stress.buckets[i] << " worst " << stress.scenarios[worst] << " " << stress.Get(worst, i);
+    }
+    cout << endl;
+    SmartOrderRouter& router = bondalgoexecutionservice->GetRouter();
+    cout << "Routed: BROKERTEC " << router.GetRouted(BROKERTEC) << "\tESPEED " << router.GetRouted(ESPEED)
+        << "\tCME " << router.GetRouted(CME) << "\tsplit orders: " << router.GetSplitOrders() << endl;
+
+    // no more quotes, drop /dev/shm/bond_price_stream, readers still mapped keep their view
+    pricestreampublisher->Unlink();
     
     return 0;
     
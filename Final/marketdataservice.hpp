@@ -90,8 +90,8 @@ public:
   // Get the offer stack
   const vector<Order>& GetOfferStack() const;
 
-  // NEW: GetBestBidOffer
-  const BidOffer& GetBestBidOffer() const {
+  // NEW: GetBestBidOffer, by value since the BidOffer is built on the fly
+  BidOffer GetBestBidOffer() const {
       auto bid_max = bidStack[0];
       auto offer_min = offerStack[0];
 
@@ -103,7 +103,7 @@ public:
           offer_min = offerStack[i].GetPrice() < offer_min.GetPrice() ? offerStack[i] : offer_min;
       }
 
-      return std::move(BidOffer(bid_max, offer_min));
+      return BidOffer(bid_max, offer_min);
   }
 
 private:
@@ -125,7 +125,8 @@ class MarketDataService : public Service<string,OrderBook <T> >
 public:
 
   // Get the best bid/offer order
-  virtual const BidOffer& GetBestBidOffer(const string &productId) = 0;
+  // NEW: by value, the BidOffer is built from the book
+  virtual BidOffer GetBestBidOffer(const string &productId) = 0;
 
   // Aggregate the order book
   virtual const OrderBook<T>& AggregateDepth(const string &productId) = 0;
@@ -9,14 +9,45 @@
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
 
 using namespace std;
 
+/**
+ * New: dense ids of the trading books, shared by every position.
+ * A book gets the next index the first time it is seen.
+ */
+class BookRegistry
+{
+
+public:
+
+  // Index of a book, interned on first use
+  static int GetIndex(const string &book);
+
+  // Index of a book, -1 if never seen
+  static int Find(const string &book);
+
+  // Book name of an index
+  static const string& GetBook(int index);
+
+  // Number of books
+  static int Size();
+
+private:
+  static unordered_map<string,int>& Index();
+  static vector<string>& Books();
+
+};
+
 /**
  * Position class in a particular book.
  * Type T is the product type.
+ * New: positions are kept per book index with a running aggregate,
+ * so a trade and the aggregate are both O(1).
  */
 template<typename T>
 class Position
@@ -31,17 +62,24 @@ public:
   const T& GetProduct() const;
 
   // Get the position quantity
-  long GetPosition(string &book);
+  long GetPosition(const string &book) const;
+
+  // New: position quantity of a book index
+  long GetPosition(int bookIndex) const;
 
   // Get the aggregate position
-  long GetAggregatePosition();
+  long GetAggregatePosition() const;
 
   // New created - Change the position
-  void AddPosition(string id, long _position);
+  void AddPosition(const string &book, long _position);
+
+  // New: change the position of a book index
+  void AddPosition(int bookIndex, long _position);
 
 private:
   T product;
-  map<string,long> positions; // book -> pos for the product
+  vector<long> positions; // book index -> pos for the product
+  long aggregate;
 
 };
 
@@ -61,9 +99,47 @@ public:
 
 };
 
+inline int BookRegistry::GetIndex(const string &book)
+{
+  auto it = Index().find(book);
+  if (it != Index().end()) return it->second;
+  int index = (int)Books().size();
+  Index().insert(pair<string,int>(book, index));
+  Books().push_back(book);
+  return index;
+}
+
+inline int BookRegistry::Find(const string &book)
+{
+  auto it = Index().find(book);
+  return it == Index().end() ? -1 : it->second;
+}
+
+inline const string& BookRegistry::GetBook(int index)
+{
+  return Books()[index];
+}
+
+inline int BookRegistry::Size()
+{
+  return (int)Books().size();
+}
+
+inline unordered_map<string,int>& BookRegistry::Index()
+{
+  static unordered_map<string,int> index;
+  return index;
+}
+
+inline vector<string>& BookRegistry::Books()
+{
+  static vector<string> books;
+  return books;
+}
+
 template<typename T>
 Position<T>::Position(const T &_product) :
-  product(_product)
+  product(_product), aggregate(0)
 {
 }
 
@@ -74,33 +150,38 @@ const T& Position<T>::GetProduct() const
 }
 
 template<typename T>
-long Position<T>::GetPosition(string &book)
+long Position<T>::GetPosition(const string &book) const
 {
-  return positions[book];
+  return GetPosition(BookRegistry::Find(book));
 }
 
 template<typename T>
-long Position<T>::GetAggregatePosition()
+long Position<T>::GetPosition(int bookIndex) const
 {
-  // (No-op implementation - should be filled out for implementations) finished
-    long sum = 0;
-    for (auto& pos : positions) {
-        sum += pos.second;
-    }
-    return sum;
+  return (bookIndex >= 0 && bookIndex < (int)positions.size()) ? positions[bookIndex] : 0;
+}
+
+template<typename T>
+long Position<T>::GetAggregatePosition() const
+{
+  // running sum of the books, kept by AddPosition
+  return aggregate;
 }
 
 // 
 template<typename T>
-void Position<T>::AddPosition(string book, long position) {
-    if (positions.find(book) != positions.end()) {
-        // already in the map, change the position
-        positions[book] += position;
-    }
-    else {
-        // not in the map, create a new element
-        positions.insert(pair<string, long>(book, position));
+void Position<T>::AddPosition(const string &book, long position) {
+    AddPosition(BookRegistry::GetIndex(book), position);
+}
+
+template<typename T>
+void Position<T>::AddPosition(int bookIndex, long position) {
+    if (bookIndex >= (int)positions.size()) {
+        // first trade of this book on the product
+        positions.resize(BookRegistry::Size() > bookIndex ? BookRegistry::Size() : bookIndex + 1, 0);
     }
+    positions[bookIndex] += position;
+    aggregate += position;
 }
 
 #endif
@@ -12,6 +12,7 @@
 #include <string>
 
 #include "boost/date_time/gregorian/gregorian.hpp"
+#include "FixedString.hpp"
 
 using namespace std;
 using namespace boost::gregorian;
@@ -27,16 +28,17 @@ class Product
 public:
 
   // ctor for a prduct
-  Product(string _productId, ProductType _productType);
+  Product(const ProductId& _productId, ProductType _productType);
 
   // Get the product identifier
-  const string& GetProductId() const;
+  // New: inline fixed-size id, converts to string where one is needed
+  const ProductId& GetProductId() const;
 
   // Ge the product type
   ProductType GetProductType() const;
 
 private:
-  string productId;
+  ProductId productId;
   ProductType productType;
 
 };
@@ -52,7 +54,7 @@ class Bond : public Product
 public:
 
   // ctor for a bond
-  Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, date _maturityDate);
+  Bond(const ProductId& _productId, BondIdType _bondIdType, string _ticker, float _coupon, date _maturityDate);
   Bond();
 
   // Get the ticker
@@ -160,13 +162,13 @@ private:
 
 };
 
-Product::Product(string _productId, ProductType _productType)
+Product::Product(const ProductId& _productId, ProductType _productType)
 {
   productId = _productId;
   productType = _productType;
 }
 
-const string& Product::GetProductId() const
+const ProductId& Product::GetProductId() const
 {
   return productId;
 }
@@ -176,7 +178,7 @@ ProductType Product::GetProductType() const
   return productType;
 }
 
-Bond::Bond(string _productId, BondIdType _bondIdType, string _ticker, float _coupon, date _maturityDate) : Product(_productId, BOND)
+Bond::Bond(const ProductId& _productId, BondIdType _bondIdType, string _ticker, float _coupon, date _maturityDate) : Product(_productId, BOND)
 {
   bondIdType = _bondIdType;
   ticker = _ticker;
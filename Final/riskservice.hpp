@@ -32,6 +32,9 @@ public:
   // Get the quantity that this risk value is associated with
   long GetQuantity() const { return quantity; };
 
+  // New: change the value in place, the product is not copied again
+  void Update(double _pv01, long _quantity) { pv01 = _pv01; quantity = _quantity; }
+
 private:
   T product;
   double pv01;
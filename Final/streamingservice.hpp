@@ -44,6 +44,18 @@ private:
 
 };
 
+// New: the quote tiers of a multi-tier price stream, tier 0 is the bid/offer order
+static const int MAX_QUOTE_TIERS = 8;
+
+struct QuoteTiers
+{
+  int count;
+  double bidPrice[MAX_QUOTE_TIERS];
+  double offerPrice[MAX_QUOTE_TIERS];
+  long bidQuantity[MAX_QUOTE_TIERS];
+  long offerQuantity[MAX_QUOTE_TIERS];
+};
+
 /**
  * Price Stream with a two-way market.
  * Type T is the product type.
@@ -66,10 +78,15 @@ public:
   // Get the offer order
   const PriceStreamOrder& GetOfferOrder() const;
 
+  // New: client tiers, count is 0 for a single two-way quote
+  const QuoteTiers& GetTiers() const { return tiers; }
+  void SetTiers(const QuoteTiers &_tiers) { tiers = _tiers; }
+
 private:
   T product;
   PriceStreamOrder bidOrder;
   PriceStreamOrder offerOrder;
+  QuoteTiers tiers;
 
 };
 
@@ -116,6 +133,7 @@ template<typename T>
 PriceStream<T>::PriceStream(const T &_product, const PriceStreamOrder &_bidOrder, const PriceStreamOrder &_offerOrder) :
   product(_product), bidOrder(_bidOrder), offerOrder(_offerOrder)
 {
+  tiers.count = 0;
 }
 
 template<typename T>
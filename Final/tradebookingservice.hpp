@@ -25,13 +25,14 @@ class Trade
 public:
 
   // ctor for a trade
-  Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+  Trade(const T &_product, const TradeId& _tradeId, double _price, string _book, long _quantity, Side _side);
 
   // Get the product
   const T& GetProduct() const;
 
   // Get the trade ID
-  const string& GetTradeId() const;
+  // New: inline fixed-size id
+  const TradeId& GetTradeId() const;
 
   // Get the mid price
   double GetPrice() const;
@@ -47,7 +48,7 @@ public:
 
 private:
   T product;
-  string tradeId;
+  TradeId tradeId;
   double price;
   string book;
   long quantity;
@@ -72,7 +73,7 @@ public:
 };
 
 template<typename T>
-Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
+Trade<T>::Trade(const T &_product, const TradeId& _tradeId, double _price, string _book, long _quantity, Side _side) :
   product(_product)
 {
   tradeId = _tradeId;
@@ -89,7 +90,7 @@ const T& Trade<T>::GetProduct() const
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const
+const TradeId& Trade<T>::GetTradeId() const
 {
   return tradeId;
 }